@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+
+#
+#  This file is part of MADNESS.
+#
+#  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+#
+#  For more information please contact:
+#
+#  Robert J. Harrison
+#  Oak Ridge National Laboratory
+#  One Bethel Valley Road
+#  P.O. Box 2008, MS-6367
+#
+#  email: harrisonrj@ornl.gov
+#  tel:   865-241-3937
+#  fax:   865-572-0680
+#
+
+# Merges the per-process timelines written when MAD_TIMELINE is set
+# into a single Chrome trace, with one process track per rank.
+#
+#   timeline_merge.py trace            merges trace.0.json, trace.1.json, ...
+#   timeline_merge.py a.json b.json    merges the named files
+#
+# The result (trace.json by default, see -o) can be opened in
+# chrome://tracing or https://ui.perfetto.dev.  With --summary the total
+# time and count of each task and message handler is also printed.
+
+import argparse
+import glob
+import json
+import os
+import re
+import sys
+
+
+def rank_of(filename):
+    m = re.search(r"\.(\d+)\.json$", filename)
+    return int(m.group(1)) if m else -1
+
+
+def input_files(args):
+    if len(args) == 1 and not os.path.isfile(args[0]):
+        files = [f for f in glob.glob(args[0] + ".*.json") if rank_of(f) >= 0]
+        files.sort(key=rank_of)
+        if not files:
+            sys.exit("timeline_merge: no files match %s.<rank>.json" % args[0])
+        return files
+    return args
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Merge MADNESS timelines into one Chrome trace")
+    parser.add_argument("inputs", nargs="+", help="timeline prefix (value of MAD_TIMELINE) or files")
+    parser.add_argument("-o", "--output", help="output file (default <prefix>.json or trace.json)")
+    parser.add_argument("--summary", action="store_true", help="print time per task and message handler")
+    args = parser.parse_args()
+
+    files = input_files(args.inputs)
+    output = args.output
+    if not output:
+        output = args.inputs[0] + ".json" if len(args.inputs) == 1 and files != args.inputs else "trace.json"
+    if output in files:
+        sys.exit("timeline_merge: output %s would overwrite an input" % output)
+
+    events = []
+    dropped = 0
+    for f in files:
+        with open(f) as fp:
+            data = json.load(fp)
+        events.extend(data["traceEvents"])
+        dropped += data.get("otherData", {}).get("dropped_events", 0)
+
+    with open(output, "w") as fp:
+        json.dump({"traceEvents": events,
+                   "displayTimeUnit": "ms",
+                   "otherData": {"nproc": len(files), "dropped_events": dropped}}, fp)
+    print("timeline_merge: wrote %d events from %d files to %s" % (len(events), len(files), output))
+    if dropped:
+        print("timeline_merge: %d events were dropped while recording" % dropped)
+
+    if args.summary:
+        totals = {}
+        for e in events:
+            if e.get("ph") == "X" and e.get("cat") in ("task", "rmi", "am"):
+                t = totals.setdefault((e["cat"], e["name"]), [0.0, 0])
+                t[0] += e["dur"]
+                t[1] += 1
+        print("%12s %10s %12s  %s" % ("total (s)", "count", "mean (us)", "name"))
+        for (cat, name), (dur, n) in sorted(totals.items(), key=lambda x: -x[1][0])[:40]:
+            print("%12.6f %10d %12.3f  %s: %s" % (dur * 1e-6, n, dur / n, cat, name))
+
+
+if __name__ == "__main__":
+    main()
@@ -37,6 +37,7 @@
 #include <limits.h>
 #include <madness/tensor/tensor.h>
 #include <madness/mra/simplecache.h>
+#include <madness/mra/rnlp_disk_cache.h>
 #include <madness/mra/adquad.h>
 #include <madness/mra/twoscale.h>
 #include <madness/tensor/aligned.h>
@@ -304,6 +305,11 @@ namespace madness {
         /// Returns true if the block of rnlp is expected to be small
         virtual bool issmall(Level n, Translation lx) const = 0;
 
+        /// Fills in the key of block n,lx in RnlpDiskCache and returns true, or returns false if it cannot be stored
+        virtual bool disk_cache_key(Level n, Translation lx, RnlpDiskCache::Key& key) const {
+            return false;
+        }
+
         /// Returns true if the block of rnlp is expected to be small including periodicity
         bool get_issmall(Level n, Translation lx) const {
             if (maxR == 0) {
@@ -336,6 +342,7 @@ namespace madness {
         const Tensor<Q>& rnlij(Level n, Translation lx, bool do_transpose=false) const {
             const Tensor<Q>* p=rnlij_cache.getptr(n,lx);
             if (p) return *p;
+            SimpleCacheBuildTimer build_timer;
 
             // PROFILE_MEMBER_FUNC(Convolution1D); // Too fine grain for routine profiling
 
@@ -369,6 +376,7 @@ namespace madness {
             const Key<2> cache_key(n, Vector<Translation,2>{lx, s_off} );
             const ConvolutionData1D<Q>* p = mod_ns_cache.getptr(cache_key);
             if (p) return p;
+            SimpleCacheBuildTimer build_timer;
 
             // for paranoid me
             MADNESS_ASSERT(sx>=0 and tx>=0);
@@ -426,6 +434,7 @@ namespace madness {
         const ConvolutionData1D<Q>* nonstandard(Level n, Translation lx) const {
             const ConvolutionData1D<Q>* p = ns_cache.getptr(n,lx);
             if (p) return p;
+            SimpleCacheBuildTimer build_timer;
 
             // PROFILE_MEMBER_FUNC(Convolution1D); // Too fine grain for routine profiling
 
@@ -498,12 +507,25 @@ namespace madness {
         const Tensor<Q>& get_rnlp(Level n, Translation lx) const {
             const Tensor<Q>* p=rnlp_cache.getptr(n,lx);
             if (p) return *p;
+            SimpleCacheBuildTimer build_timer;
 
             // PROFILE_MEMBER_FUNC(Convolution1D); // Too fine grain for routine profiling
 
             long twok = 2*k;
             Tensor<Q> r;
 
+            // Blocks that are not small may be in the persistent cache
+            RnlpDiskCache::Key disk_key;
+            const bool on_disk = !get_issmall(n, lx) && RnlpDiskCache::enabled() && disk_cache_key(n, lx, disk_key);
+            const std::size_t nval = twok*sizeof(Q)/sizeof(double);
+            if (on_disk) {
+                r = Tensor<Q>(twok);
+                if (RnlpDiskCache::get(disk_key, reinterpret_cast<double*>(r.ptr()), nval)) {
+                    rnlp_cache.set(n, lx, r);
+                    return *rnlp_cache.getptr(n,lx);
+                }
+            }
+
             if (get_issmall(n, lx)) {
                 r = Tensor<Q>(twok);
             }
@@ -530,6 +552,7 @@ namespace madness {
                 }
             }
 
+            if (on_disk) RnlpDiskCache::put(disk_key, reinterpret_cast<const double*>(r.ptr()), nval);
             rnlp_cache.set(n, lx, r);
             //print("   SET rnlp", n, lx, r);
             return *rnlp_cache.getptr(n,lx);
@@ -842,6 +865,20 @@ namespace madness {
 
             return (beta*ll*ll > 49.0);      // 49 -> 5e-22     69 -> 1e-30
         };
+
+        bool disk_cache_key(Level n, Translation lx, RnlpDiskCache::Key& key) const {
+            key.expnt = expnt;
+            key.coeff_re = std::real(coeff);
+            key.coeff_im = std::imag(coeff);
+            key.arg = this->arg;
+            key.translation = lx;
+            key.k = this->k;
+            key.m = m;
+            key.maxR = Convolution1D<Q>::maxR;
+            key.level = n;
+            key.is_complex = TensorTypeData<Q>::iscomplex;
+            return true;
+        }
     };
 
 
@@ -184,6 +184,7 @@ namespace madness {
         static bool debug;             ///< Controls output of debug info
         static bool truncate_on_project; ///< If true initial projection inserts at n-1 not n
         static bool apply_randomize;   ///< If true use randomization for load balancing in apply integral operator
+        static bool apply_coalesce;    ///< If true batch remote results of apply per destination process
         static bool project_randomize; ///< If true use randomization for load balancing in project/refine
         static BoundaryConditions<NDIM> bc; ///< Default boundary conditions
         static Tensor<double> cell ;   ///< cell[NDIM][2] Simulation cell, cell(0,0)=xlo, cell(0,1)=xhi, ...
@@ -350,6 +351,19 @@ namespace madness {
         }
 
 
+        /// Gets the flag for batching remote results of integral operators
+        static bool get_apply_coalesce() {
+            return apply_coalesce;
+        }
+
+        /// Sets the flag for batching remote results of integral operators
+
+        /// If true, results of do_apply destined for the same process are
+        /// summed and sent in one message instead of one message per box.
+        static void set_apply_coalesce(bool value) {
+            apply_coalesce=value;
+        }
+
         /// Gets the random load balancing for projection flag
         static bool get_project_randomize() {
             return project_randomize;
@@ -48,6 +48,7 @@
 #include <madness/mra/key.h>
 #include <madness/mra/funcdefaults.h>
 #include <madness/mra/function_factory.h>
+#include <madness/mra/lbsfc.h>
 
 #include "leafop.h"
 
@@ -107,6 +108,9 @@ namespace madness {
 
         LevelPmap(World& world) : nproc(world.nproc()) {}
 
+        /// Makes the map for a given number of processes (for analysis)
+        LevelPmap(int nproc) : nproc(nproc) {}
+
         /// Find the owner of a given key
         ProcessID owner(const keyT& key) const {
             Level n = key.level();
@@ -1783,6 +1787,7 @@ namespace madness {
         template <typename L, typename R>
         void do_mul(const keyT& key, const Tensor<L>& left, const std::pair< keyT, Tensor<R> >& arg) {
             // PROFILE_MEMBER_FUNC(FunctionImpl); // Too fine grain for routine profiling
+            const double time0 = NodeCostRecorder<NDIM>::enabled() ? wall_time() : 0.0;
             const keyT& rkey = arg.first;
             const Tensor<R>& rcoeff = arg.second;
             //madness::print("do_mul: r", rkey, rcoeff.size());
@@ -1795,6 +1800,7 @@ namespace madness {
             double scale = pow(0.5,0.5*NDIM*key.level())*sqrt(FunctionDefaults<NDIM>::get_cell_volume());
             tcube = transform(tcube,cdata.quad_phiw).scale(scale);
             coeffs.replace(key, nodeT(coeffT(tcube,targs),false));
+            if (NodeCostRecorder<NDIM>::enabled()) NodeCostRecorder<NDIM>::record(key, wall_time()-time0);
         }
 
 
@@ -4425,6 +4431,7 @@ namespace madness {
             typedef typename opT::keyT opkeyT;
             static const size_t opdim=opT::opdim;
             const opkeyT source=op->get_source_key(key);
+            const double time0 = NodeCostRecorder<NDIM>::enabled() ? wall_time() : 0.0;
 
             
             // Tuning here is based on observation that with
@@ -4453,6 +4460,8 @@ namespace madness {
             const std::vector<bool> is_periodic(NDIM,false); // Periodic sum is already done when making rnlp
 	    int ndone=1;	// Counts #done at each distance
 	    uint64_t distsq = 99999999999999; 
+            const bool coalesce = FunctionDefaults<NDIM>::get_apply_coalesce();
+            apply_batch_buffer outgoing(this);
             for (typename std::vector<opkeyT>::const_iterator it=disp.begin(); it != disp.end(); ++it) {
 	        keyT d;
                 Key<NDIM-opdim> nullkey(key.level());
@@ -4483,12 +4492,79 @@ namespace madness {
 			if (result.normf() > 0.3*tol/fac) {
 			  if (coeffs.is_local(dest))
 			      coeffs.send(dest, &nodeT::accumulate2, result, coeffs, dest);
+			  else if (coalesce)
+			      outgoing.add(coeffs.owner(dest), dest, result);
 			  else
   			      coeffs.task(dest, &nodeT::accumulate2, result, coeffs, dest);
                         }
                     }
                 }
             }
+            outgoing.flush();
+            if (NodeCostRecorder<NDIM>::enabled()) NodeCostRecorder<NDIM>::record(key, wall_time()-time0);
+        }
+
+        /// Buffers remote results of do_apply and sends them batched per destination process
+
+        /// One source box contributes to many neighboring boxes, most of
+        /// which live on a handful of processes.  Rather than one active
+        /// message per contribution, results are collected per owner and
+        /// sent as a single accumulate_batch task once a batch exceeds
+        /// max_batch_size elements or when flush() is called.
+        /// Contributions to the same destination key are summed locally.
+        class apply_batch_buffer {
+            typedef std::map< keyT, tensorT > batchT;
+            static const size_t max_batch_size = 16*1024*1024/sizeof(T);
+
+            implT* impl;
+            std::map<ProcessID, batchT> batches;
+            std::map<ProcessID, size_t> sizes;
+
+            void flush(ProcessID p, batchT& batch) {
+                if (batch.empty()) return;
+                std::vector<keyT> keys;
+                std::vector<tensorT> values;
+                keys.reserve(batch.size());
+                values.reserve(batch.size());
+                for (typename batchT::iterator it=batch.begin(); it!=batch.end(); ++it) {
+                    keys.push_back(it->first);
+                    values.push_back(it->second);
+                }
+                batch.clear();
+                sizes[p]=0;
+                impl->woT::task(p, &implT::accumulate_batch, keys, values, TaskAttributes::hipri());
+            }
+
+        public:
+            apply_batch_buffer(implT* impl) : impl(impl) {}
+
+            /// Adds result to the batch for process p, summing if dest is already present
+            void add(ProcessID p, const keyT& dest, const tensorT& result) {
+                batchT& batch=batches[p];
+                typename batchT::iterator it=batch.find(dest);
+                if (it==batch.end()) {
+                    batch.insert(std::make_pair(dest,result));
+                    sizes[p]+=result.size();
+                }
+                else {
+                    it->second += result;
+                }
+                if (sizes[p]>=max_batch_size) flush(p,batch);
+            }
+
+            /// Sends all pending batches
+            void flush() {
+                for (typename std::map<ProcessID,batchT>::iterator it=batches.begin(); it!=batches.end(); ++it)
+                    flush(it->first,it->second);
+            }
+        };
+
+        /// Accumulates a batch of results sent by apply_batch_buffer into local nodes
+        void accumulate_batch(const std::vector<keyT>& keys, const std::vector<tensorT>& values) {
+            MADNESS_ASSERT(keys.size()==values.size());
+            for (size_t i=0; i<keys.size(); ++i) {
+                coeffs.send(keys[i], &nodeT::accumulate2, values[i], coeffs, keys[i]);
+            }
         }
 
 
@@ -0,0 +1,333 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_MRA_LBSFC_H__INCLUDED
+#define MADNESS_MRA_LBSFC_H__INCLUDED
+
+#include <madness/madness_config.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <madness/world/worldhashmap.h>
+#include <madness/world/worlddc.h>
+
+#include <madness/mra/key.h>
+#include <madness/mra/sfcpmap.h>
+
+/// \file mra/lbsfc.h
+/// \brief Implements load balancing of functions along a space-filling curve
+/// \ingroup function
+
+namespace madness {
+
+    template<typename T, std::size_t NDIM>
+    class FunctionNode;
+
+    template<typename T, std::size_t NDIM>
+    class Function;
+
+
+    /// Accumulates measured compute time per box for use by LoadBalanceSFC
+
+    /// When enabled, the leaf kernels of apply and multiplication time
+    /// themselves and add the elapsed wall time to the source box.  Costs
+    /// of all functions of dimension NDIM are summed into one table since
+    /// they all share the same process map.  The table is local to each
+    /// process and only holds keys whose work ran there.
+    template <std::size_t NDIM>
+    class NodeCostRecorder {
+        typedef Key<NDIM> keyT;
+        typedef ConcurrentHashMap<keyT,double> mapT;
+
+        static bool& flag() {
+            static bool enabled = false;
+            return enabled;
+        }
+
+    public:
+        /// Returns the table of measured costs on this process
+        static mapT& costs() {
+            static mapT map(100003);
+            return map;
+        }
+
+        /// Returns true if costs are being recorded
+        static bool enabled() {return flag();}
+
+        /// Starts or stops recording costs (existing costs are kept)
+        static void set_enabled(bool value) {flag() = value;}
+
+        /// Adds cost (usually seconds) to box key
+        static void record(const keyT& key, double cost) {
+            typename mapT::accessor acc;
+            costs().insert(acc, std::make_pair(key, 0.0));
+            acc->second += cost;
+        }
+
+        /// Discards all recorded costs on this process
+        static void clear() {costs().clear();}
+    };
+
+
+    /// Process map that partitions a space-filling curve into contiguous pieces
+
+    /// Every key is mapped to its position on the Morton (Z-order) curve
+    /// at level \c sfc_level; keys below that level are mapped with
+    /// their ancestor at \c sfc_level and keys above it to the position of
+    /// their first descendant.  Process p owns positions in the half-open
+    /// range [start[p],start[p+1]), so that a lookup is a binary search of
+    /// a sorted array of nproc entries and whole subtrees and spatial
+    /// neighborhoods tend to stay on the same process.
+    template <std::size_t NDIM>
+    class LBSFCPmap : public WorldDCPmapInterface< Key<NDIM> > {
+        typedef Key<NDIM> keyT;
+        std::vector<uint64_t> start;
+
+    public:
+        /// #levels resolved by the curve (limited by 63 bits of position)
+        static constexpr Level sfc_level = (NDIM <= 2) ? 30 : Level(63/NDIM);
+
+        /// Makes the map from the first position owned by each process
+
+        /// @param[in] start Nondecreasing with start[0]=0 and one entry per process
+        LBSFCPmap(const std::vector<uint64_t>& start) : start(start) {
+            MADNESS_ASSERT(!start.empty() && start[0] == 0);
+            MADNESS_ASSERT(std::is_sorted(start.begin(), start.end()));
+        }
+
+        /// Returns the position of key on the curve
+        static uint64_t position(const keyT& key) {
+            return sfc_position(key, sfc_level, SFC_MORTON);
+        }
+
+        /// Returns the process that owns the given position on the curve
+        ProcessID owner_of_position(uint64_t pos) const {
+            return ProcessID(std::upper_bound(start.begin(), start.end(), pos) - start.begin()) - 1;
+        }
+
+        ProcessID owner(const keyT& key) const {
+            return owner_of_position(position(key));
+        }
+
+        /// Returns the first position owned by each process
+        const std::vector<uint64_t>& get_start() const {return start;}
+
+        void print() const {
+            madness::print("LBSFCPmap");
+            for (std::size_t p=0; p<start.size(); ++p) madness::print("   ", p, start[p]);
+        }
+    };
+
+
+    /// Load balancer that cuts a space-filling curve into pieces of equal cost
+
+    /// Costs are gathered per box either from a model (add_tree, with the
+    /// same cost functor as LoadBalanceDeux) or from the timings made by
+    /// NodeCostRecorder (add_measured_costs), and are summed along the
+    /// curve of LBSFCPmap.  Each process coarsens its costs to at most a
+    /// few thousand runs of the curve before they are gathered, so the
+    /// volume of communication is independent of the size of the trees.
+    ///
+    /// Since the curve is fixed, small changes in cost only move the cuts
+    /// between processes a little and redistribute() only moves the boxes
+    /// whose owner has changed.  rebalance() additionally keeps the
+    /// present map if it is still balanced to within a tolerance, which
+    /// makes it cheap to call between iterations.
+    /// \code
+    ///     NodeCostRecorder<3>::set_enabled(true);
+    ///     ... iterate ...
+    ///     LoadBalanceSFC<3> lb(world);
+    ///     lb.add_measured_costs();
+    ///     FunctionDefaults<3>::redistribute(world, lb.rebalance(FunctionDefaults<3>::get_pmap()));
+    /// \endcode
+    template <std::size_t NDIM>
+    class LoadBalanceSFC {
+        typedef Key<NDIM> keyT;
+        typedef LBSFCPmap<NDIM> pmapT;
+        typedef std::pair<uint64_t,double> costT;   ///< Position on curve and cost
+        World& world;
+        std::vector<costT> costs;                   ///< Local costs (not yet merged)
+
+        /// Sorts v by position and combines entries at the same position
+        static void merge(std::vector<costT>& v) {
+            std::sort(v.begin(), v.end());
+            std::size_t n = 0;
+            for (std::size_t i=0; i<v.size(); ++i) {
+                if (n && v[n-1].first == v[i].first) v[n-1].second += v[i].second;
+                else v[n++] = v[i];
+            }
+            v.resize(n);
+        }
+
+        /// Merges local costs, coarsening the curve until there are at most maxrun entries
+        void coarsen(std::size_t maxrun) {
+            merge(costs);
+            for (int shift=NDIM; costs.size() > maxrun && shift < 64; shift += NDIM) {
+                const uint64_t mask = ~((uint64_t(1) << shift) - 1);
+                for (costT& c : costs) c.first &= mask;
+                merge(costs);
+            }
+        }
+
+        /// Returns the cost of each process under the map of the local costs summed over all processes
+        std::vector<double> costs_per_process(const pmapT& pmap) const {
+            std::vector<double> load(world.size(), 0.0);
+            for (const costT& c : costs) load[pmap.owner_of_position(c.first)] += c.second;
+            world.gop.sum(load.data(), load.size());
+            return load;
+        }
+
+        /// Returns max/mean-1 of load
+        static double imbalance(const std::vector<double>& load) {
+            double total = 0.0, maxload = 0.0;
+            for (double x : load) {
+                total += x;
+                maxload = std::max(maxload, x);
+            }
+            return (total > 0.0) ? maxload*load.size()/total - 1.0 : 0.0;
+        }
+
+    public:
+        LoadBalanceSFC(World& world) : world(world) {}
+
+        /// Accumulates the model cost costfn(key,node) of each box of f on this process
+
+        /// The function must not be being modified (i.e., fence first).
+        template <typename T, typename costfnT>
+        void add_tree(const Function<T,NDIM>& f, const costfnT& costfn) {
+            const auto& coeffs = f.get_impl()->get_coeffs();
+            for (auto it=coeffs.begin(); it!=coeffs.end(); ++it) {
+                costs.push_back(costT(pmapT::position(it->first), costfn(it->first, it->second)));
+            }
+        }
+
+        /// Accumulates the costs measured by NodeCostRecorder on this process
+
+        /// @param[in] clear If true the recorded costs are discarded so the next measurement starts afresh
+        void add_measured_costs(bool clear=true) {
+            const auto& recorded = NodeCostRecorder<NDIM>::costs();
+            for (auto it=recorded.begin(); it!=recorded.end(); ++it) {
+                costs.push_back(costT(pmapT::position(it->first), it->second));
+            }
+            if (clear) NodeCostRecorder<NDIM>::clear();
+        }
+
+        /// Accumulates cost on box key
+        void add_cost(const keyT& key, double cost) {
+            costs.push_back(costT(pmapT::position(key), cost));
+        }
+
+        /// Partitions the curve so that each process has about the same cost
+
+        /// Collective.  If no costs were added the curve is divided evenly.
+        std::shared_ptr< WorldDCPmapInterface<keyT> > load_balance(bool printstuff=false) {
+            world.gop.fence();
+            const std::size_t nproc = world.size();
+            coarsen(std::max(std::size_t(1024), std::size_t(1<<22)/nproc));
+            std::vector<costT> all = world.gop.concat0(costs, 128*1024*1024);
+            world.gop.fence();
+
+            std::vector<uint64_t> start(nproc, 0);
+            if (world.rank() == 0) {
+                merge(all);
+                double total = 0.0;
+                for (const costT& c : all) total += c.second;
+
+                if (total > 0.0) {
+                    // Each run goes to the process in which its midpoint falls
+                    std::size_t p = 1;
+                    double sum = 0.0;
+                    for (const costT& c : all) {
+                        const std::size_t q = std::min(nproc-1, std::size_t((sum + 0.5*c.second)*nproc/total));
+                        while (p <= q) start[p++] = c.first;
+                        sum += c.second;
+                    }
+                    while (p < nproc) start[p++] = ~uint64_t(0); // idle processes
+                }
+                else {
+                    const uint64_t npos = uint64_t(1) << (NDIM*pmapT::sfc_level);
+                    for (std::size_t p=1; p<nproc; ++p) start[p] = uint64_t(double(npos)*p/nproc);
+                }
+            }
+            world.gop.broadcast_serializable(start, 0);
+            world.gop.fence();
+
+            std::shared_ptr<pmapT> pmap(new pmapT(start));
+            if (printstuff) {
+                std::vector<double> load = costs_per_process(*pmap);
+                if (world.rank() == 0) {
+                    print("LoadBalanceSFC: cost per process", load);
+                    print("LoadBalanceSFC: imbalance", imbalance(load));
+                }
+            }
+            return pmap;
+        }
+
+        /// Returns current if it is an LBSFCPmap balanced to within tolerance, otherwise a new map
+
+        /// Collective.  Keeping the present map avoids moving any data;
+        /// otherwise only boxes near the moved cuts change owner.
+        /// @param[in] current The map presently in use (usually FunctionDefaults<NDIM>::get_pmap())
+        /// @param[in] tolerance Acceptable value of max/mean-1 of the cost per process
+        std::shared_ptr< WorldDCPmapInterface<keyT> >
+        rebalance(const std::shared_ptr< WorldDCPmapInterface<keyT> >& current,
+                  double tolerance=0.1, bool printstuff=false) {
+            world.gop.fence();
+            std::shared_ptr<pmapT> old = std::dynamic_pointer_cast<pmapT>(current);
+            if (old && old->get_start().size() == std::size_t(world.size())) {
+                const double x = imbalance(costs_per_process(*old));
+                if (printstuff && world.rank() == 0) print("LoadBalanceSFC: present imbalance", x);
+                if (x <= tolerance) return current;
+            }
+
+            std::shared_ptr< WorldDCPmapInterface<keyT> > pmap = load_balance(printstuff);
+            if (printstuff && old) {
+                // Fraction of the cost that changes owner
+                const pmapT& p = static_cast<const pmapT&>(*pmap);
+                double moved[2] = {0.0, 0.0};
+                for (const costT& c : costs) {
+                    if (p.owner_of_position(c.first) != old->owner_of_position(c.first)) moved[0] += c.second;
+                    moved[1] += c.second;
+                }
+                world.gop.sum(moved, 2);
+                if (world.rank() == 0)
+                    print("LoadBalanceSFC: fraction of cost moved", (moved[1] > 0.0) ? moved[0]/moved[1] : 0.0);
+            }
+            return pmap;
+        }
+
+        /// Discards all costs added so far
+        void clear() {costs.clear();}
+    };
+}
+
+
+#endif // MADNESS_MRA_LBSFC_H__INCLUDED
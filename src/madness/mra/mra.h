@@ -70,6 +70,8 @@ namespace madness {
 #include <madness/mra/funcdefaults.h>
 #include <madness/mra/function_factory.h>
 #include <madness/mra/lbdeux.h>
+#include <madness/mra/lbsfc.h>
+#include <madness/mra/sfcpmap.h>
 #include <madness/mra/funcimpl.h>
 
 // some forward declarations
@@ -2495,6 +2497,20 @@ namespace madness {
                 f.store(ar);
             }
         };
+
+        template <class T, std::size_t NDIM>
+        struct ArchiveLoadImpl< SharedFileInputArchive, Function<T,NDIM> > {
+            static inline void load(const SharedFileInputArchive& ar, Function<T,NDIM>& f) {
+                f.load(*ar.get_world(), ar);
+            }
+        };
+
+        template <class T, std::size_t NDIM>
+        struct ArchiveStoreImpl< SharedFileOutputArchive, Function<T,NDIM> > {
+            static inline void store(const SharedFileOutputArchive& ar, const Function<T,NDIM>& f) {
+                f.store(ar);
+            }
+        };
     }
 
     template <class T, std::size_t NDIM>
@@ -3323,6 +3323,7 @@ namespace madness {
         debug = false;
         truncate_on_project = true;
         apply_randomize = false;
+        apply_coalesce = true;
         project_randomize = false;
         bc = BoundaryConditions<NDIM>(BC_FREE);
         tt = TT_FULL;
@@ -3333,6 +3334,25 @@ namespace madness {
         //pmap = std::shared_ptr< WorldDCPmapInterface< Key<NDIM> > >(new WorldDCDefaultPmap< Key<NDIM> >(world));
         pmap = std::shared_ptr< WorldDCPmapInterface< Key<NDIM> > >(new madness::LevelPmap< Key<NDIM> >(world));
         //pmap = std::shared_ptr< WorldDCPmapInterface< Key<NDIM> > >(new SimplePmap< Key<NDIM> >(world));
+
+        // MAD_PMAP=morton[:depth] or hilbert[:depth] selects a space-filling-curve map
+        const char* mad_pmap = getenv("MAD_PMAP");
+        if (mad_pmap) {
+            const std::string s(mad_pmap);
+            const std::string name = s.substr(0, s.find(':'));
+            int depth = 0;
+            if (name != s && (sscanf(s.c_str()+name.size()+1, "%d", &depth) != 1 ||
+                              depth < 1 || depth > SFCPmap<NDIM>::max_depth())) {
+                if (world.rank() == 0) std::cerr << "!!! WARNING: MAD_PMAP depth is invalid ... using default\n";
+                depth = 0;
+            }
+            if (name == "morton")
+                pmap = std::shared_ptr< WorldDCPmapInterface< Key<NDIM> > >(new SFCPmap<NDIM>(world, SFC_MORTON, depth));
+            else if (name == "hilbert")
+                pmap = std::shared_ptr< WorldDCPmapInterface< Key<NDIM> > >(new SFCPmap<NDIM>(world, SFC_HILBERT, depth));
+            else if (name != "level" && world.rank() == 0)
+                std::cerr << "!!! WARNING: MAD_PMAP must be level, morton or hilbert ... using level\n";
+        }
     }
     template <std::size_t NDIM>
     void FunctionDefaults<NDIM>::print(){
@@ -3349,6 +3369,7 @@ namespace madness {
     		std::cout << "                           debug" <<  ": " << debug << std::endl;
     		std::cout << "             truncate_on_project" <<  ": " << truncate_on_project << std::endl;
     		std::cout << "                 apply_randomize" <<  ": " << apply_randomize << std::endl;
+    		std::cout << "                  apply_coalesce" <<  ": " << apply_coalesce << std::endl;
     		std::cout << "               project_randomize" <<  ": " << project_randomize << std::endl;
     		std::cout << "                              bc" <<  ": " << bc << std::endl;
     		std::cout << "                              tt" <<  ": " << tt << std::endl;
@@ -3369,6 +3390,7 @@ namespace madness {
     template <std::size_t NDIM> bool FunctionDefaults<NDIM>::debug;
     template <std::size_t NDIM> bool FunctionDefaults<NDIM>::truncate_on_project;
     template <std::size_t NDIM> bool FunctionDefaults<NDIM>::apply_randomize;
+    template <std::size_t NDIM> bool FunctionDefaults<NDIM>::apply_coalesce;
     template <std::size_t NDIM> bool FunctionDefaults<NDIM>::project_randomize;
     template <std::size_t NDIM> BoundaryConditions<NDIM> FunctionDefaults<NDIM>::bc;
     template <std::size_t NDIM> TensorType FunctionDefaults<NDIM>::tt;
@@ -275,6 +275,60 @@ namespace madness {
         }
 
 
+        /// accumulate into a batch of results
+
+        /// Same as apply_transformation() but for \c nbatch source blocks
+        /// stored interleaved in \c f (i.e., as f(i0,...,iNDIM-1,batch)) so
+        /// that each step is a single matrix multiplication over the whole
+        /// batch.  Cycling the indices leaves the batch index first, hence
+        /// \c result holds the \c nbatch result blocks contiguously.  The
+        /// work arrays must hold nbatch*dimk^NDIM elements.
+        template <typename T, typename R>
+        void apply_transformation_batch(long dimk, long nbatch,
+                                        const Transformation trans[NDIM],
+                                        const T* f,
+                                        R* MADNESS_RESTRICT w1,
+                                        R* MADNESS_RESTRICT w2,
+                                        const Q mufac,
+                                        R* MADNESS_RESTRICT result) const {
+
+            long size = nbatch;
+            for (std::size_t i=0; i<NDIM; ++i) size *= dimk;
+            long dimi = size/dimk;
+
+            mTxmq(dimi, trans[0].r, dimk, w1, f, trans[0].U, dimk);
+            size = trans[0].r * size / dimk;
+            dimi = size/dimk;
+            for (std::size_t d=1; d<NDIM; ++d) {
+                mTxmq(dimi, trans[d].r, dimk, w2, w1, trans[d].U, dimk);
+                size = trans[d].r * size / dimk;
+                dimi = size/dimk;
+                std::swap(w1,w2);
+            }
+
+            bool doit = false;
+            for (std::size_t d=0; d<NDIM; ++d) doit = doit || trans[d].VT;
+
+            if (doit) {
+                // Move the batch index back to the end for the second sweep
+                fast_transpose(nbatch, size/nbatch, w1, w2);
+                std::swap(w1,w2);
+                for (std::size_t d=0; d<NDIM; ++d) {
+                    if (trans[d].VT) {
+                        dimi = size/trans[d].r;
+                        mTxmq(dimi, dimk, trans[d].r, w2, w1, trans[d].VT);
+                        size = dimk*size/trans[d].r;
+                    }
+                    else {
+                        fast_transpose(dimk, size/dimk, w1, w2);
+                    }
+                    std::swap(w1,w2);
+                }
+            }
+            aligned_axpy(size, result, w1, mufac);
+        }
+
+
         /// accumulate into result
         template <typename T, typename R>
         void apply_transformation3(const Tensor<T> trans2[NDIM],
@@ -352,6 +406,49 @@ namespace madness {
         }
 
 
+        /// Select the full or low-rank (SVD) transformation of one term in each dimension
+
+        /// @param[in]  ops_1d  the 1D operators of the term
+        /// @param[in]  r_term  if true select the R (two-scale) block, else the T (scaling) block
+        /// @param[in]  tol     tolerance relative to the norm of the block
+        /// @param[out] trans   the transformations
+        /// @return     false if the numerical rank in some dimension is zero
+        bool make_transformation(const ConvolutionData1D<Q>* const ops_1d[NDIM],
+                                 bool r_term, double tol, Transformation trans[NDIM]) const {
+            long dimk = k;
+            if (r_term and not modified()) dimk = 2*k;
+
+            long break_even;
+            if (NDIM==1) break_even = long(0.5*dimk);
+            else if (NDIM==2) break_even = long(0.6*dimk);
+            else if (NDIM==3) break_even=long(0.65*dimk);
+            else break_even=long(0.7*dimk);
+            for (std::size_t d=0; d<NDIM; ++d) {
+                const Tensor<typename Tensor<Q>::scalar_type>& err = r_term ? ops_1d[d]->Rs : ops_1d[d]->Ts;
+                long r;
+                for (r=0; r<dimk; ++r) {
+                    if (err[r] < tol) break;
+                }
+                if (r >= break_even) {
+                    trans[d].r = dimk;
+                    trans[d].U = r_term ? ops_1d[d]->R.ptr() : ops_1d[d]->T.ptr();
+                    trans[d].VT = 0;
+                }
+                else {
+
+#ifdef USE_GENTENSOR
+                    r = std::max(2L,r+(r&1L)); // (needed for 6D == when GENTENSOR is on) NOLONGER NEED TO FORCE OPERATOR RANK TO BE EVEN
+#endif
+                    if (r == 0) return false;
+                    trans[d].r = r;
+                    trans[d].U = r_term ? ops_1d[d]->RU.ptr() : ops_1d[d]->TU.ptr();
+                    trans[d].VT = r_term ? ops_1d[d]->RVT.ptr() : ops_1d[d]->TVT.ptr();
+                }
+            }
+            return true;
+        }
+
+
         /// Apply one of the separated terms, accumulating into the result
         template <typename T>
         void muopxv_fast(ApplyTerms at,
@@ -366,7 +463,6 @@ namespace madness {
 
             //PROFILE_MEMBER_FUNC(SeparatedConvolution); // Too fine grain for routine profiling
             Transformation trans[NDIM];
-            Tensor<T> trans2[NDIM];
 
             double Rnorm = 1.0;
             for (std::size_t d=0; d<NDIM; ++d) Rnorm *= ops_1d[d]->Rnorm;
@@ -375,43 +471,10 @@ namespace madness {
 
                 tol = tol/(Rnorm*NDIM);  // Errors are relative within here
 
-                // Determine rank of SVD to use or if to use the full matrix
                 long twok = 2*k;
                 if (modified()) twok=k;
 
-                long break_even;
-                if (NDIM==1) break_even = long(0.5*twok);
-                else if (NDIM==2) break_even = long(0.6*twok);
-                else if (NDIM==3) break_even=long(0.65*twok);
-                else break_even=long(0.7*twok);
-                bool rank_is_zero = false;
-                for (std::size_t d=0; d<NDIM; ++d) {
-                    long r;
-                    for (r=0; r<twok; ++r) {
-                        if (ops_1d[d]->Rs[r] < tol) break;
-                    }
-                    if (r >= break_even) {
-                        trans[d].r = twok;
-                        trans[d].U = ops_1d[d]->R.ptr();
-                        trans[d].VT = 0;
-                    }
-                    else {
-
-#ifdef USE_GENTENSOR
-                        r = std::max(2L,r+(r&1L)); // (needed for 6D == when GENTENSOR is on) NOLONGER NEED TO FORCE OPERATOR RANK TO BE EVEN
-#endif
-                        if (r == 0) {
-                            rank_is_zero = true;
-                            break;
-                        }
-                        trans[d].r = r;
-                        trans[d].U = ops_1d[d]->RU.ptr();
-                        trans[d].VT = ops_1d[d]->RVT.ptr();
-                    }
-                    trans2[d]=ops_1d[d]->R;
-                }
-
-                if (!rank_is_zero)
+                if (make_transformation(ops_1d, true, tol, trans))
                     apply_transformation(twok, trans, f, work1, work2, mufac, result);
 
                 //            apply_transformation2(n, twok, tol, trans2, f, work1, work2, mufac, result);
@@ -424,38 +487,7 @@ namespace madness {
             if (at.t_term and (Tnorm>0.0)) {
                 tol = tol/(Tnorm*NDIM);  // Errors are relative within here
 
-                long break_even;
-                if (NDIM==1) break_even = long(0.5*k);
-                else if (NDIM==2) break_even = long(0.6*k);
-                else if (NDIM==3) break_even=long(0.65*k);
-                else break_even=long(0.7*k);
-                bool rank_is_zero = false;
-                for (std::size_t d=0; d<NDIM; ++d) {
-                    long r;
-                    for (r=0; r<k; ++r) {
-                        if (ops_1d[d]->Ts[r] < tol) break;
-                    }
-                    if (r >= break_even) {
-                        trans[d].r = k;
-                        trans[d].U = ops_1d[d]->T.ptr();
-                        trans[d].VT = 0;
-                    }
-                    else {
-
-#ifdef USE_GENTENSOR
-                        r = std::max(2L,r+(r&1L)); // (needed for 6D == GENTENSOR is USED) NOLONGER NEED TO FORCE OPERATOR RANK TO BE EVEN
-#endif
-                        if (r == 0) {
-                            rank_is_zero = true;
-                            break;
-                        }
-                        trans[d].r = r;
-                        trans[d].U = ops_1d[d]->TU.ptr();
-                        trans[d].VT = ops_1d[d]->TVT.ptr();
-                    }
-                    trans2[d]=ops_1d[d]->T;
-                }
-                if (!rank_is_zero)
+                if (make_transformation(ops_1d, false, tol, trans))
                     apply_transformation(k, trans, f0, work1, work2, -mufac, result0);
 //                apply_transformation2(n, k, tol, trans2, f0, work1, work2, -mufac, result0);
 //                apply_transformation3(trans2, f0, -mufac, result0);
@@ -463,6 +495,41 @@ namespace madness {
         }
 
 
+        /// Apply one of the separated terms to a batch of sources, accumulating into the results
+
+        /// Same as muopxv_fast() but on \c nbatch interleaved source blocks
+        /// (see apply_transformation_batch())
+        template <typename T, typename R>
+        void muopxv_fast_batch(ApplyTerms at,
+                               const ConvolutionData1D<Q>* const ops_1d[NDIM],
+                               long nbatch, const T* f, const T* f0,
+                               R* result, R* result0,
+                               double tol,
+                               const Q mufac,
+                               R* work1, R* work2) const {
+
+            Transformation trans[NDIM];
+
+            double Rnorm = 1.0;
+            for (std::size_t d=0; d<NDIM; ++d) Rnorm *= ops_1d[d]->Rnorm;
+
+            if (at.r_term and (Rnorm > 1.e-20)) {
+                tol = tol/(Rnorm*NDIM);  // Errors are relative within here
+                if (make_transformation(ops_1d, true, tol, trans))
+                    apply_transformation_batch(2*k, nbatch, trans, f, work1, work2, mufac, result);
+            }
+
+            double Tnorm = 1.0;
+            for (std::size_t d=0; d<NDIM; ++d) Tnorm *= ops_1d[d]->Tnorm;
+
+            if (at.t_term and (Tnorm>0.0)) {
+                tol = tol/(Tnorm*NDIM);  // Errors are relative within here
+                if (make_transformation(ops_1d, false, tol, trans))
+                    apply_transformation_batch(k, nbatch, trans, f0, work1, work2, -mufac, result0);
+            }
+        }
+
+
         /// Apply one of the separated terms, accumulating into the result
         template <typename T>
         void muopxv_fast2(Level n,
@@ -730,6 +797,7 @@ namespace madness {
             //PROFILE_MEMBER_FUNC(SeparatedConvolution); // Too fine grain for routine profiling
             const SeparatedConvolutionData<Q,NDIM>* p = data.getptr(n,d);
             if (p) return p;
+            SimpleCacheBuildTimer build_timer;
 
             // get the data for each term
             SeparatedConvolutionData<Q,NDIM> op(rank);
@@ -770,6 +838,7 @@ namespace madness {
 
             const SeparatedConvolutionData<Q,NDIM>* p = mod_data.getptr(n,key);
             if (p) return p;
+            SimpleCacheBuildTimer build_timer;
 
             // get the data for each term
             // op.muops is of type SeparatedConvolutionInternal (1 term, all dim, 1 disp)
@@ -1029,6 +1098,7 @@ namespace madness {
                 timer_full.print("op full tensor       ");
                 timer_low_transf.print("op low rank transform");
                 timer_low_accumulate.print("op low rank addition ");
+                print_simple_cache_stats();
         	}
         }
 
@@ -1185,6 +1255,97 @@ namespace madness {
         }
 
 
+        /// apply this operator on a batch of source boxes that share one displacement
+
+        /// Gives the same results as calling apply() for each source in
+        /// turn, but all sources share one set of operator matrices so the
+        /// source blocks are packed contiguously and each separated term is
+        /// applied with NDIM large matrix multiplications over the whole
+        /// batch instead of NDIM small ones per source.
+        /// Since the same truncation is used for the whole batch, \c tol
+        /// should be the smallest of the tolerances of the individual sources.
+        /// @param[in]  sources the source keys, all on the same level
+        /// @param[in]  shift   the displacement, common to all sources
+        /// @param[in]  coeffs  source coeffs in full rank, one per source
+        /// @param[in]  tol     thresh/#neigh*cnorm
+        /// @return     the results op(coeff), one per source
+        template <typename T>
+        std::vector< Tensor<TENSOR_RESULT_TYPE(T,Q)> >
+        apply_batch(const std::vector< Key<NDIM> >& sources,
+                    const Key<NDIM>& shift,
+                    const std::vector< Tensor<T> >& coeffs,
+                    double tol) const {
+            typedef TENSOR_RESULT_TYPE(T,Q) resultT;
+            MADNESS_ASSERT(sources.size() == coeffs.size());
+            const long nbatch = coeffs.size();
+            std::vector< Tensor<resultT> > results(nbatch);
+            if (nbatch == 0) return results;
+
+            // The operator for a modified NS form depends on the source box
+            if (modified() or nbatch == 1) {
+                for (long m=0; m<nbatch; ++m) results[m] = apply(sources[m], shift, coeffs[m], tol);
+                return results;
+            }
+
+            double cpu0=cpu_time();
+
+            const Level n = sources[0].level();
+            long size0 = 1;
+            for (std::size_t d=0; d<NDIM; ++d) size0 *= k;
+            const long size = size0 << NDIM;
+
+            // Pack the sources as f(i0,...,iNDIM-1,batch) and f0 likewise
+            Tensor<T> block(nbatch, size), block0(nbatch, size0);
+            for (long m=0; m<nbatch; ++m) {
+                MADNESS_ASSERT(sources[m].level() == n);
+                const Tensor<T>& coeff = coeffs[m];
+                MADNESS_ASSERT(coeff.ndim()==NDIM);
+                Tensor<T> fm = block(m,_).reshape(v2k);
+                if (coeff.dim(0) == k) {
+                    fm(s0) = coeff;
+                }
+                else {
+                    MADNESS_ASSERT(coeff.dim(0)==2*k);
+                    fm(___) = coeff;
+                }
+                Tensor<T> f0m = block0(m,_).reshape(vk);
+                f0m(___) = coeff(s0);
+            }
+            Tensor<T> f(std::vector<long>(1,nbatch*size),false), f0(std::vector<long>(1,nbatch*size0),false);
+            fast_transpose(nbatch, size, block.ptr(), f.ptr());
+            fast_transpose(nbatch, size0, block0.ptr(), f0.ptr());
+
+            tol = 0.01*tol/rank; // Error is per separated term
+            ApplyTerms at;
+            at.r_term=true;
+            at.t_term=(n>0);
+
+            const SeparatedConvolutionData<Q,NDIM>* op = getop_ns(n, shift);
+
+            Tensor<resultT> r(nbatch, size), r0(nbatch, size0);
+            const std::vector<long> vwork(1,nbatch*size);
+            Tensor<resultT> work1(vwork,false), work2(vwork,false);
+
+            for (int mu=0; mu<rank; ++mu) {
+                const SeparatedConvolutionInternal<Q,NDIM>& muop =  op->muops[mu];
+                if (muop.norm > tol) {
+                    Q fac = ops[mu].getfac();
+                    muopxv_fast_batch(at, muop.ops, nbatch, f.ptr(), f0.ptr(), r.ptr(), r0.ptr(),
+                                      tol/std::abs(fac), fac, work1.ptr(), work2.ptr());
+                }
+            }
+
+            for (long m=0; m<nbatch; ++m) {
+                results[m] = copy(r(m,_).reshape(v2k));
+                results[m](s0).gaxpy(1.0,r0(m,_).reshape(vk),1.0);
+            }
+            double cpu1=cpu_time();
+            timer_full.accumulate(cpu1-cpu0);
+
+            return results;
+        }
+
+
         /// apply this operator on only 1 particle of the coefficients in low rank form
 
         /// note the unfortunate mess with NDIM: here NDIM is the operator dimension, and FDIM is the
@@ -0,0 +1,328 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+/// \file mra/rnlp_disk_cache.cc
+/// \brief Implements RnlpDiskCache
+
+#include <madness/mra/rnlp_disk_cache.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace madness {
+
+    namespace {
+
+        typedef RnlpDiskCache::Key Key;
+        static_assert(sizeof(Key) == 64, "RnlpDiskCache::Key must have no implicit padding");
+
+        // File layout:  Header | Slot[nslot] | records
+        // Each record is:  Key | uint64_t nval | double[nval]
+        const char MAGIC[8] = {'M','A','D','R','N','L','P','1'};
+
+        struct Header {
+            char magic[8];
+            uint64_t nslot;         // power of 2
+            uint64_t nrecord;
+            uint64_t size;          // of the whole file in bytes
+        };
+
+        struct Slot {
+            uint64_t hash;
+            uint64_t offset;        // of the record, 0 if the slot is empty
+        };
+
+        const std::size_t RECORD_HEADER = sizeof(Key) + sizeof(uint64_t);
+
+        uint64_t hash_key(const Key& key) {
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(&key);
+            uint64_t h = 14695981039346656037ull;  // FNV-1a
+            for (std::size_t i=0; i<sizeof(Key); ++i) {
+                h ^= p[i];
+                h *= 1099511628211ull;
+            }
+            return h;
+        }
+
+        /// A cache file mapped read-only
+        class MappedFile {
+            const char* base;
+            std::size_t size;
+
+        public:
+            MappedFile() : base(nullptr), size(0) {}
+
+            ~MappedFile() {
+                if (base) munmap(const_cast<char*>(base), size);
+            }
+
+            /// Maps the file, returning false if it is missing or not valid
+            bool open(const std::string& path) {
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) return false;
+                struct stat st;
+                if (fstat(fd, &st) || std::size_t(st.st_size) < sizeof(Header)) {
+                    ::close(fd);
+                    return false;
+                }
+                void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if (p == MAP_FAILED) return false;
+                base = static_cast<const char*>(p);
+                size = st.st_size;
+
+                const Header* h = header();
+                const uint64_t nslot = h->nslot;
+                if (std::memcmp(h->magic, MAGIC, sizeof(MAGIC)) || h->size != size ||
+                    nslot == 0 || (nslot & (nslot-1)) ||
+                    nslot > (size - sizeof(Header))/sizeof(Slot)) {
+                    std::cerr << "!!! WARNING: " << path << " is not a valid rnlp cache file ... ignored\n";
+                    munmap(p, size);
+                    base = nullptr;
+                    size = 0;
+                    return false;
+                }
+                return true;
+            }
+
+            bool is_open() const {return base;}
+
+            const Header* header() const {return reinterpret_cast<const Header*>(base);}
+
+            const Slot* slots() const {return reinterpret_cast<const Slot*>(base + sizeof(Header));}
+
+            /// Returns the key of the record at offset or NULL if it is out of bounds
+            const Key* record(uint64_t offset, uint64_t& nval) const {
+                if (offset < sizeof(Header) || offset > size || size - offset < RECORD_HEADER) return nullptr;
+                std::memcpy(&nval, base + offset + sizeof(Key), sizeof(nval));
+                if (nval > (size - offset - RECORD_HEADER)/sizeof(double)) return nullptr;
+                return reinterpret_cast<const Key*>(base + offset);
+            }
+
+            /// Returns the data of the record for key or NULL if not present
+            const double* find(const Key& key, uint64_t hash, std::size_t nval) const {
+                if (!base) return nullptr;
+                const uint64_t mask = header()->nslot - 1;
+                const Slot* s = slots();
+                for (uint64_t i=hash, n=0; n<=mask; ++i, ++n) {
+                    const Slot& slot = s[i & mask];
+                    if (slot.offset == 0) return nullptr;
+                    if (slot.hash != hash) continue;
+                    uint64_t nv;
+                    const Key* k = record(slot.offset, nv);
+                    if (k && nv == nval && std::memcmp(k, &key, sizeof(Key)) == 0)
+                        return reinterpret_cast<const double*>(reinterpret_cast<const char*>(k) + RECORD_HEADER);
+                }
+                return nullptr;
+            }
+        };
+
+        struct State {
+            std::string path;
+            std::unique_ptr<MappedFile> file;   // as found at startup or by set_path
+            std::mutex mutex;                   // protects pending and flushing
+            std::vector< std::pair< Key, std::vector<double> > > pending;
+            std::atomic<uint64_t> nhit, nmiss, nput;
+            bool atexit_registered;
+
+            State() : file(new MappedFile), nhit(0), nmiss(0), nput(0), atexit_registered(false) {
+                const char* mad_rnlp_cache = getenv("MAD_RNLP_CACHE");
+                if (mad_rnlp_cache && *mad_rnlp_cache) {
+                    path = mad_rnlp_cache;
+                    file->open(path);
+                }
+            }
+        };
+
+        State& state() {
+            static State s;
+            return s;
+        }
+
+        void flush_at_exit() {
+            RnlpDiskCache::flush();
+        }
+
+        /// Writes all records to a new file, returning false on error
+        bool write_file(const std::string& path, const MappedFile& old,
+                        const std::vector< std::pair< Key, std::vector<double> > >& pending) {
+            // Gather the distinct records
+            struct Record {
+                const Key* key;
+                uint64_t hash, nval;
+                const char* data;   // nval doubles
+            };
+            std::vector<Record> records;
+            if (old.is_open()) {
+                const Slot* s = old.slots();
+                for (uint64_t i=0; i<old.header()->nslot; ++i) {
+                    uint64_t nval;
+                    const Key* k = s[i].offset ? old.record(s[i].offset, nval) : nullptr;
+                    if (k) records.push_back(Record{k, s[i].hash, nval,
+                                reinterpret_cast<const char*>(k) + RECORD_HEADER});
+                }
+            }
+            for (const auto& p : pending) {
+                records.push_back(Record{&p.first, hash_key(p.first), p.second.size(),
+                            reinterpret_cast<const char*>(p.second.data())});
+            }
+
+            uint64_t nslot = 64;
+            while (nslot < 2*records.size()) nslot *= 2;
+            std::vector<Slot> slots(nslot, Slot{0, 0});
+            std::vector<const Record*> in_slot(nslot, nullptr);
+            std::vector<const Record*> unique;
+            uint64_t offset = sizeof(Header) + nslot*sizeof(Slot);
+            for (const Record& r : records) {
+                uint64_t i = r.hash & (nslot-1);
+                bool duplicate = false;
+                while (in_slot[i]) {
+                    if (in_slot[i]->hash == r.hash && !std::memcmp(in_slot[i]->key, r.key, sizeof(Key))) {
+                        duplicate = true;
+                        break;
+                    }
+                    i = (i+1) & (nslot-1);
+                }
+                if (duplicate) continue;
+                in_slot[i] = &r;
+                slots[i] = Slot{r.hash, offset};
+                offset += RECORD_HEADER + r.nval*sizeof(double);
+                unique.push_back(&r);
+            }
+
+            Header h;
+            std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+            h.nslot = nslot;
+            h.nrecord = unique.size();
+            h.size = offset;
+
+            const std::string tmp = path + ".tmp." + std::to_string(getpid());
+            FILE* f = std::fopen(tmp.c_str(), "wb");
+            if (!f) return false;
+            bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1;
+            ok = ok && std::fwrite(slots.data(), sizeof(Slot), nslot, f) == nslot;
+            for (const Record* r : unique) {
+                ok = ok && std::fwrite(r->key, sizeof(Key), 1, f) == 1;
+                ok = ok && std::fwrite(&r->nval, sizeof(uint64_t), 1, f) == 1;
+                ok = ok && std::fwrite(r->data, sizeof(double), r->nval, f) == r->nval;
+            }
+            ok = (std::fclose(f) == 0) && ok;
+            ok = ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+            if (!ok) std::remove(tmp.c_str());
+            return ok;
+        }
+    }
+
+
+    bool RnlpDiskCache::enabled() {
+        return !state().path.empty();
+    }
+
+    bool RnlpDiskCache::get(const Key& key, double* data, std::size_t nval) {
+        State& s = state();
+        const double* p = s.file->find(key, hash_key(key), nval);
+        if (!p) {
+            s.nmiss++;
+            return false;
+        }
+        std::memcpy(data, p, nval*sizeof(double));
+        s.nhit++;
+        return true;
+    }
+
+    void RnlpDiskCache::put(const Key& key, const double* data, std::size_t nval) {
+        State& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.atexit_registered) {
+            std::atexit(flush_at_exit);
+            s.atexit_registered = true;
+        }
+        s.pending.push_back(std::make_pair(key, std::vector<double>(data, data+nval)));
+        s.nput++;
+    }
+
+    void RnlpDiskCache::flush() {
+        State& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (s.pending.empty()) return;
+
+        // Serialize with other processes and merge with what they have written
+        const std::string lockpath = s.path + ".lock";
+        int fd = ::open(lockpath.c_str(), O_RDWR | O_CREAT, 0666);
+        if (fd < 0 || flock(fd, LOCK_EX)) {
+            std::cerr << "!!! WARNING: cannot lock " << lockpath << " ... rnlp cache not written\n";
+            if (fd >= 0) ::close(fd);
+            s.pending.clear();
+            return;
+        }
+        {
+            MappedFile current;
+            current.open(s.path);
+            if (!write_file(s.path, current, s.pending))
+                std::cerr << "!!! WARNING: cannot write " << s.path << " ... rnlp cache not written\n";
+        }
+        flock(fd, LOCK_UN);
+        ::close(fd);
+        s.pending.clear();
+    }
+
+    void RnlpDiskCache::set_path(const std::string& path) {
+        flush();
+        State& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.path = path;
+        s.file.reset(new MappedFile);
+        if (!path.empty()) s.file->open(path);
+    }
+
+    RnlpDiskCacheStats RnlpDiskCache::get_stats() {
+        State& s = state();
+        RnlpDiskCacheStats stats;
+        stats.nhit = s.nhit;
+        stats.nmiss = s.nmiss;
+        stats.nput = s.nput;
+        return stats;
+    }
+
+}
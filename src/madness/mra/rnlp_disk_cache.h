@@ -0,0 +1,116 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+#ifndef MADNESS_MRA_RNLP_DISK_CACHE_H__INCLUDED
+#define MADNESS_MRA_RNLP_DISK_CACHE_H__INCLUDED
+
+/// \file mra/rnlp_disk_cache.h
+/// \brief Optional cache of Gaussian convolution blocks that persists between runs
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace madness {
+
+    /// Statistics of the persistent rnlp cache in this process
+    struct RnlpDiskCacheStats {
+        uint64_t nhit;      ///< #blocks read from the file
+        uint64_t nmiss;     ///< #blocks not in the file
+        uint64_t nput;      ///< #blocks queued for writing
+        RnlpDiskCacheStats() : nhit(0), nmiss(0), nput(0) {}
+    };
+
+    /// Persistent cache of the rnlp blocks of Gaussian convolutions
+
+    /// Computing the rnlp blocks (the projection of a Gaussian onto the
+    /// double order polynomials) by quadrature dominates the cost of
+    /// making BSH and Coulomb operators with many terms, and every process
+    /// of every job does it again.  If the environment variable
+    /// MAD_RNLP_CACHE names a file, get_rnlp() first looks for each block
+    /// there, and blocks that had to be computed are added to the file
+    /// when the process exits (or flush() is called).
+    ///
+    /// The file is memory mapped read-only so that only the pages holding
+    /// blocks that are actually used are read, and all processes on a node
+    /// share the same pages.  It holds an open-addressing index followed by
+    /// the records.  Writers serialize on an flock of "<file>.lock", merge
+    /// their new blocks with the present contents into a temporary file and
+    /// rename it over the old one, so readers always see a complete file.
+    ///
+    /// Only blocks that are not screened as small are stored.  The
+    /// nonstandard blocks are not stored since they are formed from rnlp
+    /// by a few small transformations.
+    class RnlpDiskCache {
+    public:
+        /// Identifies a block ... all fields (and padding) are compared bitwise
+        struct Key {
+            double expnt;           ///< Exponent in simulation coordinates
+            double coeff_re;        ///< Real part of the coefficient
+            double coeff_im;        ///< Imaginary part of the coefficient
+            double arg;             ///< Phase argument of periodic sums
+            int64_t translation;
+            int32_t k;              ///< Wavelet order
+            int32_t m;              ///< Order of derivative
+            int32_t maxR;           ///< Number of lattice translations (0 if not periodic)
+            int32_t level;
+            int32_t is_complex;     ///< Nonzero for complex blocks
+            int32_t reserved;
+
+            Key() : expnt(0), coeff_re(0), coeff_im(0), arg(0), translation(0)
+                  , k(0), m(0), maxR(0), level(0), is_complex(0), reserved(0) {}
+        };
+
+        /// Returns true if the cache is enabled (MAD_RNLP_CACHE is set)
+        static bool enabled();
+
+        /// Flushes queued blocks and switches to another file (empty to disable)
+
+        /// Must not be called while operators are being made by other threads.
+        static void set_path(const std::string& path);
+
+        /// Copies a block of \c nval doubles into \c data if it is in the file
+        static bool get(const Key& key, double* data, std::size_t nval);
+
+        /// Queues a block of \c nval doubles to be added to the file
+        static void put(const Key& key, const double* data, std::size_t nval);
+
+        /// Adds the queued blocks to the file
+        static void flush();
+
+        /// Returns the statistics of this process
+        static RnlpDiskCacheStats get_stats();
+    };
+
+}
+
+#endif // MADNESS_MRA_RNLP_DISK_CACHE_H__INCLUDED
@@ -0,0 +1,193 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_MRA_SFCPMAP_H__INCLUDED
+#define MADNESS_MRA_SFCPMAP_H__INCLUDED
+
+#include <madness/madness_config.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <madness/world/worlddc.h>
+
+#include <madness/mra/key.h>
+
+/// \file mra/sfcpmap.h
+/// \brief Positions of keys on space-filling curves and a process map built on them
+/// \ingroup function
+
+namespace madness {
+
+    /// Space-filling curves through the boxes of one level of the tree
+    enum SFCurve {SFC_MORTON, SFC_HILBERT};
+
+    /// Returns the position of key on a space-filling curve through the boxes at level n
+
+    /// The curve through level n visits the 2^NDIM children of each box
+    /// at level n-1 consecutively, so the boxes of any subtree occupy a
+    /// contiguous range of positions.  A key below level n is given the
+    /// position of its ancestor at level n and a key above level n the
+    /// first position of its descendants, so every key sits with the
+    /// start of its subtree.  Requires NDIM*n <= 64.
+    ///
+    /// The Morton (Z-order) position interleaves the bits of the
+    /// translations.  The Hilbert position uses Skilling's transform
+    /// (AIP Conf. Proc. 707, 381 (2004)) which works in any dimension;
+    /// consecutive Hilbert positions are always face neighbors whereas the
+    /// Morton curve jumps between octants.
+    template <std::size_t NDIM>
+    uint64_t sfc_position(const Key<NDIM>& key, Level n, SFCurve curve) {
+        const Level m = key.level();
+        const Level nbit = std::min(m, n);
+        if (nbit == 0) return 0;
+
+        uint64_t x[NDIM];
+        for (std::size_t d=0; d<NDIM; ++d) x[d] = uint64_t(key.translation()[d]) >> (m - nbit);
+
+        if (curve == SFC_HILBERT) {
+            // Skilling's AxestoTranspose is exact for nbit bits; since a
+            // Hilbert curve of any order nests, the position of an
+            // ancestor follows from that of a descendant at level n.
+            if (nbit < n)
+                for (std::size_t d=0; d<NDIM; ++d) x[d] <<= (n - nbit);
+            const uint64_t top = uint64_t(1) << (n-1);
+            for (uint64_t q=top; q>1; q>>=1) {
+                const uint64_t p = q - 1;
+                for (std::size_t d=0; d<NDIM; ++d) {
+                    if (x[d] & q) {
+                        x[0] ^= p;
+                    }
+                    else {
+                        const uint64_t t = (x[0] ^ x[d]) & p;
+                        x[0] ^= t;
+                        x[d] ^= t;
+                    }
+                }
+            }
+            for (std::size_t d=1; d<NDIM; ++d) x[d] ^= x[d-1];
+            uint64_t t = 0;
+            for (uint64_t q=top; q>1; q>>=1)
+                if (x[NDIM-1] & q) t ^= q - 1;
+            for (std::size_t d=0; d<NDIM; ++d) x[d] ^= t;
+
+            uint64_t pos = 0;
+            for (Level b=n-1; b>=0; --b)
+                for (std::size_t d=0; d<NDIM; ++d) pos = (pos << 1) | ((x[d] >> b) & 0x1);
+            if (nbit < n) pos &= ~((uint64_t(1) << (NDIM*(n-nbit))) - 1);
+            return pos;
+        }
+        else {
+            uint64_t pos = 0;
+            for (Level b=nbit-1; b>=0; --b)
+                for (std::size_t d=0; d<NDIM; ++d) pos = (pos << 1) | ((x[d] >> b) & 0x1);
+            return pos << (NDIM*(n - nbit));
+        }
+    }
+
+
+    /// Process map that keeps spatially contiguous subtrees on the same process
+
+    /// The boxes at level \c depth are numbered along a Morton or Hilbert
+    /// curve and the curve is cut into nproc pieces of equal length.  A
+    /// key at or below level \c depth lives with its ancestor at \c depth,
+    /// so each subtree rooted at that level is entirely on one process;
+    /// keys above \c depth are placed with the first box of their subtree.
+    /// Unlike the hashing maps (LevelPmap, SimplePmap) most neighbors of a
+    /// box are then on the same process, which removes most of the remote
+    /// messages made by apply, diff and mul.  The price is that the
+    /// partition knows nothing about where the boxes are; use
+    /// LoadBalanceSFC to also balance the cost.
+    ///
+    /// Select it with e.g.
+    /// \code
+    ///     FunctionDefaults<3>::set_pmap(pmapT(new SFCPmap<3>(world, SFC_HILBERT)));
+    /// \endcode
+    /// or by setting MAD_PMAP to "morton" or "hilbert", optionally
+    /// followed by ":depth", before startup.
+    template <std::size_t NDIM>
+    class SFCPmap : public WorldDCPmapInterface< Key<NDIM> > {
+        typedef Key<NDIM> keyT;
+        int nproc;
+        SFCurve curve;
+        Level depth;
+        uint64_t chunk;         ///< #positions per process
+
+        void init() {
+            MADNESS_ASSERT(depth >= 1 && depth <= max_depth());
+            const uint64_t npos = uint64_t(1) << (NDIM*depth);
+            chunk = (npos + nproc - 1)/nproc;
+        }
+
+    public:
+        /// Deepest level whose positions fit in 63 bits
+        static Level max_depth() {return Level(63/NDIM);}
+
+        /// Default depth giving about 64 subtrees per process
+        static Level default_depth(int nproc) {
+            const Level n = Level(std::ceil((std::log2(double(nproc)) + 6.0)/NDIM));
+            return std::max(Level(2), std::min(n, max_depth()));
+        }
+
+        /// Makes the map for all processes in world
+
+        /// @param[in] curve The curve to use
+        /// @param[in] depth Level of the subtrees kept together (0 selects default_depth)
+        SFCPmap(World& world, SFCurve curve=SFC_HILBERT, Level depth=0)
+            : nproc(world.size()), curve(curve), depth(depth ? depth : default_depth(world.size())) {
+            init();
+        }
+
+        /// Makes the map for a given number of processes (for analysis)
+        SFCPmap(int nproc, SFCurve curve, Level depth)
+            : nproc(nproc), curve(curve), depth(depth) {
+            init();
+        }
+
+        /// Returns the position of key on the curve
+        uint64_t position(const keyT& key) const {
+            return sfc_position(key, depth, curve);
+        }
+
+        ProcessID owner(const keyT& key) const {
+            return ProcessID(position(key)/chunk);
+        }
+
+        Level get_depth() const {return depth;}
+
+        SFCurve get_curve() const {return curve;}
+
+        void print() const {
+            madness::print("SFCPmap:", (curve == SFC_HILBERT) ? "hilbert" : "morton", "depth", depth);
+        }
+    };
+}
+
+#endif // MADNESS_MRA_SFCPMAP_H__INCLUDED
@@ -0,0 +1,99 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+/// \file simplecache.cc
+/// \brief Statistics of SimpleCache
+
+#include <madness/mra/simplecache.h>
+#include <madness/mra/rnlp_disk_cache.h>
+#include <cstdio>
+#include <mutex>
+#include <set>
+
+namespace madness {
+
+    namespace {
+        std::mutex registry_mutex;
+        std::set<const detail::SimpleCacheCounters*>& registry() {
+            static std::set<const detail::SimpleCacheCounters*> counters;
+            return counters;
+        }
+        SimpleCacheStats retired_stats;  // Counters of threads that have exited
+    }
+
+    namespace detail {
+
+        SimpleCacheCounters::SimpleCacheCounters()
+            : nhit(0), nmiss(0), ninsert(0), build_time(0.0), build_depth(0) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry().insert(this);
+        }
+
+        SimpleCacheCounters::~SimpleCacheCounters() {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry().erase(this);
+            retired_stats.nhit += nhit.load();
+            retired_stats.nmiss += nmiss.load();
+            retired_stats.ninsert += ninsert.load();
+            retired_stats.build_time += build_time.load();
+        }
+
+    }
+
+    SimpleCacheStats get_simple_cache_stats() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        SimpleCacheStats s = retired_stats;
+        for (const detail::SimpleCacheCounters* c : registry()) {
+            s.nhit += c->nhit.load(std::memory_order_relaxed);
+            s.nmiss += c->nmiss.load(std::memory_order_relaxed);
+            s.ninsert += c->ninsert.load(std::memory_order_relaxed);
+            s.build_time += c->build_time.load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+    void print_simple_cache_stats() {
+        SimpleCacheStats s = get_simple_cache_stats();
+        std::printf("  Operator cache statistics\n");
+        std::printf("  -------------------------\n");
+        std::printf("                #lookups    %.2e\n", double(s.nhit + s.nmiss));
+        std::printf("                hit rate    %.1f%%\n", 100.0*s.hit_rate());
+        std::printf("                #inserts    %.2e\n", double(s.ninsert));
+        std::printf("       build time (cpu s)    %.2f\n", s.build_time);
+        if (RnlpDiskCache::enabled()) {
+            RnlpDiskCacheStats d = RnlpDiskCache::get_stats();
+            std::printf("    rnlp blocks from file    %.2e\n", double(d.nhit));
+            std::printf("   rnlp blocks not in file   %.2e\n", double(d.nmiss));
+        }
+    }
+
+}
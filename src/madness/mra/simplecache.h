@@ -34,38 +34,275 @@
 #define MADNESS_MRA_SIMPLECACHE_H__INCLUDED
 
 #include <madness/mra/key.h>
+#include <madness/world/worldmutex.h>
+#include <madness/world/timers.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
 
 namespace madness {
+
+    /// Statistics summed over all SimpleCache instances and threads
+    struct SimpleCacheStats {
+        uint64_t nhit;          ///< #lookups that found the value
+        uint64_t nmiss;         ///< #lookups that did not
+        uint64_t ninsert;       ///< #values inserted
+        double build_time;      ///< cpu time spent computing values after a miss
+
+        SimpleCacheStats() : nhit(0), nmiss(0), ninsert(0), build_time(0.0) {}
+
+        /// Fraction of lookups that found the value
+        double hit_rate() const {
+            return (nhit+nmiss) ? double(nhit)/double(nhit+nmiss) : 0.0;
+        }
+    };
+
+    /// Returns statistics summed over all SimpleCache instances and threads
+    SimpleCacheStats get_simple_cache_stats();
+
+    /// Prints the SimpleCache statistics to std::cout
+    void print_simple_cache_stats();
+
+    namespace detail {
+
+        /// Per-thread counters behind SimpleCacheStats
+
+        /// Written only by the owning thread (so no atomic read-modify-write
+        /// on the lookup path) but read by any thread.
+        struct SimpleCacheCounters {
+            std::atomic<uint64_t> nhit, nmiss, ninsert;
+            std::atomic<double> build_time;
+            int build_depth;    // nesting of SimpleCacheBuildTimer
+
+            SimpleCacheCounters();
+            ~SimpleCacheCounters();
+
+            static void add(std::atomic<uint64_t>& c, uint64_t n) {
+                c.store(c.load(std::memory_order_relaxed)+n, std::memory_order_relaxed);
+            }
+        };
+
+        /// Returns the counters of the calling thread
+        inline SimpleCacheCounters& simple_cache_counters() {
+            static thread_local SimpleCacheCounters counters;
+            return counters;
+        }
+    }
+
+    /// Accumulates the time to compute a value that is to be cached
+
+    /// Construct one of these before computing a value after a miss.
+    /// Computing a value often recursively needs other cached values (e.g.,
+    /// rnlp at the next level), so only the outermost timer on each thread
+    /// counts to avoid adding the same interval more than once.
+    class SimpleCacheBuildTimer {
+        detail::SimpleCacheCounters& counters;
+        double start;
+    public:
+        SimpleCacheBuildTimer() : counters(detail::simple_cache_counters()), start(0.0) {
+            if (counters.build_depth++ == 0) start = cpu_time();
+        }
+
+        ~SimpleCacheBuildTimer() {
+            if (--counters.build_depth == 0) {
+                const double t = counters.build_time.load(std::memory_order_relaxed);
+                counters.build_time.store(t + cpu_time() - start, std::memory_order_relaxed);
+            }
+        }
+    };
+
+
     /// Simplified interface around hash_map to cache stuff for 1D
 
     /// This is a write once cache --- subsequent writes of elements
     /// have no effect (so that pointers/references to cached data
     /// cannot be invalidated)
+    ///
+    /// The cache is read-mostly (the operator matrices are looked up for
+    /// every box and displacement but computed only once) so lookups take
+    /// no lock.  Keys whose translations all lie within +/-DENSE_RANGE (the
+    /// displacements of the near field) are found directly in a dense array
+    /// for their level.  Other keys go to an open-addressing hash table.
+    /// Both hold atomic pointers to entries that are never moved or freed
+    /// until the cache is destroyed, and insertions (and the growth of the
+    /// hash table) are serialized by a mutex.  A table that has been
+    /// replaced by a larger one is kept until destruction since another
+    /// thread might still be probing it.
     template <typename Q, std::size_t NDIM>
     class SimpleCache {
     private:
-        typedef ConcurrentHashMap< Key<NDIM>, Q > mapT;
         typedef std::pair<Key<NDIM>, Q> pairT;
-        mapT cache;
+
+        /// Returns (2r+1)^NDIM
+        static constexpr std::size_t dense_size(Translation r) {
+            std::size_t size = 1;
+            for (std::size_t d=0; d<NDIM; ++d) size *= std::size_t(2*r+1);
+            return size;
+        }
+
+        /// Returns the largest r such that (2r+1)^NDIM <= n
+        static constexpr Translation dense_range(std::size_t n) {
+            Translation r = 0;
+            while (dense_size(r+1) <= n) ++r;
+            return r;
+        }
+
+    public:
+        static const int DENSE_NLEVEL = 64; ///< Levels with a dense array (> MAXLEVEL)
+        static constexpr Translation DENSE_RANGE = dense_range(729); ///< Max |translation| held densely
+
+    private:
+        static constexpr std::size_t DENSE_WIDTH = 2*DENSE_RANGE+1;
+        static constexpr std::size_t DENSE_SIZE = dense_size(DENSE_RANGE);
+
+        typedef std::atomic<const pairT*> slotT;
+
+        struct Table {
+            std::size_t mask;       // #slots - 1
+            slotT* slots;
+            explicit Table(std::size_t nslot) : mask(nslot-1), slots(new slotT[nslot]) {
+                for (std::size_t i=0; i<nslot; ++i) slots[i].store(nullptr, std::memory_order_relaxed);
+            }
+            ~Table() {delete [] slots;}
+        };
+
+        slotT* dense[DENSE_NLEVEL];                    // written under mutex, null until used
+        std::atomic<slotT*> dense_level[DENSE_NLEVEL];
+        std::atomic<Table*> table;
+        std::vector<Table*> retired;                   // replaced tables
+        std::vector<const pairT*> entries;             // all entries in insertion order
+        mutable Mutex mutex;
+
+        /// Index into the dense array of a level or -1 if out of range
+        static long dense_index(const Key<NDIM>& key) {
+            if (key.level() < 0 || key.level() >= DENSE_NLEVEL) return -1;
+            long index = 0;
+            for (std::size_t d=0; d<NDIM; ++d) {
+                const Translation l = key.translation()[d];
+                if (l < -DENSE_RANGE || l > DENSE_RANGE) return -1;
+                index = index*DENSE_WIDTH + (l + DENSE_RANGE);
+            }
+            return index;
+        }
+
+        /// Finds the entry for key in the hash table or returns NULL
+        static const pairT* probe(const Table* t, const Key<NDIM>& key) {
+            for (std::size_t i=key.hash();; ++i) {
+                const pairT* p = t->slots[i & t->mask].load(std::memory_order_acquire);
+                if (!p || p->first == key) return p;
+            }
+        }
+
+        /// Finds the entry for key or returns NULL
+        const pairT* find(const Key<NDIM>& key) const {
+            const long index = dense_index(key);
+            if (index >= 0) {
+                const slotT* d = dense_level[key.level()].load(std::memory_order_acquire);
+                return d ? d[index].load(std::memory_order_acquire) : nullptr;
+            }
+            return probe(table.load(std::memory_order_acquire), key);
+        }
+
+        /// Adds a new entry, the caller holding the mutex
+        void insert(const Key<NDIM>& key, const Q& val) {
+            const pairT* p = new pairT(key, val);
+            entries.push_back(p);
+            detail::SimpleCacheCounters::add(detail::simple_cache_counters().ninsert, 1);
+
+            const long index = dense_index(key);
+            if (index >= 0) {
+                const Level n = key.level();
+                if (!dense[n]) {
+                    dense[n] = new slotT[DENSE_SIZE];
+                    for (std::size_t i=0; i<DENSE_SIZE; ++i) dense[n][i].store(nullptr, std::memory_order_relaxed);
+                    dense_level[n].store(dense[n], std::memory_order_release);
+                }
+                dense[n][index].store(p, std::memory_order_release);
+                return;
+            }
+
+            // Keep the hash table at most half full
+            Table* t = table.load(std::memory_order_relaxed);
+            if (2*(nhashed+1) > t->mask+1) {
+                Table* bigger = new Table(2*(t->mask+1));
+                for (std::size_t i=0; i<=t->mask; ++i) {
+                    const pairT* q = t->slots[i].load(std::memory_order_relaxed);
+                    if (q) {
+                        std::size_t j = q->first.hash();
+                        while (bigger->slots[j & bigger->mask].load(std::memory_order_relaxed)) ++j;
+                        bigger->slots[j & bigger->mask].store(q, std::memory_order_relaxed);
+                    }
+                }
+                table.store(bigger, std::memory_order_release);
+                retired.push_back(t);
+                t = bigger;
+            }
+            std::size_t j = key.hash();
+            while (t->slots[j & t->mask].load(std::memory_order_relaxed)) ++j;
+            t->slots[j & t->mask].store(p, std::memory_order_release);
+            ++nhashed;
+        }
+
+        std::size_t nhashed;            // #entries in the hash table
+
+        void init() {
+            for (int n=0; n<DENSE_NLEVEL; ++n) {
+                dense[n] = nullptr;
+                dense_level[n].store(nullptr, std::memory_order_relaxed);
+            }
+            table.store(new Table(16), std::memory_order_relaxed);
+            nhashed = 0;
+        }
+
+        void clear() {
+            for (int n=0; n<DENSE_NLEVEL; ++n) delete [] dense[n];
+            for (Table* t : retired) delete t;
+            retired.clear();
+            delete table.load(std::memory_order_relaxed);
+            for (const pairT* p : entries) delete p;
+            entries.clear();
+            init();
+        }
+
+        void copy_from(const SimpleCache& c) {
+            ScopedMutex<Mutex> obolus(c.mutex);
+            for (const pairT* p : c.entries) insert(p->first, p->second);
+        }
 
     public:
-        SimpleCache() : cache() {};
+        SimpleCache() {init();}
 
-        SimpleCache(const SimpleCache& c) : cache(c.cache) {};
+        SimpleCache(const SimpleCache& c) {
+            init();
+            copy_from(c);
+        }
 
         SimpleCache& operator=(const SimpleCache& c) {
             if (this != &c) {
-                cache.clear();
-                cache = c.cache;
+                ScopedMutex<Mutex> obolus(mutex);
+                clear();
+                copy_from(c);
             }
             return *this;
         }
 
+        ~SimpleCache() {
+            for (int n=0; n<DENSE_NLEVEL; ++n) delete [] dense[n];
+            for (Table* t : retired) delete t;
+            delete table.load(std::memory_order_relaxed);
+            for (const pairT* p : entries) delete p;
+        }
+
         /// If key is present return pointer to cached value, otherwise return NULL
         inline const Q* getptr(const Key<NDIM>& key) const {
-            typename mapT::const_iterator test = cache.find(key);
-            if (test == cache.end()) return 0;
-            return &(test->second);
+            const pairT* p = find(key);
+            detail::SimpleCacheCounters& counters = detail::simple_cache_counters();
+            if (p) {
+                detail::SimpleCacheCounters::add(counters.nhit, 1);
+                return &(p->second);
+            }
+            detail::SimpleCacheCounters::add(counters.nmiss, 1);
+            return 0;
         }
 
 
@@ -89,7 +326,8 @@ namespace madness {
 
         /// Set value associated with key ... gives ownership of a new copy to the container
         inline void set(const Key<NDIM>& key, const Q& val) {
-            cache.insert(pairT(key,val));
+            ScopedMutex<Mutex> obolus(mutex);
+            if (!find(key)) insert(key, val);
         }
 
         inline void set(Level n, Translation l, const Q& val) {
@@ -38,6 +38,9 @@
 #include <madness/mra/mra.h>
 #include <madness/mra/operator.h>
 #include <madness/constants.h>
+#include <madness/mra/rnlp_disk_cache.h>
+#include <cstdio>
+#include <thread>
 
 using namespace madness;
 
@@ -175,6 +178,148 @@ int test_gconv(World& world) {
 }
 
 
+/// Test that the batched apply agrees with applying to each source in turn
+int test_apply_batch(World& world) {
+    if (world.rank() == 0) print("\nTest batched apply of a separated operator");
+    int success=0;
+
+    const int k3=8;
+    FunctionDefaults<3>::set_cubic_cell(-L,L);
+    FunctionDefaults<3>::set_k(k3);
+    FunctionDefaults<3>::set_thresh(thresh);
+    real_convolution_3d op = BSHOperator3D(world, 1.0, 1.e-3, thresh);
+
+    const Level n = 3;
+    const Key<3> shift(n, Vector<Translation,3>{1,0,-1});
+    const long nbatch = 64;
+    std::vector< Key<3> > sources;
+    std::vector< Tensor<double> > coeffs;
+    for (long m=0; m<nbatch; ++m) {
+        sources.push_back(Key<3>(n, Vector<Translation,3>{m%8, (m/8)%8, (3*m)%8}));
+        // Include some leaf-like inputs with only scaling coefficients
+        coeffs.push_back((m%5 == 0) ? Tensor<double>(k3,k3,k3) : Tensor<double>(2*k3,2*k3,2*k3));
+        coeffs.back().fillrandom();
+    }
+    const double tol = 1.e-10;
+    op.apply(sources[0], shift, coeffs[0], tol); // Make the operator blocks before timing
+
+    double t0 = wall_time();
+    std::vector< Tensor<double> > r0;
+    for (long m=0; m<nbatch; ++m) r0.push_back(op.apply(sources[m], shift, coeffs[m], tol));
+    double t1 = wall_time();
+    std::vector< Tensor<double> > r1 = op.apply_batch(sources, shift, coeffs, tol);
+    double t2 = wall_time();
+
+    double err = 0.0;
+    for (long m=0; m<nbatch; ++m) err = std::max(err, (r0[m]-r1[m]).normf()/r0[m].normf());
+    print("max relative error in apply_batch", err);
+    print("time for", nbatch, "calls to apply", t1-t0, "for one call to apply_batch", t2-t1);
+    if (err > 1.e-12) success++;
+    print("success 7 ", success);
+
+    world.gop.fence();
+    return success;
+}
+
+/// Test the lock-free lookups of SimpleCache while other threads insert
+int test_simple_cache(World& world) {
+    if (world.rank() == 0) print("\nTest concurrent use of SimpleCache");
+    int success=0;
+
+    // Translations up to 3*DENSE_RANGE exercise both the dense arrays and the hash table
+    typedef SimpleCache<long,2> cacheT;
+    const Translation lmax = 3*cacheT::DENSE_RANGE;
+    cacheT cache;
+    const int nthread = 4;
+    std::atomic<long> nbad(0);
+    auto value = [](Level n, Translation lx, Translation ly) {return 1000000*n + 1000*lx + ly;};
+    std::vector<std::thread> threads;
+    for (int id=0; id<nthread; ++id) {
+        threads.push_back(std::thread([&,id]() {
+            for (Level n=0; n<4; ++n) {
+                for (Translation lx=-lmax; lx<=lmax; ++lx) {
+                    for (Translation ly=-lmax+id; ly<=lmax; ly+=nthread) {
+                        Key<2> key(n, Vector<Translation,2>{lx,ly});
+                        cache.set(key, value(n,lx,ly));
+                        cache.set(key, -1);     // Write once ... must have no effect
+                    }
+                    // Look up what this and the other threads might have inserted so far
+                    for (Translation ly=-lmax; ly<=lmax; ++ly) {
+                        const long* p = cache.getptr(Key<2>(n, Vector<Translation,2>{lx,ly}));
+                        if (p && *p != value(n,lx,ly)) ++nbad;
+                    }
+                }
+            }
+        }));
+    }
+    for (std::thread& t : threads) t.join();
+
+    cacheT copy(cache);
+    long nfound = 0;
+    for (Level n=0; n<4; ++n) {
+        for (Translation lx=-lmax; lx<=lmax; ++lx) {
+            for (Translation ly=-lmax; ly<=lmax; ++ly) {
+                for (const cacheT* c : {&cache, &copy}) {
+                    const long* p = c->getptr(Key<2>(n, Vector<Translation,2>{lx,ly}));
+                    if (!p || *p != value(n,lx,ly)) ++nbad;
+                    else ++nfound;
+                }
+            }
+        }
+    }
+    if (cache.getptr(Key<2>(4, Vector<Translation,2>{0,0}))) ++nbad;
+    print("found", nfound, "cached values with", nbad, "errors");
+    print_simple_cache_stats();
+    if (nbad) success++;
+    print("success 8 ", success);
+
+    world.gop.fence();
+    return success;
+}
+
+/// Test that rnlp blocks written to the persistent cache are read back by a new operator
+int test_rnlp_disk_cache(World& world) {
+    if (world.rank() == 0) print("\nTest persistent cache of rnlp blocks");
+    int success=0;
+
+    const std::string path = "testgconv.rnlp." + std::to_string(world.rank());
+    std::remove(path.c_str());
+    RnlpDiskCache::set_path(path);
+
+    const int kk = 8;
+    const double expnt = 1.e4;
+    const RnlpDiskCacheStats s0 = RnlpDiskCache::get_stats();
+    GaussianConvolution1D<double> op1(kk, sqrt(expnt/constants::pi), expnt, 0, false);
+    std::vector< Tensor<double> > r1;
+    for (Level n=0; n<8; ++n)
+        for (Translation l=-3; l<=3; ++l) r1.push_back(copy(op1.get_rnlp(n,l)));
+    RnlpDiskCache::flush();
+    const RnlpDiskCacheStats s1 = RnlpDiskCache::get_stats();
+
+    // Remap the file just written and make the same blocks with a new operator
+    RnlpDiskCache::set_path(path);
+    GaussianConvolution1D<double> op2(kk, sqrt(expnt/constants::pi), expnt, 0, false);
+    double err = 0.0;
+    long i = 0;
+    for (Level n=0; n<8; ++n)
+        for (Translation l=-3; l<=3; ++l) err = std::max(err, (op2.get_rnlp(n,l) - r1[i++]).normf());
+    const RnlpDiskCacheStats s2 = RnlpDiskCache::get_stats();
+
+    RnlpDiskCache::set_path("");
+    std::remove(path.c_str());
+    std::remove((path + ".lock").c_str());
+
+    print("blocks written", s1.nput-s0.nput, "read back", s2.nhit-s1.nhit, "computed", s2.nput-s1.nput,
+          "max difference", err);
+    // Blocks at coarse levels come straight from the file without recursing to finer ones
+    if (s1.nput == s0.nput || s2.nhit == s1.nhit || s2.nput != s1.nput || err != 0.0) success++;
+    print("success 9 ", success);
+
+    world.gop.fence();
+    return success;
+}
+
+
 int main(int argc, char**argv) {
     initialize(argc,argv);
     World world(SafeMPI::COMM_WORLD);
@@ -193,6 +338,9 @@ int main(int argc, char**argv) {
         	print(" polynomial ", k,"\n");
         }
         success+=test_gconv(world);
+        success+=test_apply_batch(world);
+        success+=test_simple_cache(world);
+        success+=test_rnlp_disk_cache(world);
 
     }
     catch (const SafeMPI::Exception& e) {
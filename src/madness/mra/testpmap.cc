@@ -0,0 +1,191 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+/// \file mra/testpmap.cc
+/// \brief Compares the locality of the process maps for apply and diff
+
+/// For each map the fraction of neighbor references of apply (all boxes
+/// within one box in every direction) and of diff (face neighbors of leaf
+/// boxes) that go to another process is counted for the trees of a
+/// Gaussian in 3D and 6D, as if running on 16 or 256 processes.  When run
+/// on more than one process the actual number of RMI messages sent by
+/// apply and diff in 3D is also measured.
+
+#include <madness/mra/mra.h>
+#include <madness/mra/operator.h>
+#include <madness/world/worldrmi.h>
+
+using namespace madness;
+
+template <std::size_t NDIM>
+static double gaussian(const Vector<double,NDIM>& r) {
+    double rsq = 0.0;
+    for (std::size_t d=0; d<NDIM; ++d) rsq += (r[d]-0.1*d)*(r[d]-0.1*d);
+    return exp(-rsq);
+}
+
+/// Fraction of remote references made by apply and diff on the given tree
+template <std::size_t NDIM>
+static void count_remote(const std::vector< std::pair<Key<NDIM>,bool> >& tree,
+                         const WorldDCPmapInterface< Key<NDIM> >& pmap,
+                         double& apply_fraction, double& diff_fraction) {
+    typedef Key<NDIM> keyT;
+    double napply=0, nremote_apply=0, ndiff=0, nremote_diff=0;
+    for (const auto& node : tree) {
+        const keyT& key = node.first;
+        const ProcessID me = pmap.owner(key);
+        const Translation nbox = Translation(1) << key.level();
+
+        // Displacements {-1,0,1}^NDIM except zero
+        Vector<Translation,NDIM> l;
+        long ndisp = 1;
+        for (std::size_t d=0; d<NDIM; ++d) ndisp *= 3;
+        for (long i=0; i<ndisp; ++i) {
+            long r = i;
+            bool valid = true, zero = true;
+            for (std::size_t d=0; d<NDIM; ++d) {
+                const Translation s = r%3 - 1;
+                r /= 3;
+                l[d] = key.translation()[d] + s;
+                valid = valid && l[d] >= 0 && l[d] < nbox;
+                zero = zero && s == 0;
+            }
+            if (zero || !valid) continue;
+            const bool remote = pmap.owner(keyT(key.level(), l)) != me;
+            ++napply;
+            if (remote) ++nremote_apply;
+
+            // Face neighbors of leaves are the ones diff needs
+            long nface = 0;
+            for (std::size_t d=0; d<NDIM; ++d) nface += (l[d] != key.translation()[d]);
+            if (!node.second && nface == 1) {
+                ++ndiff;
+                if (remote) ++nremote_diff;
+            }
+        }
+    }
+    apply_fraction = napply ? nremote_apply/napply : 0.0;
+    diff_fraction = ndiff ? nremote_diff/ndiff : 0.0;
+}
+
+template <std::size_t NDIM>
+static void analyze(World& world, int k, double thresh) {
+    typedef Key<NDIM> keyT;
+    typedef std::shared_ptr< WorldDCPmapInterface<keyT> > pmapT;
+
+    FunctionDefaults<NDIM>::set_k(k);
+    FunctionDefaults<NDIM>::set_thresh(thresh);
+    FunctionDefaults<NDIM>::set_cubic_cell(-10.0,10.0);
+    Function<double,NDIM> f = FunctionFactory<double,NDIM>(world).f(gaussian<NDIM>);
+
+    std::vector< std::pair<keyT,bool> > tree;
+    const auto& coeffs = f.get_impl()->get_coeffs();
+    for (auto it=coeffs.begin(); it!=coeffs.end(); ++it)
+        tree.push_back(std::make_pair(it->first, it->second.has_children()));
+    tree = world.gop.concat0(tree, 128*1024*1024);
+
+    if (world.rank() == 0) {
+        print("\n", NDIM, "D tree with", tree.size(), "boxes, k =", k, "thresh =", thresh);
+        printf("  nproc   map       depth   remote apply   remote diff\n");
+        for (int nproc : {16, 256}) {
+            const Level depth = SFCPmap<NDIM>::default_depth(nproc);
+            std::vector< std::pair<const char*,pmapT> > maps;
+            maps.push_back(std::make_pair("level", pmapT(new LevelPmap<keyT>(nproc))));
+            maps.push_back(std::make_pair("morton", pmapT(new SFCPmap<NDIM>(nproc, SFC_MORTON, depth))));
+            maps.push_back(std::make_pair("hilbert", pmapT(new SFCPmap<NDIM>(nproc, SFC_HILBERT, depth))));
+            for (const auto& m : maps) {
+                double apply_fraction, diff_fraction;
+                count_remote(tree, *m.second, apply_fraction, diff_fraction);
+                printf("  %5d   %-8s  %5s   %11.1f%%   %10.1f%%\n", nproc, m.first,
+                       (m.second.get() == maps[0].second.get()) ? "-" : std::to_string(depth).c_str(),
+                       100.0*apply_fraction, 100.0*diff_fraction);
+            }
+        }
+    }
+    world.gop.fence();
+}
+
+/// Returns the number of messages sent by all processes
+static uint64_t nmsg_sent(World& world) {
+    world.gop.fence();
+    uint64_t n = RMI::get_stats().nmsg_sent;
+    world.gop.sum(n);
+    return n;
+}
+
+static void measure(World& world) {
+    typedef Key<3> keyT;
+    typedef std::shared_ptr< WorldDCPmapInterface<keyT> > pmapT;
+
+    FunctionDefaults<3>::set_k(8);
+    FunctionDefaults<3>::set_thresh(1e-6);
+    FunctionDefaults<3>::set_cubic_cell(-10.0,10.0);
+    SeparatedConvolution<double,3> op = CoulombOperator(world, 1e-3, 1e-6);
+    Derivative<double,3> D = free_space_derivative<double,3>(world, 0);
+
+    if (world.rank() == 0) {
+        print("\nRMI messages sent in 3D on", world.size(), "processes");
+        printf("  map          apply      diff\n");
+    }
+    std::vector< std::pair<const char*,pmapT> > maps;
+    maps.push_back(std::make_pair("level", pmapT(new LevelPmap<keyT>(world))));
+    maps.push_back(std::make_pair("morton", pmapT(new SFCPmap<3>(world, SFC_MORTON))));
+    maps.push_back(std::make_pair("hilbert", pmapT(new SFCPmap<3>(world, SFC_HILBERT))));
+    for (const auto& m : maps) {
+        FunctionDefaults<3>::set_pmap(m.second);
+        Function<double,3> f = FunctionFactory<double,3>(world).f(gaussian<3>);
+        f.truncate();
+        f.reconstruct();
+
+        uint64_t n0 = nmsg_sent(world);
+        Function<double,3> g = apply(op, f);
+        uint64_t n1 = nmsg_sent(world);
+        Function<double,3> df = D(f);
+        uint64_t n2 = nmsg_sent(world);
+        if (world.rank() == 0) printf("  %-8s  %8lu  %8lu\n", m.first, (unsigned long)(n1-n0), (unsigned long)(n2-n1));
+    }
+    FunctionDefaults<3>::set_pmap(maps[0].second);
+    world.gop.fence();
+}
+
+int main(int argc, char** argv) {
+    World& world = initialize(argc, argv);
+    startup(world,argc,argv);
+
+    analyze<3>(world, 8, 1e-6);
+    analyze<6>(world, 4, 1e-3);
+    if (world.size() > 1) measure(world);
+
+    world.gop.fence();
+    finalize();
+    return 0;
+}
@@ -1222,6 +1222,23 @@ int test_io(World& world) {
     if (world.rank() == 0) print("err = ", err);
     CHECK(err,1e-12,"test_io");
 
+    // Same again through a single shared file
+    archive::SharedFileOutputArchive sout(world, "mary.sfa");
+    sout & f;
+    sout.close();
+
+    Function<T,NDIM> h;
+
+    archive::SharedFileInputArchive sin(world, "mary.sfa");
+    sin & h;
+    sin.close();
+    sin.remove();
+
+    err = (h-f).norm2();
+
+    if (world.rank() == 0) print("err = ", err);
+    CHECK(err,1e-12,"test_io");
+
     //    MADNESS_CHECK(err == 0.0);
 
     if (world.rank() == 0) print("test_io OK");
@@ -1230,6 +1247,89 @@ int test_io(World& world) {
     return 1;
 }
 
+template <typename T, std::size_t NDIM>
+int test_loadbal(World& world) {
+    if (world.rank() == 0) {
+        print("\nTest space-filling-curve load balance - type =", archive::get_type_name<T>(),", ndim =",NDIM,"\n");
+    }
+    bool ok=true;
+    typedef Vector<double,NDIM> coordT;
+    typedef Key<NDIM> keyT;
+    typedef std::shared_ptr< FunctionFunctorInterface<T,NDIM> > functorT;
+    typedef std::shared_ptr< WorldDCPmapInterface<keyT> > pmapT;
+
+    // The children of a box are consecutive on the curve and the
+    // parent is placed with its first child
+    int nbad = 0;
+    std::vector<uint64_t> pos;
+    for (KeyChildIterator<NDIM> kit(keyT(0)); kit; ++kit) {
+        const keyT child = kit.key();
+        pos.push_back(LBSFCPmap<NDIM>::position(child));
+        if (LBSFCPmap<NDIM>::position(child.parent()) > pos.back()) ++nbad;
+    }
+    std::sort(pos.begin(), pos.end());
+    if (std::unique(pos.begin(), pos.end()) != pos.end()) ++nbad;
+
+    // Along the diagonal the owner never decreases
+    std::vector<uint64_t> start(4);
+    for (int p=0; p<4; ++p) start[p] = p*((uint64_t(1) << (NDIM*LBSFCPmap<NDIM>::sfc_level))/4);
+    LBSFCPmap<NDIM> fake(start);
+    const Level n = 3;
+    Vector<Translation,NDIM> l(0);
+    ProcessID last = 0;
+    for (Translation i=0; i<(Translation(1)<<n); ++i) {
+        for (std::size_t d=0; d<NDIM; ++d) l[d] = i;
+        const ProcessID p = fake.owner(keyT(n,l));
+        if (p < last) ++nbad;
+        last = p;
+    }
+    if (last != 3) ++nbad;
+    CHECK(double(nbad), 0.5, "LBSFCPmap ordering");
+
+    FunctionDefaults<NDIM>::set_k(6);
+    FunctionDefaults<NDIM>::set_thresh(1e-6);
+    FunctionDefaults<NDIM>::set_refine(true);
+    FunctionDefaults<NDIM>::set_initial_level(2);
+    FunctionDefaults<NDIM>::set_cubic_cell(-10,10);
+
+    const coordT origin(0.0);
+    const double coeff = pow(2.0/PI,0.25*NDIM);
+    functorT functor(new Gaussian<T,NDIM>(origin, 10.0, coeff));
+    Function<T,NDIM> f = FunctionFactory<T,NDIM>(world).functor(functor);
+
+    // Measure the cost of a multiplication
+    NodeCostRecorder<NDIM>::clear();
+    NodeCostRecorder<NDIM>::set_enabled(true);
+    Function<T,NDIM> fsq = f*f;
+    NodeCostRecorder<NDIM>::set_enabled(false);
+    std::size_t nmeasured = NodeCostRecorder<NDIM>::costs().size();
+    world.gop.sum(nmeasured);
+    if (world.rank() == 0) print("boxes with measured cost", nmeasured);
+    CHECK(double(nmeasured == 0), 0.5, "measured costs");
+
+    const double norm = fsq.norm2();
+    LoadBalanceSFC<NDIM> lb(world);
+    lb.add_tree(f, lbcost<T,NDIM>());
+    lb.add_measured_costs();
+    pmapT pmap = lb.rebalance(FunctionDefaults<NDIM>::get_pmap(), 0.1, true);
+    CHECK(double(!std::dynamic_pointer_cast< LBSFCPmap<NDIM> >(pmap)), 0.5, "new pmap");
+    FunctionDefaults<NDIM>::redistribute(world, pmap);
+
+    const double err = std::abs(fsq.norm2() - norm) + (f*f - fsq).norm2();
+    CHECK(err, 1e-12, "redistributed function");
+
+    // A balanced map is kept
+    LoadBalanceSFC<NDIM> lb2(world);
+    lb2.add_tree(f, lbcost<T,NDIM>());
+    pmapT pmap2 = lb2.rebalance(FunctionDefaults<NDIM>::get_pmap(), 1e6);
+    CHECK(double(pmap2 != pmap), 0.5, "kept balanced pmap");
+
+    FunctionDefaults<NDIM>::redistribute(world, pmapT(new LevelPmap<keyT>(world)));
+    if (world.rank() == 0) print("test_loadbal OK");
+    if (ok) return 0;
+    return 1;
+}
+
 template <typename T, std::size_t NDIM>
 int test_apply_push_1d(World& world) {
     typedef Vector<double,NDIM> coordT;
@@ -1343,6 +1443,7 @@ int main(int argc, char**argv) {
         nfail+=test_plot<double,1>(world);
         nfail+=test_apply_push_1d<double,1>(world);
         nfail+=test_io<double,1>(world);
+        nfail+=test_loadbal<double,1>(world);
 
         // stupid location for this test
         GenericConvolution1D<double,GaussianGenericFunctor<double> > gen(10,GaussianGenericFunctor<double>(100.0,100.0),0);
@@ -1372,6 +1473,7 @@ int main(int argc, char**argv) {
         nfail+=test_op<double,2>(world);
         nfail+=test_plot<double,2>(world);
         nfail+=test_io<double,2>(world);
+        nfail+=test_loadbal<double,2>(world);
 
         if (!smalltest) {
             nfail+=test_basic<double,3>(world);
@@ -0,0 +1,109 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+/// \file mtxmq_avx2.cc
+/// \brief mTxmq kernels for AVX2 with FMA
+
+// This file is compiled with -mavx2 -mfma (see CMakeLists.txt) and its
+// code is only executed after the CPU has been checked by mtxmq_simd.cc.
+
+#include <madness/tensor/mtxmq_kernels.h>
+#include <cstdlib>
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+#include <immintrin.h>
+
+namespace {
+
+    struct AVX2 {
+        typedef __m256d vec;
+        typedef __m256i mask;
+        static const int W = 4;
+        // 12 accumulators + 3 b + 1 broadcast = 16 ymm registers
+        static const int MI_REAL = 4, NV_REAL = 3;
+        // 8 accumulators + 4 b + 2 broadcast = 14 ymm registers
+        static const int MI_CPLX = 2, NV_CPLX = 2;
+
+        static vec zero() {return _mm256_setzero_pd();}
+        static vec broadcast(const double* p) {return _mm256_broadcast_sd(p);}
+        static vec load(const double* p) {return _mm256_loadu_pd(p);}
+        static vec load(const double* p, mask m) {return _mm256_maskload_pd(p, m);}
+        static void store(double* p, vec v) {_mm256_storeu_pd(p, v);}
+        static void store(double* p, vec v, mask m) {_mm256_maskstore_pd(p, m, v);}
+        static vec fmadd(vec a, vec b, vec c) {return _mm256_fmadd_pd(a, b, c);}
+        static vec swap(vec v) {return _mm256_permute_pd(v, 0x5);}
+        static vec addsub(vec a, vec b) {return _mm256_addsub_pd(a, b);}
+        static mask make_mask(int n) {
+            return _mm256_cmpgt_epi64(_mm256_set1_epi64x(n), _mm256_setr_epi64x(0, 1, 2, 3));
+        }
+    };
+
+}
+
+namespace madness {
+    namespace mtxmq_kernels {
+
+        const bool have_avx2 = true;
+
+        void mtxmq_avx2(long dimi, long dimj, long dimk,
+                        double* c, const double* a, const double* b, long ldb) {
+            mtxmq<AVX2>(dimi, dimj, dimk, c, a, b, ldb);
+        }
+
+        void mtxmq_avx2_complex(long dimi, long dimj, long dimk,
+                                double* c, const double* a, const double* b, long ldb) {
+            mtxmq_complex<AVX2>(dimi, dimj, dimk, c, a, b, ldb);
+        }
+
+    }
+}
+
+#else
+
+namespace madness {
+    namespace mtxmq_kernels {
+
+        const bool have_avx2 = false;
+
+        void mtxmq_avx2(long, long, long, double*, const double*, const double*, long) {
+            std::abort();
+        }
+
+        void mtxmq_avx2_complex(long, long, long, double*, const double*, const double*, long) {
+            std::abort();
+        }
+
+    }
+}
+
+#endif
@@ -0,0 +1,107 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+/// \file mtxmq_avx512.cc
+/// \brief mTxmq kernels for AVX-512
+
+// This file is compiled with -mavx512f (see CMakeLists.txt) and its
+// code is only executed after the CPU has been checked by mtxmq_simd.cc.
+
+#include <madness/tensor/mtxmq_kernels.h>
+#include <cstdlib>
+
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+
+namespace {
+
+    struct AVX512 {
+        typedef __m512d vec;
+        typedef __mmask8 mask;
+        static const int W = 8;
+        // 24 accumulators + 3 b + 1 broadcast = 28 of 32 zmm registers
+        static const int MI_REAL = 8, NV_REAL = 3;
+        // 16 accumulators + 4 b + 2 broadcast = 22 zmm registers
+        static const int MI_CPLX = 4, NV_CPLX = 2;
+
+        static vec zero() {return _mm512_setzero_pd();}
+        static vec broadcast(const double* p) {return _mm512_set1_pd(*p);}
+        static vec load(const double* p) {return _mm512_loadu_pd(p);}
+        static vec load(const double* p, mask m) {return _mm512_maskz_loadu_pd(m, p);}
+        static void store(double* p, vec v) {_mm512_storeu_pd(p, v);}
+        static void store(double* p, vec v, mask m) {_mm512_mask_storeu_pd(p, m, v);}
+        static vec fmadd(vec a, vec b, vec c) {return _mm512_fmadd_pd(a, b, c);}
+        static vec swap(vec v) {return _mm512_permute_pd(v, 0x55);}
+        static vec addsub(vec a, vec b) {return _mm512_fmaddsub_pd(_mm512_set1_pd(1.0), a, b);}
+        static mask make_mask(int n) {return mask((1u << n) - 1);}
+    };
+
+}
+
+namespace madness {
+    namespace mtxmq_kernels {
+
+        const bool have_avx512 = true;
+
+        void mtxmq_avx512(long dimi, long dimj, long dimk,
+                          double* c, const double* a, const double* b, long ldb) {
+            mtxmq<AVX512>(dimi, dimj, dimk, c, a, b, ldb);
+        }
+
+        void mtxmq_avx512_complex(long dimi, long dimj, long dimk,
+                                  double* c, const double* a, const double* b, long ldb) {
+            mtxmq_complex<AVX512>(dimi, dimj, dimk, c, a, b, ldb);
+        }
+
+    }
+}
+
+#else
+
+namespace madness {
+    namespace mtxmq_kernels {
+
+        const bool have_avx512 = false;
+
+        void mtxmq_avx512(long, long, long, double*, const double*, const double*, long) {
+            std::abort();
+        }
+
+        void mtxmq_avx512_complex(long, long, long, double*, const double*, const double*, long) {
+            std::abort();
+        }
+
+    }
+}
+
+#endif
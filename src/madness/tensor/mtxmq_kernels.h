@@ -0,0 +1,219 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_TENSOR_MTXMQ_KERNELS_H__INCLUDED
+#define MADNESS_TENSOR_MTXMQ_KERNELS_H__INCLUDED
+
+/// \file tensor/mtxmq_kernels.h
+/// \brief Register-blocked mTxmq kernels templated on the vector instruction set
+
+// Internal use only.  This is included ONLY by the translation units that
+// are compiled for a specific instruction set (mtxmq_avx2.cc, ...), each
+// of which supplies a traits class V in an anonymous namespace.  That
+// gives every instantiation internal linkage so that code compiled for
+// one instruction set can never be picked by the linker for another.
+//
+// The traits class must provide
+//
+//    typedef ... vec;                       // SIMD register of doubles
+//    typedef ... mask;                      // lane mask for partial vectors
+//    static const int W;                    // #doubles per vec
+//    static const int MI_REAL, NV_REAL;     // block for real data
+//    static const int MI_CPLX, NV_CPLX;     // block for complex data
+//    static vec zero();
+//    static vec broadcast(const double* p);
+//    static vec load(const double* p);
+//    static vec load(const double* p, mask m);
+//    static void store(double* p, vec v);
+//    static void store(double* p, vec v, mask m);
+//    static vec fmadd(vec a, vec b, vec c); // a*b + c
+//    static vec swap(vec v);                // exchange re/im of each pair
+//    static vec addsub(vec a, vec b);       // a-b in even lanes, a+b in odd
+//    static mask make_mask(int n);          // first n lanes active
+//
+// A block of MI rows of c and NV vectors of columns is accumulated in
+// registers over the entire k loop and then stored, so c is written
+// exactly once and b (which is at most 64x64 in the cases we handle)
+// stays resident in L1 while a streams through.  Rows of c are the outer
+// loop since dimi is large (k^(NDIM-1) or more) and dimj, dimk are small.
+//
+// Complex data is treated as pairs of doubles.  With a=ar+i*ai and b
+// held as (br,bi) pairs we accumulate ar*(br,bi) and ai*(bi,br)
+// separately and combine them with a single addsub at the end.
+
+namespace madness {
+    namespace mtxmq_kernels {
+
+        // Entry points of the instruction-set specific translation units.
+        // The have_* flags are false if the compiler could not target
+        // that instruction set, in which case the functions must not be
+        // called.
+        extern const bool have_avx2;
+        void mtxmq_avx2(long dimi, long dimj, long dimk,
+                        double* c, const double* a, const double* b, long ldb);
+        void mtxmq_avx2_complex(long dimi, long dimj, long dimk,
+                                double* c, const double* a, const double* b, long ldb);
+
+        extern const bool have_avx512;
+        void mtxmq_avx512(long dimi, long dimj, long dimk,
+                          double* c, const double* a, const double* b, long ldb);
+        void mtxmq_avx512_complex(long dimi, long dimj, long dimk,
+                                  double* c, const double* a, const double* b, long ldb);
+
+        /// Computes an MI x (NV*W) block of c(i,j) = sum(k) a(k,i)*b(k,j)
+
+        /// All pointers/strides are in units of double.  For complex
+        /// data the a(k,i) pair is at a[2*i] and the columns of b and
+        /// c are (re,im) pairs.  If MASK is true only the lanes in \c m
+        /// of the last vector of each row are loaded and stored.
+        template <typename V, int MI, int NV, bool MASK, bool CPLX>
+        inline void block(long dimk, double* c, long ldc,
+                          const double* a, long lda, const double* b, long ldb,
+                          typename V::mask m) {
+            typedef typename V::vec vec;
+            vec sr[MI][NV];
+            vec si[MI][NV];
+            for (int i=0; i<MI; ++i) {
+                for (int v=0; v<NV; ++v) {
+                    sr[i][v] = V::zero();
+                    if constexpr (CPLX) si[i][v] = V::zero();
+                }
+            }
+
+            for (long k=0; k<dimk; ++k, a+=lda, b+=ldb) {
+                vec bk[NV];
+                for (int v=0; v<NV; ++v) {
+                    if (MASK && v==NV-1) bk[v] = V::load(b+v*V::W, m);
+                    else                 bk[v] = V::load(b+v*V::W);
+                }
+                if constexpr (CPLX) {
+                    vec bs[NV];
+                    for (int v=0; v<NV; ++v) bs[v] = V::swap(bk[v]);
+                    for (int i=0; i<MI; ++i) {
+                        const vec ar = V::broadcast(a+2*i);
+                        const vec ai = V::broadcast(a+2*i+1);
+                        for (int v=0; v<NV; ++v) {
+                            sr[i][v] = V::fmadd(ar, bk[v], sr[i][v]);
+                            si[i][v] = V::fmadd(ai, bs[v], si[i][v]);
+                        }
+                    }
+                }
+                else {
+                    for (int i=0; i<MI; ++i) {
+                        const vec ai = V::broadcast(a+i);
+                        for (int v=0; v<NV; ++v) sr[i][v] = V::fmadd(ai, bk[v], sr[i][v]);
+                    }
+                }
+            }
+
+            for (int i=0; i<MI; ++i, c+=ldc) {
+                for (int v=0; v<NV; ++v) {
+                    vec s = sr[i][v];
+                    if constexpr (CPLX) s = V::addsub(s, si[i][v]);
+                    if (MASK && v==NV-1) V::store(c+v*V::W, s, m);
+                    else                 V::store(c+v*V::W, s);
+                }
+            }
+        }
+
+        /// Selects the block that covers the last (partial) columns
+        template <typename V, int MI, int NV, bool CPLX>
+        inline void column_tail(int nv, bool masked, long dimk, double* c, long ldc,
+                                const double* a, long lda, const double* b, long ldb,
+                                typename V::mask m) {
+            if (nv == NV) {
+                if (masked) block<V,MI,NV,true,CPLX>(dimk, c, ldc, a, lda, b, ldb, m);
+                else        block<V,MI,NV,false,CPLX>(dimk, c, ldc, a, lda, b, ldb, m);
+            }
+            else if constexpr (NV > 1) {
+                column_tail<V,MI,NV-1,CPLX>(nv, masked, dimk, c, ldc, a, lda, b, ldb, m);
+            }
+        }
+
+        /// Computes MI complete rows of c
+        template <typename V, int MI, int NV, bool CPLX>
+        inline void rows(long dimj, long dimk, double* c, long ldc,
+                         const double* a, long lda, const double* b, long ldb) {
+            const long nj = NV*V::W;
+            const typename V::mask full = V::make_mask(V::W);
+            long j = 0;
+            for (; j+nj<=dimj; j+=nj)
+                block<V,MI,NV,false,CPLX>(dimk, c+j, ldc, a, lda, b+j, ldb, full);
+            const long rem = dimj - j;
+            if (rem) {
+                const int nv = int((rem + V::W - 1)/V::W);
+                const int nlast = int(rem - (nv-1)*V::W);
+                column_tail<V,MI,NV,CPLX>(nv, nlast != V::W, dimk, c+j, ldc, a, lda, b+j, ldb,
+                                          V::make_mask(nlast));
+            }
+        }
+
+        /// Selects the row block for the last (partial) rows
+        template <typename V, int MI, int NV, bool CPLX>
+        inline void row_tail(int mi, long dimj, long dimk, double* c, long ldc,
+                             const double* a, long lda, const double* b, long ldb) {
+            if (mi == MI) {
+                rows<V,MI,NV,CPLX>(dimj, dimk, c, ldc, a, lda, b, ldb);
+            }
+            else if constexpr (MI > 1) {
+                row_tail<V,MI-1,NV,CPLX>(mi, dimj, dimk, c, ldc, a, lda, b, ldb);
+            }
+        }
+
+        /// c(i,j) = sum(k) a(k,i)*b(k,j) for real data with b(k,j) at b[k*ldb+j]
+        template <typename V>
+        void mtxmq(long dimi, long dimj, long dimk,
+                   double* c, const double* a, const double* b, long ldb) {
+            const int MI = V::MI_REAL;
+            long i = 0;
+            for (; i+MI<=dimi; i+=MI)
+                rows<V,MI,V::NV_REAL,false>(dimj, dimk, c+i*dimj, dimj, a+i, dimi, b, ldb);
+            if (i < dimi)
+                row_tail<V,MI,V::NV_REAL,false>(int(dimi-i), dimj, dimk, c+i*dimj, dimj, a+i, dimi, b, ldb);
+        }
+
+        /// c(i,j) = sum(k) a(k,i)*b(k,j) for complex data viewed as (re,im) pairs
+        template <typename V>
+        void mtxmq_complex(long dimi, long dimj, long dimk,
+                           double* c, const double* a, const double* b, long ldb) {
+            const int MI = V::MI_CPLX;
+            const long ldc = 2*dimj, lda = 2*dimi;
+            long i = 0;
+            for (; i+MI<=dimi; i+=MI)
+                rows<V,MI,V::NV_CPLX,true>(2*dimj, dimk, c+i*ldc, ldc, a+2*i, lda, b, 2*ldb);
+            if (i < dimi)
+                row_tail<V,MI,V::NV_CPLX,true>(int(dimi-i), 2*dimj, dimk, c+i*ldc, ldc, a+2*i, lda, b, 2*ldb);
+        }
+
+    }
+}
+
+#endif // MADNESS_TENSOR_MTXMQ_KERNELS_H__INCLUDED
@@ -0,0 +1,173 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+/// \file mtxmq_simd.cc
+/// \brief Detects the CPU and dispatches mTxmq to the matching kernels
+
+#include <madness/tensor/mtxmq_simd.h>
+#include <madness/tensor/mtxmq_kernels.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <cpuid.h>
+#define MADNESS_MTXMQ_HAVE_CPUID
+#endif
+
+namespace madness {
+
+    namespace {
+
+#ifdef MADNESS_MTXMQ_HAVE_CPUID
+        // Extended control register 0 tells which register state the OS saves
+        unsigned long long xgetbv0() {
+            unsigned int eax, edx;
+            __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            return (static_cast<unsigned long long>(edx) << 32) | eax;
+        }
+
+        bool cpu_has_avx2() {
+            unsigned int eax, ebx, ecx, edx;
+            if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+            const bool osxsave = ecx & (1u << 27);
+            const bool avx = ecx & (1u << 28);
+            const bool fma = ecx & (1u << 12);
+            if (!(osxsave && avx && fma)) return false;
+            if ((xgetbv0() & 0x6) != 0x6) return false;      // XMM and YMM state
+            if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+            return ebx & (1u << 5);
+        }
+
+        bool cpu_has_avx512() {
+            if (!cpu_has_avx2()) return false;
+            if ((xgetbv0() & 0xe6) != 0xe6) return false;    // + opmask and ZMM state
+            unsigned int eax, ebx, ecx, edx;
+            if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+            return ebx & (1u << 16);
+        }
+#else
+        bool cpu_has_avx2() {return false;}
+        bool cpu_has_avx512() {return false;}
+#endif
+
+        bool supported(MTxmqKernel kernel) {
+            switch (kernel) {
+            case MTxmqKernel::generic: return true;
+            case MTxmqKernel::avx2:    return mtxmq_kernels::have_avx2 && cpu_has_avx2();
+            case MTxmqKernel::avx512:  return mtxmq_kernels::have_avx512 && cpu_has_avx512();
+            }
+            return false;
+        }
+
+        MTxmqKernel default_kernel() {
+            const char* mad_mtxmq_kernel = getenv("MAD_MTXMQ_KERNEL");
+            if (mad_mtxmq_kernel) {
+                bool known = false;
+                for (MTxmqKernel k : {MTxmqKernel::generic, MTxmqKernel::avx2, MTxmqKernel::avx512}) {
+                    if (std::strcmp(mad_mtxmq_kernel, mtxmq_kernel_name(k)) == 0) {
+                        if (supported(k)) return k;
+                        known = true;
+                    }
+                }
+                if (known)
+                    std::cerr << "!!! WARNING: MAD_MTXMQ_KERNEL=" << mad_mtxmq_kernel
+                              << " is not supported on this CPU ... using the default\n";
+                else
+                    std::cerr << "!!! WARNING: MAD_MTXMQ_KERNEL must be generic, avx2 or avx512"
+                              << " ... using the default\n";
+            }
+            if (supported(MTxmqKernel::avx512)) return MTxmqKernel::avx512;
+            if (supported(MTxmqKernel::avx2)) return MTxmqKernel::avx2;
+            return MTxmqKernel::generic;
+        }
+
+        MTxmqKernel selected = default_kernel();
+    }
+
+    MTxmqKernel mtxmq_kernel() {
+        return selected;
+    }
+
+    bool mtxmq_kernel_supported(MTxmqKernel kernel) {
+        return supported(kernel);
+    }
+
+    bool set_mtxmq_kernel(MTxmqKernel kernel) {
+        if (!supported(kernel)) return false;
+        selected = kernel;
+        return true;
+    }
+
+    const char* mtxmq_kernel_name(MTxmqKernel kernel) {
+        switch (kernel) {
+        case MTxmqKernel::generic: return "generic";
+        case MTxmqKernel::avx2:    return "avx2";
+        case MTxmqKernel::avx512:  return "avx512";
+        }
+        return "unknown";
+    }
+
+    bool mtxmq_simd(long dimi, long dimj, long dimk,
+                    double* c, const double* a, const double* b, long ldb) {
+        if (dimj > MTXMQ_SIMD_MAXDIM || dimk > MTXMQ_SIMD_MAXDIM) return false;
+        switch (selected) {
+        case MTxmqKernel::avx512:
+            mtxmq_kernels::mtxmq_avx512(dimi, dimj, dimk, c, a, b, ldb);
+            return true;
+        case MTxmqKernel::avx2:
+            mtxmq_kernels::mtxmq_avx2(dimi, dimj, dimk, c, a, b, ldb);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool mtxmq_simd(long dimi, long dimj, long dimk, std::complex<double>* c,
+                    const std::complex<double>* a, const std::complex<double>* b, long ldb) {
+        if (dimj > MTXMQ_SIMD_MAXDIM || dimk > MTXMQ_SIMD_MAXDIM) return false;
+        double* dc = reinterpret_cast<double*>(c);
+        const double* da = reinterpret_cast<const double*>(a);
+        const double* db = reinterpret_cast<const double*>(b);
+        switch (selected) {
+        case MTxmqKernel::avx512:
+            mtxmq_kernels::mtxmq_avx512_complex(dimi, dimj, dimk, dc, da, db, ldb);
+            return true;
+        case MTxmqKernel::avx2:
+            mtxmq_kernels::mtxmq_avx2_complex(dimi, dimj, dimk, dc, da, db, ldb);
+            return true;
+        default:
+            return false;
+        }
+    }
+
+}
@@ -0,0 +1,94 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+#ifndef MADNESS_TENSOR_MTXMQ_SIMD_H__INCLUDED
+#define MADNESS_TENSOR_MTXMQ_SIMD_H__INCLUDED
+
+/// \file tensor/mtxmq_simd.h
+/// \brief Runtime selection of hand-vectorized mTxmq kernels
+
+#include <complex>
+
+namespace madness {
+
+    /// Implementations of mTxmq that can be selected at runtime
+    enum class MTxmqKernel {
+        generic,    ///< The BLAS or reference code chosen at compile time
+        avx2,       ///< Register-blocked AVX2+FMA kernels
+        avx512      ///< Register-blocked AVX-512 kernels
+    };
+
+    /// Largest \c dimj and \c dimk for which the vectorized kernels are used
+
+    /// Beyond this the b matrix no longer fits in L1 and the cache
+    /// blocking of a real BLAS wins.  \c dimi is unrestricted.
+    static const long MTXMQ_SIMD_MAXDIM = 64;
+
+    /// Returns the kernel presently used by mTxmq
+    MTxmqKernel mtxmq_kernel();
+
+    /// Returns true if the kernel was compiled and the CPU supports it
+    bool mtxmq_kernel_supported(MTxmqKernel kernel);
+
+    /// Selects the kernel used by mTxmq
+
+    /// By default the best kernel supported by the CPU is used, which can
+    /// be overridden with the environment variable MAD_MTXMQ_KERNEL set to
+    /// one of \c generic, \c avx2 or \c avx512.
+    /// @return False (and leaves the selection unchanged) if not supported
+    bool set_mtxmq_kernel(MTxmqKernel kernel);
+
+    /// Returns the name of a kernel
+    const char* mtxmq_kernel_name(MTxmqKernel kernel);
+
+    /// Computes c(i,j) = sum(k) a(k,i)*b(k,j) with the selected vectorized kernel
+
+    /// @return False if nothing was computed because the generic kernel is
+    /// selected or the shape is outside the range of the kernels, in which
+    /// case the caller must do the work.
+    bool mtxmq_simd(long dimi, long dimj, long dimk,
+                    double* c, const double* a, const double* b, long ldb);
+
+    /// Computes c(i,j) = sum(k) a(k,i)*b(k,j) with the selected vectorized kernel
+    bool mtxmq_simd(long dimi, long dimj, long dimk, std::complex<double>* c,
+                    const std::complex<double>* a, const std::complex<double>* b, long ldb);
+
+    /// There are no vectorized kernels for other (and mixed) types
+    template <typename aT, typename bT, typename cT>
+    inline bool mtxmq_simd(long dimi, long dimj, long dimk,
+                           cT* c, const aT* a, const bT* b, long ldb) {
+        return false;
+    }
+
+}
+
+#endif // MADNESS_TENSOR_MTXMQ_SIMD_H__INCLUDED
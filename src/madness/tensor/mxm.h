@@ -36,6 +36,7 @@
 #define MADNESS_TENSOR_MXM_H__INCLUDED
 
 #include <madness/madness_config.h>
+#include <madness/tensor/mtxmq_simd.h>
 
 #define HAVE_FAST_BLAS
 #ifdef  HAVE_FAST_BLAS
@@ -248,6 +249,9 @@ namespace madness {
     /// stored with \c ldb>dimj which happens in madness when transforming with
     /// low rank matrices.  A matrix in dense storage has \c ldb=dimj which is
     /// the default for backward compatibility.
+    ///
+    /// The small shapes that dominate madness are first offered to the
+    /// vectorized kernels in mtxmq_simd.h which beat a general BLAS there.
     template <typename T>
     void mTxmq(long dimi, long dimj, long dimk,
                T* MADNESS_RESTRICT c, const T* a, const T* b, long ldb=-1) {
@@ -255,6 +259,7 @@ namespace madness {
         MADNESS_ASSERT(ldb>=dimj);
 
         if (dimi==0 || dimj==0) return; // nothing to do and *GEMM will complain
+        if (mtxmq_simd(dimi, dimj, dimk, c, a, b, ldb)) return;
         if (dimk==0) {
             for (long i=0; i<dimi*dimj; i++) c[i] = 0.0;
         }
@@ -382,6 +387,8 @@ namespace madness {
     template <typename aT, typename bT, typename cT>
     void mTxmq(long dimi, long dimj, long dimk,
                cT* MADNESS_RESTRICT c, const aT* a, const bT* b, long ldb=-1) {
+        if (ldb == -1) ldb=dimj;
+        if (mtxmq_simd(dimi, dimj, dimk, c, a, b, ldb)) return;
         mTxmq_reference(dimi, dimj, dimk, c, a, b, ldb);
     }
 
@@ -59,6 +59,7 @@
 #include <madness/tensor/mxm.h>
 #include <madness/tensor/tensorexcept.h>
 #include <madness/tensor/tensoriter.h>
+#include <madness/tensor/tensor_pool.h>
 
 #ifdef USE_GENTENSOR
 #define HAVE_GENTENSOR 1
@@ -372,8 +373,16 @@ namespace madness {
                     _p = new T[_size];
                     _shptr = std::shared_ptr<T>(_p);
 #else
-                    if (posix_memalign((void **) &_p, TENSOR_ALIGNMENT, sizeof(T)*_size)) throw 1;
-                    _shptr.reset(_p, &free);
+                    if (TensorPool::enabled()) {
+                        const std::size_t nbyte = sizeof(T)*_size;
+                        _p = static_cast<T*>(TensorPool::allocate(nbyte, TENSOR_ALIGNMENT));
+                        if (!_p) throw 1;
+                        _shptr.reset(_p, TensorPool::Deleter(nbyte));
+                    }
+                    else {
+                        if (posix_memalign((void **) &_p, TENSOR_ALIGNMENT, sizeof(T)*_size)) throw 1;
+                        _shptr.reset(_p, &free);
+                    }
 #endif
                 }
                 catch (...) {
@@ -468,6 +477,22 @@ namespace madness {
         }
 
 
+#ifndef TENSOR_USE_SHARED_ALIGNED_ARRAY
+        /// Make a tensor that aliases memory owned by someone else (no copy)
+
+        /// Used to deserialize a tensor in place in a message buffer; the
+        /// tensor (and its shallow copies) keep \c owner alive.
+        /// @param[in] nd Number of dimensions
+        /// @param[in] d Size of each dimension
+        /// @param[in] p The contiguous data, suitably aligned for \c T
+        /// @param[in] owner Owner of the memory holding \c p
+        Tensor(long nd, const long d[], T* p, const std::shared_ptr<void>& owner) : _p(p) {
+            _id = TensorTypeData<T>::id;
+            set_dims_and_size(nd, d);
+            _shptr = std::shared_ptr<T>(owner, p);
+        }
+#endif
+
         /// Type conversion makes a deep copy
         template <class Q> operator Tensor<Q>() const { // type conv => deep copy
             Tensor<Q> result = Tensor<Q>(this->_ndim,this->_dim,false);
@@ -1885,6 +1910,38 @@ namespace madness {
     std::ostream& operator << (std::ostream& out, const Tensor<T>& t);
 
 
+    namespace archive {
+        class BufferInputArchive;
+    }
+
+    namespace detail {
+        /// Deserialize tensor data in place; only buffers with an owner can do this
+        template <class Archive, typename T>
+        inline typename std::enable_if<!std::is_same<Archive,archive::BufferInputArchive>::value, bool>::type
+        load_tensor_alias(const Archive&, Tensor<T>&, long, const long*) {
+            return false;
+        }
+
+        template <class Archive, typename T>
+        inline typename std::enable_if<std::is_same<Archive,archive::BufferInputArchive>::value, bool>::type
+        load_tensor_alias(const Archive& s, Tensor<T>& t, long ndim, const long* dim) {
+#ifdef TENSOR_USE_SHARED_ALIGNED_ARRAY
+            return false;
+#else
+            // Complex data are stored as consecutive real and
+            // imaginary parts, i.e., in their in-memory layout
+            typedef typename TensorTypeData<T>::scalar_type scalarT;
+            const long nscalar = sizeof(T)/sizeof(scalarT);
+            long sz = 1;
+            for (long i=0; i<ndim; ++i) sz *= dim[i];
+            scalarT* p = s.template borrow<scalarT>(sz*nscalar);
+            if (!p) return false;
+            t = Tensor<T>(ndim, dim, reinterpret_cast<T*>(p), s.owner());
+            return true;
+#endif
+        }
+    }
+
     namespace archive {
         /// Serialize a tensor
         template <class Archive, typename T>
@@ -1902,6 +1959,9 @@ namespace madness {
 
 
         /// Deserialize a tensor ... existing tensor is replaced
+
+        /// From a \c BufferInputArchive that owns its buffer (i.e., a huge
+        /// active message) the tensor aliases the buffer instead of copying.
         template <class Archive, typename T>
         struct ArchiveLoadImpl< Archive, Tensor<T> > {
             static void load(const Archive& s, Tensor<T>& t) {
@@ -1911,6 +1971,10 @@ namespace madness {
                 if (sz) {
                     long _ndim = 0l, _dim[TENSOR_MAXDIM];
                     s & _ndim & wrap(_dim,TENSOR_MAXDIM);
+                    if (madness::detail::load_tensor_alias(s, t, _ndim, _dim)) {
+                        if (sz != t.size()) throw "size mismatch deserializing a tensor";
+                        return;
+                    }
                     t = Tensor<T>(_ndim, _dim, false);
                     if (sz != t.size()) throw "size mismatch deserializing a tensor";
                     s & wrap(t.ptr(), t.size());
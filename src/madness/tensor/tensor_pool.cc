@@ -0,0 +1,235 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+/// \file tensor_pool.cc
+/// \brief Implements TensorPool
+
+#include <madness/tensor/tensor_pool.h>
+#include <madness/world/posixmem.h>
+#include <madness/world/hardware.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <set>
+
+namespace madness {
+
+    namespace {
+
+        /// Counter written only by the owning thread but read by any
+        class Counter {
+            std::atomic<uint64_t> value;
+        public:
+            Counter() : value(0) {}
+            void add(uint64_t n) {value.store(value.load(std::memory_order_relaxed)+n, std::memory_order_relaxed);}
+            void sub(uint64_t n) {value.store(value.load(std::memory_order_relaxed)-n, std::memory_order_relaxed);}
+            uint64_t get() const {return value.load(std::memory_order_relaxed);}
+        };
+
+        struct SizeClass {
+            std::size_t nbyte;                          // 0 if unused
+            int nfree;                                  // #buffers in free
+            void* free[TensorPool::MAX_PER_CLASS];
+        };
+
+        struct ThreadCache {
+            SizeClass classes[TensorPool::NCLASS];
+            Counter nalloc, nhit, nmiss, nrelease, noverflow, nremote, ncached_bytes, npeak_bytes;
+
+            ThreadCache();
+            ~ThreadCache();
+
+            void clear() {
+                for (SizeClass& c : classes) {
+                    for (int i=0; i<c.nfree; ++i) std::free(c.free[i]);
+                    ncached_bytes.sub(c.nbyte*c.nfree);
+                    c.nfree = 0;
+                    c.nbyte = 0;
+                }
+            }
+        };
+
+        // Registry of all thread caches so that statistics can be gathered
+        std::mutex registry_mutex;
+        std::set<ThreadCache*>& registry() {
+            static std::set<ThreadCache*> caches;
+            return caches;
+        }
+        TensorPoolStats retired_stats;  // Stats of caches of threads that have exited
+
+        ThreadCache::ThreadCache() {
+            for (SizeClass& c : classes) {
+                c.nbyte = 0;
+                c.nfree = 0;
+            }
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry().insert(this);
+        }
+
+        ThreadCache::~ThreadCache() {
+            clear();
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry().erase(this);
+            retired_stats.nalloc += nalloc.get();
+            retired_stats.nhit += nhit.get();
+            retired_stats.nmiss += nmiss.get();
+            retired_stats.nrelease += nrelease.get();
+            retired_stats.noverflow += noverflow.get();
+            retired_stats.nremote += nremote.get();
+            retired_stats.npeak_bytes += npeak_bytes.get();
+        }
+
+        // The cache is constructed on first use by each thread.  After a
+        // thread's cache has been destroyed (at thread exit) any buffers
+        // still being released by that thread go straight back to the system.
+        thread_local bool cache_destroyed = false;
+        struct CacheHolder {
+            ThreadCache cache;
+            ~CacheHolder() {cache_destroyed = true;}
+        };
+
+        ThreadCache* get_cache() {
+            if (cache_destroyed) return nullptr;
+            static thread_local CacheHolder holder;
+            return &holder.cache;
+        }
+
+        bool default_enabled() {
+            const char* mad_tensor_pool = getenv("MAD_TENSOR_POOL");
+            if (mad_tensor_pool) {
+                int flag = 0;
+                if (sscanf(mad_tensor_pool, "%d", &flag) != 1) {
+                    std::cerr << "!!! WARNING: MAD_TENSOR_POOL is not an integer ... pool disabled\n";
+                    return false;
+                }
+                return flag != 0;
+            }
+            return false;
+        }
+    }
+
+
+    bool TensorPool::is_enabled = default_enabled();
+
+    void* TensorPool::allocate(std::size_t nbyte, std::size_t alignment) {
+        ThreadCache* cache = get_cache();
+        if (cache) {
+            cache->nalloc.add(1);
+            if (nbyte <= MAX_NBYTE) {
+                for (SizeClass& c : cache->classes) {
+                    if (c.nbyte == nbyte && c.nfree) {
+                        cache->nhit.add(1);
+                        cache->ncached_bytes.sub(nbyte);
+                        return c.free[--c.nfree];
+                    }
+                }
+            }
+            cache->nmiss.add(1);
+        }
+        void* p = nullptr;
+        if (posix_memalign(&p, alignment, nbyte)) return nullptr;
+        return p;
+    }
+
+    int TensorPool::current_domain() {
+        return Hardware::CurrentNUMADomain();
+    }
+
+    void TensorPool::deallocate(void* p, std::size_t nbyte, int domain) {
+        if (!p) return;
+        ThreadCache* cache = get_cache();
+        if (cache && domain >= 0 && domain != current_domain()) {
+            cache->nremote.add(1);
+            std::free(p);
+            return;
+        }
+        if (cache && nbyte <= MAX_NBYTE &&
+            cache->ncached_bytes.get() + nbyte <= MAX_CACHED_NBYTE) {
+            // Use the matching class or else recycle an empty one
+            SizeClass* target = nullptr;
+            for (SizeClass& c : cache->classes) {
+                if (c.nbyte == nbyte) {
+                    target = &c;
+                    break;
+                }
+                if (!target && c.nfree == 0) target = &c;
+            }
+            if (target && target->nfree < MAX_PER_CLASS) {
+                target->nbyte = nbyte;
+                target->free[target->nfree++] = p;
+                cache->nrelease.add(1);
+                cache->ncached_bytes.add(nbyte);
+                const uint64_t n = cache->ncached_bytes.get();
+                if (n > cache->npeak_bytes.get()) cache->npeak_bytes.add(n - cache->npeak_bytes.get());
+                return;
+            }
+        }
+        if (cache) cache->noverflow.add(1);
+        std::free(p);
+    }
+
+    void TensorPool::clear() {
+        ThreadCache* cache = get_cache();
+        if (cache) cache->clear();
+    }
+
+    TensorPoolStats TensorPool::get_stats() {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        TensorPoolStats s = retired_stats;
+        for (const ThreadCache* c : registry()) {
+            s.nalloc += c->nalloc.get();
+            s.nhit += c->nhit.get();
+            s.nmiss += c->nmiss.get();
+            s.nrelease += c->nrelease.get();
+            s.noverflow += c->noverflow.get();
+            s.nremote += c->nremote.get();
+            s.ncached_bytes += c->ncached_bytes.get();
+            s.npeak_bytes += c->npeak_bytes.get();
+        }
+        return s;
+    }
+
+    void TensorPool::print_stats() {
+        TensorPoolStats s = get_stats();
+        std::printf("  Tensor pool statistics\n");
+        std::printf("  ----------------------\n");
+        std::printf("            #allocations    %.2e\n", double(s.nalloc));
+        std::printf("                hit rate    %.1f%%\n", 100.0*s.hit_rate());
+        std::printf("       #released to pool    %.2e\n", double(s.nrelease));
+        std::printf("     #released to system    %.2e\n", double(s.noverflow));
+        std::printf("   #released cross-domain    %.2e\n", double(s.nremote));
+        std::printf("            cached bytes    %.2e\n", double(s.ncached_bytes));
+        std::printf("       peak cached bytes    %.2e\n", double(s.npeak_bytes));
+    }
+
+}  // namespace madness
@@ -0,0 +1,136 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_TENSOR_TENSOR_POOL_H__INCLUDED
+#define MADNESS_TENSOR_TENSOR_POOL_H__INCLUDED
+
+/// \file tensor_pool.h
+/// \brief Declares TensorPool, an optional thread-local cache of tensor buffers
+
+#include <cstddef>
+#include <cstdint>
+
+namespace madness {
+
+    /// Statistics of the tensor buffer pool summed over all threads
+    struct TensorPoolStats {
+        uint64_t nalloc;        ///< #allocations requested from the pool
+        uint64_t nhit;          ///< #allocations satisfied from a cached buffer
+        uint64_t nmiss;         ///< #allocations passed on to the system allocator
+        uint64_t nrelease;      ///< #buffers returned to a cache
+        uint64_t noverflow;     ///< #buffers returned to the system since a cache was full
+        uint64_t nremote;       ///< #buffers returned to the system since they were released in another NUMA domain
+        uint64_t ncached_bytes; ///< #bytes presently held in the caches
+        uint64_t npeak_bytes;   ///< Sum over threads of the peak #bytes held in the cache
+
+        TensorPoolStats()
+            : nalloc(0), nhit(0), nmiss(0), nrelease(0), noverflow(0), nremote(0)
+            , ncached_bytes(0), npeak_bytes(0) {}
+
+        /// Fraction of allocations satisfied from the caches
+        double hit_rate() const {
+            return nalloc ? double(nhit)/double(nalloc) : 0.0;
+        }
+    };
+
+
+    /// Optional thread-local size-class cache for tensor data
+
+    /// The kernels in apply, multiplication and the two-scale transforms
+    /// create very many short-lived tensors of the same few sizes
+    /// (k^NDIM and (2k)^NDIM for the current k).  When enabled, Tensor
+    /// takes its buffers from here instead of directly from posix_memalign.
+    /// Each thread keeps a small number of size classes keyed on the exact
+    /// byte count, each holding a bounded list of free buffers, so
+    /// allocation and release on a warm thread require no lock.  A buffer
+    /// released by a different thread than allocated it joins the
+    /// releasing thread's cache, unless the two threads are in different
+    /// NUMA domains: then it is freed, so that each cache only holds
+    /// memory first touched in its own domain.
+    ///
+    /// The pool is disabled by default; enable it by setting the
+    /// environment variable MAD_TENSOR_POOL to a nonzero integer or by
+    /// calling TensorPool::set_enabled(true).  Toggling the pool is safe
+    /// at any time since each buffer remembers how it must be freed.
+    class TensorPool {
+    public:
+        static const std::size_t MAX_NBYTE = 4*1024*1024; ///< Larger buffers are never cached
+        static const int NCLASS = 16;        ///< #size classes per thread
+        static const int MAX_PER_CLASS = 64; ///< #free buffers cached per size class
+        static const std::size_t MAX_CACHED_NBYTE = 64*1024*1024; ///< Limit on #bytes cached per thread
+
+        /// Deleter for shared_ptr that returns the buffer to the pool
+        struct Deleter {
+            std::size_t nbyte;
+            int domain;         ///< NUMA domain of the allocating thread
+            explicit Deleter(std::size_t nbyte) : nbyte(nbyte), domain(current_domain()) {}
+            void operator()(void* p) const {TensorPool::deallocate(p, nbyte, domain);}
+        };
+
+        /// Returns true if the pool is enabled
+        static bool enabled() {return is_enabled;}
+
+        /// Enables or disables the pool
+        static void set_enabled(bool flag) {is_enabled = flag;}
+
+        /// Allocates an aligned buffer, preferably from this thread's cache
+
+        /// @param[in] nbyte Size of the buffer in bytes
+        /// @param[in] alignment Alignment (must be the same for all calls)
+        /// @return Pointer to the buffer or null on failure
+        static void* allocate(std::size_t nbyte, std::size_t alignment);
+
+        /// Returns a buffer from allocate() to this thread's cache, or frees it
+
+        /// @param[in] p The buffer
+        /// @param[in] nbyte Size of the buffer in bytes
+        /// @param[in] domain NUMA domain it was allocated in, or -1 if unknown
+        static void deallocate(void* p, std::size_t nbyte, int domain = -1);
+
+        /// NUMA domain of the calling thread (0 on a single-domain node)
+        static int current_domain();
+
+        /// Frees all buffers cached by the calling thread
+        static void clear();
+
+        /// Returns statistics summed over all threads
+        static TensorPoolStats get_stats();
+
+        /// Prints statistics to std::cout
+        static void print_stats();
+
+    private:
+        static bool is_enabled;
+    };
+
+}  // namespace madness
+
+#endif // MADNESS_TENSOR_TENSOR_POOL_H__INCLUDED
@@ -205,7 +205,10 @@ int main(int argc, char * argv[]) {
     int stride = 1;
     if (smalltest) stride = 3; // odd to test even and odd values
     
-    printf("Starting to test ... \n");
+    const MTxmqKernel selected = mtxmq_kernel();
+    for (MTxmqKernel kernel : {MTxmqKernel::generic, MTxmqKernel::avx2, MTxmqKernel::avx512}) {
+    if (!set_mtxmq_kernel(kernel)) continue;
+    printf("Starting to test %s ... \n", mtxmq_kernel_name(kernel));
     for (ni=1; ni<12; ni+=stride) {
         for (nj=1; nj<12; nj+=stride) {
             for (nk=1; nk<12; nk+=stride) {
@@ -229,6 +232,8 @@ int main(int argc, char * argv[]) {
         }
     }
     printf("... OK!\n");
+    }
+    set_mtxmq_kernel(selected);
 
     if (!smalltest) {
         printf("%20s %3s %3s %3s %8s %8s (GF/s)\n", "type", "M", "N", "K", "LOOP", "BLAS");
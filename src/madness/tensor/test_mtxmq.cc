@@ -96,82 +96,84 @@ void crap(double rate, double fastest, double start) {
     if (rate == 0) printf("darn compiler bug %e %e %lf\n",rate,fastest,start);
 }
 
+const MTxmqKernel kernels[] = {MTxmqKernel::generic, MTxmqKernel::avx2, MTxmqKernel::avx512};
 
-void timer(const char* s, long ni, long nj, long nk, double *a, double *b, double *c) {
-  double fastest=0.0, fastest_dgemm=0.0;
-
-  double nflop = 2.0*ni*nj*nk;
+// Best rate (GF/s) of ntran successive mTxmq (or dgemm if blas) calls
+double rate(bool blas, long ntran, long ni, long nj, long nk, double *a, double *b, double *c) {
+  double fastest=0.0;
+  double nflop = ntran*2.0*ni*nj*nk;
   long loop;
   for (int t=0; t<100; t++) {
     double rate;
     double start = SafeMPI::Wtime();
     for (loop=0; loop<100; ++loop) {
+#ifdef TIME_DGEMM
+      if (blas) {
+        mTxm_dgemm(ni,nj,nk,c,a,b);
+        if (ntran == 3) {
+          mTxm_dgemm(ni,nj,nk,a,c,b);
+          mTxm_dgemm(ni,nj,nk,c,a,b);
+        }
+        continue;
+      }
+#endif
       mTxmq(ni,nj,nk,c,a,b);
+      if (ntran == 3) {
+        mTxmq(ni,nj,nk,a,c,b);
+        mTxmq(ni,nj,nk,c,a,b);
+      }
     }
     start = SafeMPI::Wtime() - start;
     rate = 1.e-9*nflop/(start/100.0);
     crap(rate,fastest,start);
     if (rate > fastest) fastest = rate;
   }
+  return fastest;
+}
+
+void header() {
+  printf("%20s %3s %3s %3s", "type", "M", "N", "K");
+  for (MTxmqKernel k : kernels)
+    if (mtxmq_kernel_supported(k)) printf(" %8s", mtxmq_kernel_name(k));
 #ifdef TIME_DGEMM
-  for (int t=0; t<100; t++) {
-    double rate;
-    double start = SafeMPI::Wtime();
-    for (loop=0; loop<100; ++loop) {
-      mTxm_dgemm(ni,nj,nk,c,a,b);
-    }
-    start = SafeMPI::Wtime() - start;
-    rate = 1.e-9*nflop/(start/100.0);
-    crap(rate,fastest_dgemm,start);
-    if (rate > fastest_dgemm) fastest_dgemm = rate;
-  }
+  printf(" %8s", "BLAS");
 #endif
-  printf("%20s %3ld %3ld %3ld %8.2f %8.2f\n",s, ni,nj,nk, fastest, fastest_dgemm);
+  printf(" (GF/s)\n");
 }
 
-void trantimer(const char* s, long ni, long nj, long nk, double *a, double *b, double *c) {
-  double fastest=0.0, fastest_dgemm=0.0;
-
-  double nflop = 3.0*2.0*ni*nj*nk;
-  long loop;
-  for (int t=0; t<100; t++) {
-    double rate;
-    double start = SafeMPI::Wtime();
-    for (loop=0; loop<100; ++loop) {
-      mTxmq(ni,nj,nk,c,a,b);
-      mTxmq(ni,nj,nk,a,c,b);
-      mTxmq(ni,nj,nk,c,a,b);
-    }
-    start = SafeMPI::Wtime() - start;
-    rate = 1.e-9*nflop/(start/100.0);
-    crap(rate,fastest,start);
-    if (rate > fastest) fastest = rate;
+// Prints the rate of each supported mTxmq kernel and of dgemm
+void timer(const char* s, long ntran, long ni, long nj, long nk, double *a, double *b, double *c) {
+  const MTxmqKernel selected = mtxmq_kernel();
+  printf("%20s %3ld %3ld %3ld",s, ni,nj,nk);
+  for (MTxmqKernel k : kernels) {
+    if (set_mtxmq_kernel(k)) printf(" %8.2f", rate(false, ntran, ni, nj, nk, a, b, c));
   }
 #ifdef TIME_DGEMM
-  for (int t=0; t<100; t++) {
-    double rate;
-    double start = SafeMPI::Wtime();
-    for (loop=0; loop<100; ++loop) {
-      mTxm_dgemm(ni,nj,nk,c,a,b);
-      mTxm_dgemm(ni,nj,nk,a,c,b);
-      mTxm_dgemm(ni,nj,nk,c,a,b);
-    }
-    start = SafeMPI::Wtime() - start;
-    rate = 1.e-9*nflop/(start/100.0);
-    crap(rate,fastest_dgemm,start);
-    if (rate > fastest_dgemm) fastest_dgemm = rate;
-  }
+  printf(" %8.2f", rate(true, ntran, ni, nj, nk, a, b, c));
 #endif
-  printf("%20s %3ld %3ld %3ld %8.2f %8.2f\n",s, ni,nj,nk, fastest, fastest_dgemm);
+  printf("\n");
+  set_mtxmq_kernel(selected);
+}
+
+void timer(const char* s, long ni, long nj, long nk, double *a, double *b, double *c) {
+  timer(s, 1, ni, nj, nk, a, b, c);
+}
+
+void trantimer(const char* s, long ni, long nj, long nk, double *a, double *b, double *c) {
+  timer(s, 3, ni, nj, nk, a, b, c);
 }
 
 int main(int argc, char * argv[]) {
 
+    bool benchmark = false;
     if (getenv("MAD_SMALL_TESTS")) smalltest=true;
     for (int iarg=1; iarg<argc; iarg++) if (strcmp(argv[iarg],"--small")==0) smalltest=true;
+    for (int iarg=1; iarg<argc; iarg++) if (strcmp(argv[iarg],"--bench")==0) benchmark=true;
+    if (benchmark) smalltest=false;
     std::cout << "small test : " << smalltest << std::endl;
+    std::cout << "mTxmq kernel : " << mtxmq_kernel_name(mtxmq_kernel()) << std::endl;
     
-    const long nimax=!smalltest ? 30*30 : 8*8;
+    const long nimax=!smalltest ? 40*40 : 8*8;
     const long njmax=!smalltest ? 100 : 20;
     const long nkmax=!smalltest ? 100 : 20;
     long ni, nj, nk, i, m;
@@ -180,12 +182,12 @@ int main(int argc, char * argv[]) {
     SafeMPI::Init_thread(argc, argv, MPI_THREAD_SINGLE);
 
     posix_memalign((void **) &a, 16, nkmax*nimax*sizeof(double));
-    posix_memalign((void **) &b, 16, nkmax*njmax*sizeof(double));
+    posix_memalign((void **) &b, 16, nkmax*(njmax+3)*sizeof(double));
     posix_memalign((void **) &c, 16, nimax*njmax*sizeof(double));
     posix_memalign((void **) &d, 16, nimax*njmax*sizeof(double));
 
     ran_fill(nkmax*nimax, a);
-    ran_fill(nkmax*njmax, b);
+    ran_fill(nkmax*(njmax+3), b);
 
 
 /*     ni = nj = nk = 2; */
@@ -200,8 +202,22 @@ int main(int argc, char * argv[]) {
 /*     } */
 /*     return 0; */
 
-    printf("Starting to test ... \n");
-    for (ni=1; ni<std::min(60L,nimax); ni+=1) {
+    // --bench only times the shapes that occur in madness for k=4..20
+    if (benchmark) {
+        header();
+        for (m=4; m<=20; m+=2) timer("1D k",  m*m, m, m, a,b,c);
+        for (m=4; m<=20; m+=2) timer("1D 2k", 4*m*m, 2*m, 2*m, a,b,c);
+        for (m=4; m<=20; m+=2) timer("low rank 2k", 4*m*m, m, 2*m, a,b,c);
+        for (m=4; m<=20; m+=2) trantimer("3D k", m*m, m, m, a,b,c);
+        SafeMPI::Finalize();
+        return 0;
+    }
+
+    const MTxmqKernel selected = mtxmq_kernel();
+    for (MTxmqKernel kernel : kernels) {
+      if (!set_mtxmq_kernel(kernel)) continue;
+      printf("Starting to test %s ... \n", mtxmq_kernel_name(kernel));
+      for (ni=1; ni<std::min(60L,nimax); ni+=1) {
         for (nj=1; nj<std::min(60L,njmax); nj+=1) {
             for (nk=1; nk<std::min(60L,nkmax); nk+=1) {
                 for (i=0; i<ni*nj; ++i) d[i] = c[i] = 0.0;
@@ -220,13 +236,26 @@ int main(int argc, char * argv[]) {
                         exit(1);
                     }
                 }
+                // b stored with a larger leading dimension
+                const long ldb = nj + 3;
+                mTxmq_reference(ni,nj,nk,c,a,b,ldb);
+                mTxmq(ni,nj,nk,d,a,b,ldb);
+                for (i=0; i<ni*nj; ++i) {
+                    double err = std::abs(d[i]-c[i]);
+                    if (err > 1e-13) {
+                        printf("test_mtxmq: ldb error %ld %ld %ld %e\n",ni,nj,nk,err);
+                        exit(1);
+                    }
+                }
             }
         }
+      }
+      printf("... OK!\n");
     }
-    printf("... OK!\n");
+    set_mtxmq_kernel(selected);
 
     if (!smalltest) {
-        printf("%20s %3s %3s %3s %8s %8s (GF/s)\n", "type", "M", "N", "K", "LOOP", "BLAS");
+        header();
         for (ni=2; ni<60; ni+=2) timer("(m*m)T*(m*m)", ni,ni,ni,a,b,c);
         for (m=2; m<=30; m+=2) timer("(m*m,m)T*(m*m)", m*m,m,m,a,b,c);
         for (m=2; m<=30; m+=2) trantimer("tran(m,m,m)", m*m,m,m,a,b,c);
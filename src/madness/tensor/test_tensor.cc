@@ -34,6 +34,7 @@
 
 #include <madness/tensor/tensor.h>
 #include <madness/world/print.h>
+#include <madness/world/buffer_archive.h>
 
 #ifdef MADNESS_HAS_GOOGLE_TEST
 
@@ -415,6 +416,59 @@ namespace {
         ITERATOR3(b,ASSERT_EQ(b(_i,_j,_k), a(_j,_i,_k)));
     }
 
+    TYPED_TEST(TensorTest, Pool) {
+        const bool was_enabled = madness::TensorPool::enabled();
+        madness::TensorPool::set_enabled(true);
+        madness::TensorPool::clear();
+        madness::TensorPoolStats before = madness::TensorPool::get_stats();
+
+        TypeParam* p;
+        {
+            madness::Tensor<TypeParam> a(4,5,6);
+            p = a.ptr();
+            ASSERT_EQ(long(p) & (TENSOR_ALIGNMENT-1), 0);
+        }
+        madness::Tensor<TypeParam> b(4,5,6); // Same size so must reuse the buffer
+        EXPECT_EQ(b.ptr(), p);
+        ITERATOR3(b, ASSERT_EQ(b(_i,_j,_k), TypeParam(0)));
+
+        madness::TensorPoolStats after = madness::TensorPool::get_stats();
+        EXPECT_EQ(after.nalloc - before.nalloc, 2u);
+        EXPECT_EQ(after.nhit - before.nhit, 1u);
+        EXPECT_EQ(after.nrelease - before.nrelease, 1u);
+        EXPECT_GE(after.npeak_bytes, 4*5*6*sizeof(TypeParam));
+
+        madness::TensorPool::set_enabled(was_enabled);
+    }
+
+    TYPED_TEST(TensorTest, BufferAlias) {
+        madness::Tensor<TypeParam> a(4,5,6);
+        a.fillindex();
+
+        madness::archive::BufferOutputArchive count;
+        count & a;
+        std::shared_ptr<void> owner(std::malloc(count.size()), &std::free);
+        madness::archive::BufferOutputArchive out(owner.get(), count.size());
+        out & a;
+
+        // Without an owner the data are copied out of the buffer
+        madness::Tensor<TypeParam> b;
+        madness::archive::BufferInputArchive(owner.get(), count.size()) & b;
+        const char* lo = static_cast<const char*>(owner.get());
+        const char* hi = lo + count.size();
+        EXPECT_TRUE((const char*)b.ptr() < lo || (const char*)b.ptr() >= hi);
+        ITERATOR3(b, ASSERT_EQ(b(_i,_j,_k), a(_i,_j,_k)));
+
+        // With an owner the tensor aliases the buffer and keeps it alive
+        madness::Tensor<TypeParam> c;
+        madness::archive::BufferInputArchive(owner.get(), count.size(), owner) & c;
+        EXPECT_TRUE((const char*)c.ptr() >= lo && (const char*)c.ptr() < hi);
+        EXPECT_EQ(owner.use_count(), 2);
+        ITERATOR3(c, ASSERT_EQ(c(_i,_j,_k), a(_i,_j,_k)));
+        c = madness::Tensor<TypeParam>();
+        EXPECT_EQ(owner.use_count(), 1);
+    }
+
 //     TYPED_TEST(TensorTest, Container) {
 //         typedef madness::ConcurrentHashMap< int, Tensor<TypeParam> > containerT;
 //         static const int N = 100;
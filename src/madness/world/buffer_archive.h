@@ -41,7 +41,9 @@
 #include <type_traits>
 #include <madness/world/archive.h>
 #include <madness/world/print.h>
+#include <cstdint>
 #include <cstring>
+#include <memory>
 
 namespace madness {
     namespace archive {
@@ -130,12 +132,18 @@ MADNESS_PRAGMA_GCC(diagnostic pop)
 
         /// \note Type checking is disabled for efficiency.
         ///
+        /// If the buffer is given an owner, objects that hold large arrays
+        /// (e.g., tensors) may use \c borrow to alias their data in the
+        /// buffer instead of copying it; they then share ownership of the
+        /// whole buffer.
+        ///
         /// \throw madness::MadnessException in case of buffer overrun.
         class BufferInputArchive : public BaseInputArchive {
         private:
             const unsigned char* const ptr; ///< The memory buffer.
             const std::size_t nbyte; ///< Buffer size.
             mutable std::size_t i; ///< Current input location.
+            std::shared_ptr<void> owner_; ///< Keeps the buffer alive for objects aliasing it (may be null).
 
         public:
             /// Constructor that assigns a buffer.
@@ -145,6 +153,39 @@ MADNESS_PRAGMA_GCC(diagnostic pop)
             BufferInputArchive(const void* ptr, std::size_t nbyte)
                     : ptr((const unsigned char *) ptr), nbyte(nbyte), i(0) {};
 
+            /// Constructor that assigns a buffer that loaded objects may alias.
+
+            /// \param[in] ptr Pointer to the buffer.
+            /// \param[in] nbyte Size of the buffer.
+            /// \param[in] owner Owner of the (writable) buffer; if null this is the same as the two-argument constructor.
+            BufferInputArchive(const void* ptr, std::size_t nbyte, std::shared_ptr<void> owner)
+                    : ptr((const unsigned char *) ptr), nbyte(nbyte), i(0), owner_(std::move(owner)) {};
+
+            /// Owner of the buffer, or null if loaded objects must copy.
+            const std::shared_ptr<void>& owner() const {
+                return owner_;
+            }
+
+            /// Skips over \c n objects of type \c T and returns their address in the buffer.
+
+            /// Returns null, and consumes nothing, if the buffer has no owner
+            /// or the data are not suitably aligned for \c T.  Whoever keeps
+            /// the returned pointer must also keep a copy of \c owner().
+            /// \tparam T Type of the data.
+            /// \param[in] n Number of objects.
+            /// \return Pointer to the data in the buffer, or null.
+            template <class T>
+            T* borrow(long n) const {
+                static_assert(madness::is_trivially_serializable<T>::value, "can only borrow trivially serializable data");
+                if (!owner_) return nullptr;
+                const unsigned char* p = ptr + i;
+                if (reinterpret_cast<std::uintptr_t>(p) % alignof(T)) return nullptr;
+                std::size_t m = n*sizeof(T);
+                MADNESS_ASSERT(m+i <= nbyte);
+                i += m;
+                return reinterpret_cast<T*>(const_cast<unsigned char*>(p));
+            }
+
             /// Reads data from the memory buffer.
 
             /// The function only appears (due to \c enable_if) if \c T is
@@ -44,6 +44,7 @@
 #include <madness/world/nodefaults.h>
 #include <madness/world/dependency_interface.h>
 #include <madness/world/stack.h>
+#include <madness/world/slab_allocator.h>
 #include <madness/world/worldref.h>
 #include <madness/world/world.h>
 
@@ -499,13 +500,22 @@ namespace madness {
         /// \param[in] blah Description needed.
         explicit Future(const dddd& blah) : f(), value(nullptr) { }
 
+        /// Makes an unassigned implementation object.
+
+        /// The object and its reference count share one block drawn from
+        /// the slab allocator.
+        /// \return Shared pointer to the new object.
+        static std::shared_ptr< FutureImpl<T> > make_impl() {
+            return std::allocate_shared< FutureImpl<T> >(SlabAllocator< FutureImpl<T> >());
+        }
+
     public:
         /// \todo Brief description needed.
         typedef RemoteReference< FutureImpl<T> > remote_refT;
 
         /// Makes an unassigned future.
         Future() :
-            f(new FutureImpl<T>()), value(nullptr)
+            f(make_impl()), value(nullptr)
         { }
 
         /// Makes an assigned future.
@@ -523,8 +533,7 @@ namespace madness {
         explicit Future(const remote_refT& remote_ref) :
                 f(remote_ref.is_local() ?
                         remote_ref.get_shared() :
-                        std::make_shared<FutureImpl<T> >(remote_ref)),
-                //                        std::shared_ptr<FutureImpl<T> >(new FutureImpl<T>(remote_ref))),
+                        std::allocate_shared<FutureImpl<T> >(SlabAllocator<FutureImpl<T> >(), remote_ref)),
                 value(nullptr)
         { }
 
@@ -549,7 +558,7 @@ namespace madness {
                 nullptr)
         {
             if(other.is_default_initialized())
-                f.reset(new FutureImpl<T>()); // Other was default constructed so make a new f
+                f = make_impl(); // Other was default constructed so make a new f
         }
 
         /// Destructor.
@@ -38,35 +38,94 @@
 */
 
 #include <madness/world/hardware.h>
+#include <madness/world/thread.h>
+#include <madness/world/slab_allocator.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#  include <sched.h>
+#endif
 
 namespace madness {
 
+    bool    Hardware::initialized = false;
+    int     Hardware::hwthreads = 1;
+    double  Hardware::cpufrequency = 1.0e9;
+    int64_t Hardware::memorysize = 1;
+    int     Hardware::ndomain = 1;
+    int     Hardware::ncpu_domain = 0;
+    int*    Hardware::cpu_domain = nullptr;
+    char**  Hardware::domain_cpulist = nullptr;
+#if defined(__bgp__)
+    DCMF_Hardware_t Hardware::bghw;
+#elif defined(__bgq__)
+    MPIX_Hardware_t Hardware::bghw;
+#endif
+
     void Hardware::Initialize(void) {
+        if (initialized) return;
+
 #if defined(__bgp__) || defined(__bgq__)
         int init = 0;
-        MPI_Is_initialized(&init);
+        MPI_Initialized(&init);
         if (init<1)
-            MADNESS_EXCEPTION("MPI is not initialized!");
+            MADNESS_EXCEPTION("MPI is not initialized!", init);
 #  if defined(__bgp__)
         /* We need MPI to initialize DCMF so DCMF_Hardware will work.
          * Alternatively, we must initialize DCMF ourselves, which is fine since the init call is not a singleton like MPI. */
-        DCMF_Hardware(&bgphw);
+        DCMF_Hardware(&bghw);
 #  elif defined(__bgq__)
         /* MPIX requires MPI, obviously. */
-        MPIX_Hardware(&bgqhw);
+        MPIX_Hardware(&bghw);
 #  endif
 #endif
         Hardware::InitializeHWThreads();
         Hardware::InitializeCPUFrequency();
         Hardware::InitializeMemorySize();
+        Hardware::InitializeNUMA();
+        initialized = true;
 
         return;
     }
 
     void Hardware::Print(std::ostream & out) {
+        Initialize();
         out.flush();
         out << "\n    MADNESS Hardware Information \n";
         out << "    --------------------------------\n";
+        out << "        hardware threads    " << hwthreads << "\n";
+        out << "             memory (GB)    " << std::fixed << std::setprecision(1)
+            << memorysize/1073741824.0 << "\n";
+        out.unsetf(std::ios::floatfield);
+        out << "            NUMA domains    " << ndomain << "\n";
+        for (int d=0; d<ndomain; ++d) {
+            out << "         domain " << std::setw(3) << d << " cpus    "
+                << (domain_cpulist ? domain_cpulist[d] : "all") << "\n";
+        }
+
+        // Where the thread pool and the slab allocator ended up
+        const std::vector<int> placement = ThreadPool::get_numa_domains();
+        if (!placement.empty()) {
+            std::vector<int> count(ndomain, 0);
+            for (int d : placement) count[d < ndomain ? d : 0]++;
+            out << "\n    Placement (pool threads + main per domain)\n";
+            for (int d=0; d<ndomain; ++d)
+                out << "         domain " << std::setw(3) << d << "        " << count[d] << "\n";
+            if (ThreadPool::is_work_stealing()) {
+                const WSDQStats ws = ThreadPool::get_work_stealing_stats();
+                out << "   steals local / remote    " << ws.nsteal - ws.nsteal_remote
+                    << " / " << ws.nsteal_remote << "\n";
+            }
+        }
+        const SlabStats ss = slab_get_stats();
+        out << "  slab local / remote / new    " << ss.nlocal << " / "
+            << ss.nremote << " / " << ss.nslab << "\n";
+        out.flush();
     }
 
     /* Taken from ThreadBase.
@@ -83,17 +142,17 @@ namespace madness {
         /* Apple has deprecated HW_NCPU */
         int rc = sysctlbyname("hw.logicalcpu", &n, &len, nullptr, 0);
         if (rc!=0) 
-            MADNESS_EXCEPTION("sysctlbyname failed");
+            MADNESS_EXCEPTION("sysctlbyname failed", rc);
 #  else
         int mib[2] = {CTL_HW, HW_NCPU};
         int rc = sysctl(mib, 2, &n, &len, nullptr, 0);
         if (rc!=0) 
-            MADNESS_EXCEPTION("sysctl failed");
+            MADNESS_EXCEPTION("sysctl failed", rc);
 #  endif
 #elif defined(HARDWARE_USE_SYSCONF)
         n = (int)sysconf(_SC_NPROCESSORS_CONF);
         if (n<1) 
-            MADNESS_EXCEPTION("sysconf failed");
+            MADNESS_EXCEPTION("sysconf failed", n);
 #endif
         hwthreads = n;
         return;
@@ -118,12 +177,12 @@ namespace madness {
         f = (double) c.hz;
 #  endif
         if (rc!=0) 
-            MADNESS_EXCEPTION("sysctl failed");
+            MADNESS_EXCEPTION("sysctl failed", rc);
 #elif defined(HARDWARE_USE_SYSCONF)
         long cps = sysconf(_SC_CLK_TCK);
         f = (double)cps;
         if (cps<1) 
-            MADNESS_EXCEPTION("sysconf failed");
+            MADNESS_EXCEPTION("sysconf failed", cps);
 #endif
         cpufrequency = f;
     }
@@ -139,24 +198,83 @@ namespace madness {
         int mib[2] = {CTL_HW, HW_MEMSIZE};
         int rc = sysctl(mib, 2, &m, &len, nullptr, 0);
         if (rc!=0) 
-            MADNESS_EXCEPTION("sysctl failed");
+            MADNESS_EXCEPTION("sysctl failed", rc);
 #elif defined(HARDWARE_USE_SYSCONF)
         long np = sysconf(_SC_PHYS_PAGES);
         long ps = sysconf(_SC_PAGESIZE);
         m = np*ps;
         if (np<1 || ps<1) 
-            MADNESS_EXCEPTION("sysconf failed");
+            MADNESS_EXCEPTION("sysconf failed", np);
 #endif
         memorysize = m;
         return;
     }
 
+    /* Domains are the nodeN directories of sysfs; their cpulist files
+     * look like "0-15,32-47".  Without sysfs the node is one domain. */
+    void Hardware::InitializeNUMA(void) {
+        std::vector<int> map;
+        std::vector<std::string> lists;
+#if defined(__linux__)
+        for (int node=0; node<1024; ++node) {
+            char path[64];
+            snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+            FILE* f = fopen(path, "r");
+            if (!f) {
+                if (node >= 64) break;  // node ids may have holes, but not many
+                continue;
+            }
+            char buf[4096];
+            const bool ok = fgets(buf, sizeof(buf), f) != nullptr;
+            fclose(f);
+            if (!ok) continue;
+            buf[strcspn(buf, "\n")] = 0;
+            if (!buf[0]) continue;      // memory-only node
 
+            const int d = int(lists.size());
+            lists.push_back(buf);
+            for (char* p=buf; *p; ) {
+                char* end;
+                const long lo = strtol(p, &end, 10);
+                if (end == p) break;
+                long hi = lo;
+                p = end;
+                if (*p == '-') {
+                    hi = strtol(p+1, &end, 10);
+                    p = end;
+                }
+                if (*p == ',') ++p;
+                if (lo < 0 || hi < lo || hi >= 65536) continue;
+                if (map.size() <= std::size_t(hi)) map.resize(hi+1, 0);
+                for (long cpu=lo; cpu<=hi; ++cpu) map[cpu] = d;
+            }
+        }
+#endif
+        if (lists.size() < 2) {
+            ndomain = 1;
+            ncpu_domain = 0;
+            cpu_domain = nullptr;
+            domain_cpulist = nullptr;
+            return;
+        }
 
-} // namespace madness
-
-
-
-
+        // Written once, before any pool thread exists, and never freed
+        // since the slab allocator may ask during static destruction
+        cpu_domain = new int[map.size()];
+        std::copy(map.begin(), map.end(), cpu_domain);
+        domain_cpulist = new char*[lists.size()];
+        for (std::size_t d=0; d<lists.size(); ++d) domain_cpulist[d] = strdup(lists[d].c_str());
+        ncpu_domain = int(map.size());
+        ndomain = int(lists.size());
+    }
 
+    int Hardware::CurrentNUMADomain(void) {
+        if (ndomain < 2) return 0;
+#if defined(__linux__)
+        return NUMADomainOfCPU(sched_getcpu());
+#else
+        return 0;
+#endif
+    }
 
+} // namespace madness
@@ -36,8 +36,11 @@
   email: jhammond@alcf.anl.gov
 */
 
-#ifndef MADNESS_WOLRD_HARDWARE_H__INCLUDED
-#ifndef MADNESS_WOLRD_HARDWARE_H__INCLUDED
+#ifndef MADNESS_WORLD_HARDWARE_H__INCLUDED
+#define MADNESS_WORLD_HARDWARE_H__INCLUDED
+
+/// \file hardware.h
+/// \brief Describes the node: hardware threads, memory and NUMA topology
 
 #include <iostream>
 #include <stdint.h>
@@ -74,25 +77,70 @@
 
 namespace madness {
 
-  private:
-
-    int     hwthreads;
-    double  cpufrequency;
-    int64_t memorysize;
+    /// Static description of the node the process is running on
+
+    /// \c Initialize is called by the thread pool before it starts its
+    /// threads and may be called again (it is idempotent).  Until then
+    /// the node looks like a single NUMA domain.
+    ///
+    /// NUMA domains are read from \c /sys/devices/system/node on Linux;
+    /// elsewhere the node is treated as a single domain.
+    class Hardware {
+    private:
+        static bool    initialized;
+        static int     hwthreads;
+        static double  cpufrequency;
+        static int64_t memorysize;
+
+        static int     ndomain;         ///< Number of NUMA domains (at least 1)
+        static int     ncpu_domain;     ///< Length of \c cpu_domain
+        static int*    cpu_domain;      ///< Domain of each cpu (never freed)
+        static char**  domain_cpulist;  ///< cpulist of each domain, for printing (never freed)
 
 #if defined(__bgp__)
-    DCMF_Hardware_t bghw;
+        static DCMF_Hardware_t bghw;
 #elif defined(__bgq__)
-    MPIX_Hardware_t bghw;
+        static MPIX_Hardware_t bghw;
 #endif
 
-  public:
+        static void InitializeHWThreads(void);
+        static void InitializeCPUFrequency(void);
+        static void InitializeMemorySize(void);
+        static void InitializeNUMA(void);
+
+    public:
+
+        /// Probes the hardware
+        static void Initialize(void);
+
+        /// Prints the topology and the placement statistics of the
+        /// thread pool and the slab allocator
+        static void Print(std::ostream & out);
+
+        /// Number of hardware threads (logical cpus) configured
+        static int NumHWThreads(void) { return hwthreads; }
+
+        /// Clock rate reported by the system
+        static double CPUFrequency(void) { return cpufrequency; }
+
+        /// Physical memory in bytes
+        static int64_t MemorySize(void) { return memorysize; }
+
+        /// Number of NUMA domains
+        static int NumNUMADomains(void) { return ndomain; }
+
+        /// NUMA domain of a logical cpu (0 if unknown)
+        static int NUMADomainOfCPU(int cpu) {
+            return (cpu >= 0 && cpu < ncpu_domain) ? cpu_domain[cpu] : 0;
+        }
 
-    void Hardware::Initialize(void);
-    void Hardware::Print(std::ostream & out);
+        /// NUMA domain of the cpu the calling thread is running on
 
-}
+        /// Threads that are not bound may migrate, so for them this is
+        /// only a hint.
+        static int CurrentNUMADomain(void);
+    };
 
 } // namespace madness
 
-#endif // MADNESS_WOLRD_HARDWARE_H__INCLUDED
+#endif // MADNESS_WORLD_HARDWARE_H__INCLUDED
@@ -0,0 +1,364 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+/**
+ \file shared_file_archive.cc
+ \brief Implements the single-file parallel archives.
+ \ingroup serialization
+*/
+
+#include <madness/world/shared_file_archive.h>
+#include <madness/world/worldam.h>
+#include <madness/world/worldmutex.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <map>
+#include <numeric>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace madness {
+    namespace archive {
+
+        namespace {
+
+            /// Largest number of bytes moved by one read or write call
+            const uint64_t max_chunk = uint64_t(1) << 30;
+
+            /// Version of the file format
+            const uint64_t file_version = 1;
+
+            typedef SharedFileInputArchive::extentT extentT;
+            typedef std::pair<unsigned long, uint64_t> recordidT; // world id and record offset
+
+            Mutex incoming_mutex;
+            std::map< recordidT, std::vector<extentT> > incoming; // extents sent to this process
+
+            /// Collects extents sent by other readers of a container record
+            void extents_handler(const AmArg& arg) {
+                uint64_t record;
+                std::vector<extentT> extents;
+                arg & record & extents;
+                ScopedMutex<Mutex> obolus(incoming_mutex);
+                std::vector<extentT>& v = incoming[recordidT(arg.get_world()->id(), record)];
+                v.insert(v.end(), extents.begin(), extents.end());
+            }
+
+        } // namespace
+
+        const uint64_t BaseSharedFileArchive::file_magic = 0x4146534d4441414dull; // "MAADMSFA"
+        const uint64_t BaseSharedFileArchive::container_magic = 0x544e4f434146534dull; // "MSFACONT"
+
+
+        SharedFile::SharedFile()
+            : world(nullptr)
+#ifdef STUBOUTMPI
+            , fd(-1)
+#endif
+        {}
+
+#ifdef STUBOUTMPI
+
+        void SharedFile::open(World& world, const char* filename, bool write) {
+            MADNESS_ASSERT(!is_open());
+            fd = ::open(filename, write ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY, 0644);
+            if (fd < 0) MADNESS_EXCEPTION("SharedFile: failed to open file", errno);
+            this->world = &world;
+        }
+
+        void SharedFile::close() {
+            MADNESS_ASSERT(is_open());
+            ::close(fd);
+            fd = -1;
+            world = nullptr;
+        }
+
+        void SharedFile::write_at(uint64_t offset, const void* buf, uint64_t nbyte) {
+            const char* p = static_cast<const char*>(buf);
+            while (nbyte) {
+                ssize_t n = ::pwrite(fd, p, std::min(nbyte, max_chunk), offset);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    MADNESS_EXCEPTION("SharedFile: write failed", errno);
+                }
+                p += n; offset += n; nbyte -= n;
+            }
+        }
+
+        void SharedFile::write_at_all(uint64_t offset, const void* buf, uint64_t nbyte) {
+            write_at(offset, buf, nbyte);
+        }
+
+        void SharedFile::read_at(uint64_t offset, void* buf, uint64_t nbyte) {
+            char* p = static_cast<char*>(buf);
+            while (nbyte) {
+                ssize_t n = ::pread(fd, p, std::min(nbyte, max_chunk), offset);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    MADNESS_EXCEPTION("SharedFile: read failed", errno);
+                }
+                if (n == 0) MADNESS_EXCEPTION("SharedFile: reading past end of file", offset);
+                p += n; offset += n; nbyte -= n;
+            }
+        }
+
+#else
+
+        void SharedFile::open(World& world, const char* filename, bool write) {
+            MADNESS_ASSERT(!is_open());
+            const int amode = write ? (MPI_MODE_WRONLY | MPI_MODE_CREATE) : MPI_MODE_RDONLY;
+            int rc;
+            {
+                SAFE_MPI_GLOBAL_MUTEX;
+                rc = MPI_File_open(world.mpi.comm().Get_mpi_comm(), const_cast<char*>(filename),
+                                   amode, MPI_INFO_NULL, &fh);
+            }
+            if (rc != MPI_SUCCESS) MADNESS_EXCEPTION("SharedFile: failed to open file", rc);
+            if (write) {
+                SAFE_MPI_GLOBAL_MUTEX;
+                MADNESS_MPI_TEST(MPI_File_set_size(fh, 0));
+            }
+            this->world = &world;
+        }
+
+        void SharedFile::close() {
+            MADNESS_ASSERT(is_open());
+            {
+                SAFE_MPI_GLOBAL_MUTEX;
+                MADNESS_MPI_TEST(MPI_File_close(&fh));
+            }
+            world = nullptr;
+        }
+
+        void SharedFile::write_at(uint64_t offset, const void* buf, uint64_t nbyte) {
+            const char* p = static_cast<const char*>(buf);
+            while (nbyte) {
+                const int n = std::min(nbyte, max_chunk);
+                MPI_Status status;
+                {
+                    SAFE_MPI_GLOBAL_MUTEX;
+                    MADNESS_MPI_TEST(MPI_File_write_at(fh, offset, const_cast<char*>(p), n, MPI_BYTE, &status));
+                }
+                p += n; offset += n; nbyte -= n;
+            }
+        }
+
+        void SharedFile::write_at_all(uint64_t offset, const void* buf, uint64_t nbyte) {
+            // Each call moves at most max_chunk bytes so all processes
+            // must agree on the number of calls
+            uint64_t nround = (nbyte + max_chunk - 1)/max_chunk;
+            world->gop.max(nround);
+            const char* p = static_cast<const char*>(buf);
+            for (uint64_t round=0; round<nround; ++round) {
+                const int n = std::min(nbyte, max_chunk);
+                MPI_Status status;
+                {
+                    SAFE_MPI_GLOBAL_MUTEX;
+                    MADNESS_MPI_TEST(MPI_File_write_at_all(fh, offset, const_cast<char*>(p), n, MPI_BYTE, &status));
+                }
+                p += n; offset += n; nbyte -= n;
+            }
+        }
+
+        void SharedFile::read_at(uint64_t offset, void* buf, uint64_t nbyte) {
+            char* p = static_cast<char*>(buf);
+            while (nbyte) {
+                const int n = std::min(nbyte, max_chunk);
+                MPI_Status status;
+                int count;
+                {
+                    SAFE_MPI_GLOBAL_MUTEX;
+                    MADNESS_MPI_TEST(MPI_File_read_at(fh, offset, p, n, MPI_BYTE, &status));
+                    MADNESS_MPI_TEST(MPI_Get_count(&status, MPI_BYTE, &count));
+                }
+                if (count != n) MADNESS_EXCEPTION("SharedFile: reading past end of file", offset);
+                p += n; offset += n; nbyte -= n;
+            }
+        }
+
+#endif // STUBOUTMPI
+
+
+        bool BaseSharedFileArchive::exists(World& world, const char* filename) {
+            bool status = false;
+            if (world.rank() == 0)
+                status = (access(filename, F_OK|R_OK) == 0);
+            world.gop.broadcast(status);
+            return status;
+        }
+
+        void BaseSharedFileArchive::remove(World& world, const char* filename) {
+            if (world.rank() == 0) ::remove(filename);
+        }
+
+
+        void SharedFileOutputArchive::open(World& world, const char* filename) {
+            MADNESS_ASSERT(filename);
+            this->world = &world;
+            fname = filename;
+            serial.clear();
+            file.open(world, filename, true);
+            if (world.rank() == 0) {
+                const uint64_t header[2] = {file_magic, file_version};
+                file.write_at(0, header, sizeof(header));
+            }
+            cursor = header_size;
+        }
+
+        void SharedFileOutputArchive::flush_serial() const {
+            if (serial.size()) {
+                file.write_at(cursor, serial.data(), serial.size());
+                cursor += serial.size();
+                serial.clear();
+            }
+        }
+
+        void SharedFileOutputArchive::close() {
+            MADNESS_ASSERT(world);
+            if (world->rank() == 0) flush_serial();
+            file.close();
+        }
+
+        void SharedFileOutputArchive::store_container(const std::vector<unsigned char>& data,
+                                                      const std::vector<unsigned char>& index) const {
+            const ProcessID me = world->rank();
+            const int nproc = world->size();
+
+            // Sizes of every chunk, followed by the pending serial data of
+            // process zero that precedes the record
+            std::vector<uint64_t> sizes(2*nproc+1, 0);
+            sizes[me] = data.size();
+            sizes[nproc+me] = index.size();
+            if (me == 0) sizes[2*nproc] = serial.size();
+            world->gop.sum(sizes.data(), sizes.size());
+
+            if (me == 0) flush_serial();
+            else cursor += sizes[2*nproc];
+
+            // Record header: magic, number of writers, then all data sizes and all index sizes
+            std::vector<uint64_t> table(2+2*nproc);
+            table[0] = container_magic;
+            table[1] = nproc;
+            std::copy(sizes.begin(), sizes.begin()+2*nproc, table.begin()+2);
+
+            uint64_t data_offset = cursor + table.size()*sizeof(uint64_t);
+            for (ProcessID p=0; p<me; ++p) data_offset += sizes[p];
+            uint64_t index_offset = cursor + table.size()*sizeof(uint64_t);
+            for (ProcessID p=0; p<nproc; ++p) index_offset += sizes[p];
+            const uint64_t end = index_offset + std::accumulate(sizes.begin()+nproc, sizes.begin()+2*nproc, uint64_t(0));
+            for (ProcessID p=0; p<me; ++p) index_offset += sizes[nproc+p];
+
+            if (me == 0) file.write_at(cursor, table.data(), table.size()*sizeof(uint64_t));
+            file.write_at_all(data_offset, data.data(), data.size());
+            file.write_at_all(index_offset, index.data(), index.size());
+            cursor = end;
+        }
+
+
+        void SharedFileInputArchive::open(World& world, const char* filename) {
+            MADNESS_ASSERT(filename);
+            this->world = &world;
+            fname = filename;
+            file.open(world, filename, false);
+            bool ok = false;
+            if (world.rank() == 0) {
+                uint64_t header[2];
+                file.read_at(0, header, sizeof(header));
+                ok = (header[0] == file_magic && header[1] == file_version);
+            }
+            world.gop.broadcast(ok);
+            if (!ok) MADNESS_EXCEPTION("SharedFileInputArchive: not a shared-file archive or unknown version", 0);
+            cursor = header_size;
+        }
+
+        void SharedFileInputArchive::close() {
+            MADNESS_ASSERT(world);
+            file.close();
+        }
+
+        SharedFileInputArchive::ContainerRecord SharedFileInputArchive::load_container_record() const {
+            ContainerRecord record;
+            if (world->rank() == 0) {
+                uint64_t head[2];
+                file.read_at(cursor, head, sizeof(head));
+                MADNESS_CHECK(head[0] == container_magic);
+                const uint64_t nwriter = head[1];
+                std::vector<uint64_t> sizes(2*nwriter);
+                file.read_at(cursor+sizeof(head), sizes.data(), sizes.size()*sizeof(uint64_t));
+
+                record.offset = cursor;
+                record.data_offset.resize(nwriter);
+                record.index_offset.resize(nwriter);
+                record.index_size.assign(sizes.begin()+nwriter, sizes.end());
+                uint64_t offset = cursor + sizeof(head) + sizes.size()*sizeof(uint64_t);
+                for (uint64_t w=0; w<nwriter; ++w) {
+                    record.data_offset[w] = offset;
+                    offset += sizes[w];
+                }
+                for (uint64_t w=0; w<nwriter; ++w) {
+                    record.index_offset[w] = offset;
+                    offset += sizes[nwriter+w];
+                }
+                cursor = offset;
+            }
+            world->gop.broadcast_serializable(record, 0);
+            world->gop.broadcast(cursor, 0);
+            return record;
+        }
+
+        std::vector<extentT> SharedFileInputArchive::exchange_extents(const ContainerRecord& record,
+                                                                     const std::vector< std::vector<extentT> >& by_owner) const {
+            const ProcessID me = world->rank();
+            for (ProcessID p=0; p<world->size(); ++p) {
+                if (p != me && by_owner[p].size()) {
+                    world->am.send(p, extents_handler, new_am_arg(record.offset, by_owner[p]));
+                }
+            }
+            world->gop.fence();
+
+            std::vector<extentT> mine(by_owner[me]);
+            {
+                ScopedMutex<Mutex> obolus(incoming_mutex);
+                auto it = incoming.find(recordidT(world->id(), record.offset));
+                if (it != incoming.end()) {
+                    mine.insert(mine.end(), it->second.begin(), it->second.end());
+                    incoming.erase(it);
+                }
+            }
+            std::sort(mine.begin(), mine.end());
+            return mine;
+        }
+
+    } // namespace archive
+} // namespace madness
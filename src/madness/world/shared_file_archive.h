@@ -0,0 +1,467 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+#ifndef MADNESS_WORLD_SHARED_FILE_ARCHIVE_H__INCLUDED
+#define MADNESS_WORLD_SHARED_FILE_ARCHIVE_H__INCLUDED
+
+/**
+ \file shared_file_archive.h
+ \brief Implements \c SharedFileInputArchive and \c SharedFileOutputArchive, which keep
+ parallel data in a single file written collectively with MPI-IO.
+ \ingroup serialization
+*/
+
+#include <type_traits>
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include <madness/world/archive.h>
+#include <madness/world/vector_archive.h>
+#include <madness/world/parallel_archive.h>
+#include <madness/world/world.h>
+#include <madness/world/worldgop.h>
+
+namespace madness {
+    namespace archive {
+
+        /// \addtogroup serialization
+        /// @{
+
+        /// A file opened by every process of a world and accessed at explicit offsets.
+
+        /// Uses MPI-IO on the communicator of the world. When MPI is stubbed
+        /// out there is only one process and POSIX \c pread / \c pwrite are used
+        /// instead.
+        class SharedFile {
+            World* world; ///< The world sharing the file.
+#ifdef STUBOUTMPI
+            int fd; ///< The POSIX file descriptor.
+#else
+            MPI_File fh; ///< The MPI-IO file handle.
+#endif
+
+        public:
+            SharedFile();
+
+            /// Opens the file for reading or, truncating it, for writing.
+
+            /// This is a collective operation.
+            /// \param[in] world The world.
+            /// \param[in] filename Name of the file.
+            /// \param[in] write True to create the file for writing.
+            void open(World& world, const char* filename, bool write);
+
+            /// Closes the file. This is a collective operation.
+            void close();
+
+            /// Returns true if the file is open.
+            bool is_open() const { return world != nullptr; }
+
+            /// Writes \c nbyte bytes at \c offset from this process alone.
+            void write_at(uint64_t offset, const void* buf, uint64_t nbyte);
+
+            /// Writes \c nbyte bytes at \c offset as part of a collective write.
+
+            /// Every process must call this, possibly with nothing to write.
+            void write_at_all(uint64_t offset, const void* buf, uint64_t nbyte);
+
+            /// Reads \c nbyte bytes at \c offset from this process alone.
+            void read_at(uint64_t offset, void* buf, uint64_t nbyte);
+        };
+
+
+        /// Reads process-local data sequentially from a \c SharedFile.
+
+        /// Used by process zero to load the serial items of a \c SharedFileInputArchive.
+        class SharedFileSerialInputArchive : public BaseInputArchive {
+            SharedFile* file; ///< The file.
+            uint64_t* cursor; ///< The current read location, advanced by every load.
+
+        public:
+            SharedFileSerialInputArchive(SharedFile* file, uint64_t* cursor)
+                : file(file), cursor(cursor) {}
+
+            /// Load data from the file.
+
+            /// \tparam T The type of data to be loaded.
+            /// \param[out] t Where to store the loaded data.
+            /// \param[in] n The number of data items to be loaded.
+            template <class T>
+            inline
+            typename std::enable_if< madness::is_trivially_serializable<T>::value, void >::type
+            load(T* t, long n) const {
+                const uint64_t nbyte = n*sizeof(T);
+                file->read_at(*cursor, t, nbyte);
+                *cursor += nbyte;
+            }
+
+            void open() {}
+            void close() {}
+        };
+
+
+        /// Base class for input and output shared-file archives.
+
+        /// The file begins with a short header, followed by records in the
+        /// order the objects were stored. Process-local objects are stored
+        /// by process zero as an ordinary serial stream. Each parallel
+        /// container is a record holding, for every process that wrote it,
+        /// a chunk of serialized (key,value) pairs and an index of
+        /// (key, offset, size) for the pairs in that chunk. The index lets
+        /// any number of processes, with any process map, find and read
+        /// only the entries they own.
+        class BaseSharedFileArchive {
+        protected:
+            World* world; ///< The world.
+            mutable SharedFile file; ///< The shared file.
+            mutable uint64_t cursor; ///< Offset of the next record. Only meaningful on process zero between container records.
+            bool do_fence; ///< If true (default), a read/write of parallel objects fences before and after I/O.
+            std::string fname; ///< Name of the archive.
+
+            static const uint64_t file_magic; ///< Identifies the file format.
+            static const uint64_t container_magic; ///< Identifies a container record.
+            static const uint64_t header_size = 16; ///< Magic and version.
+
+        public:
+            static const bool is_parallel_archive = true; ///< Mark this class as a parallel archive.
+
+            /// Default constructor.
+            BaseSharedFileArchive()
+                : world(nullptr), cursor(0), do_fence(true) {}
+
+            /// Returns a pointer to the world.
+
+            /// \return A pointer to the world.
+            World* get_world() const {
+                MADNESS_ASSERT(world);
+                return world;
+            }
+
+            /// Same as `world.gop.broadcast_serializable(obj, root)`.
+
+            /// \tparam objT Type of object to broadcast.
+            /// \param[in] obj The object to broadcast.
+            /// \param[in] root The root process for broadcasting.
+            template <typename objT>
+            void broadcast(objT& obj, ProcessID root) const {
+                get_world()->gop.broadcast_serializable(obj, root);
+            }
+
+            /// Returns true if the named, unopened archive exists on disk with read access.
+
+            /// This is a collective operation.
+            /// \param[in] world The world.
+            /// \param[in] filename Name of the file.
+            /// \return True if the named, unopened archive exists and is readable.
+            static bool exists(World& world, const char* filename);
+
+            /// Deletes the file of the archive with the given name.
+
+            /// Presently assumes a shared file system since process zero does the
+            /// deleting.
+            /// \param[in] world The world.
+            /// \param[in] filename Name of the file.
+            static void remove(World& world, const char* filename);
+
+            /// Removes the file of the current archive.
+            void remove() {
+                MADNESS_ASSERT(world);
+                remove(*world, fname.c_str());
+            }
+
+            /// Check if we should fence around a read/write operation.
+
+            /// \return True if we should fence; false otherwise.
+            bool dofence() const {
+                return this->do_fence;
+            }
+
+            /// Set the flag for fencing around a read/write operation.
+
+            /// \param[in] dofence True if we should fence; false otherwise.
+            void set_dofence(bool dofence) {
+                do_fence = dofence;
+            }
+        };
+
+
+        /// An archive for storing local or parallel data in a single file shared by all processes.
+
+        /// \note Writes of process-local objects only store the data from process zero.
+        /// They are buffered by process zero until the next parallel object or
+        /// the archive is closed.
+        ///
+        /// \note Writes of parallel containers (presently \c WorldContainer
+        /// and hence \c Function) store all data with one collective write.
+        class SharedFileOutputArchive : public BaseSharedFileArchive, public BaseOutputArchive {
+            mutable std::vector<unsigned char> serial; ///< Process-local data from process zero not yet written.
+            mutable VectorOutputArchive serial_ar; ///< Archive appending to \c serial.
+
+            /// Writes the pending process-local data of process zero at the cursor.
+            void flush_serial() const;
+
+        public:
+            /// Default constructor.
+            SharedFileOutputArchive() : serial_ar(serial, 0) {}
+
+            /// Creates a shared-file archive for output.
+
+            /// \param[in] world The world.
+            /// \param[in] filename Name of the file.
+            SharedFileOutputArchive(World& world, const char* filename)
+                : serial_ar(serial, 0) {
+                open(world, filename);
+            }
+
+            /// Opens the archive, truncating any existing file. This is a collective operation.
+
+            /// \param[in] world The world.
+            /// \param[in] filename Name of the file.
+            void open(World& world, const char* filename);
+
+            /// Writes pending data and closes the archive. This is a collective operation.
+            void close();
+
+            /// Returns the archive receiving process-local data on process zero.
+            VectorOutputArchive& serial_archive() const {
+                MADNESS_ASSERT(world && world->rank() == 0);
+                return serial_ar;
+            }
+
+            /// Writes a parallel container record. This is a collective operation.
+
+            /// \param[in] data This process's serialized (key,value) pairs.
+            /// \param[in] index This process's index: the number of entries then,
+            ///     for each, the key and the offset and size of its pair in \c data.
+            void store_container(const std::vector<unsigned char>& data,
+                                 const std::vector<unsigned char>& index) const;
+        };
+
+
+        /// An archive for loading local or parallel data from a single file shared by all processes.
+
+        /// \note Reads of process-local objects load the values originally stored by process zero,
+        /// which are then broadcast to all processes.
+        ///
+        /// \note Reads of parallel containers work with any number of
+        /// processes and any process map, independently of how the archive
+        /// was written. The index chunks are shared among the readers, each
+        /// of which tells the owner of every entry where to find it; owners
+        /// then read their entries directly from the file.
+        class SharedFileInputArchive : public BaseSharedFileArchive, public BaseInputArchive {
+            mutable SharedFileSerialInputArchive serial_ar; ///< Reads process-local data on process zero.
+
+        public:
+            typedef std::pair<uint64_t,uint64_t> extentT; ///< Offset and size of an entry in the file.
+
+            /// Location of the chunks of one container record.
+            struct ContainerRecord {
+                uint64_t offset; ///< Offset of the record in the file.
+                std::vector<uint64_t> data_offset; ///< Offset of the data chunk of each writer.
+                std::vector<uint64_t> index_offset; ///< Offset of the index chunk of each writer.
+                std::vector<uint64_t> index_size; ///< Size of the index chunk of each writer.
+
+                template <typename Archive>
+                void serialize(Archive& ar) {
+                    ar & offset & data_offset & index_offset & index_size;
+                }
+            };
+
+            /// Default constructor.
+            SharedFileInputArchive() : serial_ar(&file, &cursor) {}
+
+            /// Creates a shared-file archive for input.
+
+            /// \param[in] world The world.
+            /// \param[in] filename Name of the file.
+            SharedFileInputArchive(World& world, const char* filename)
+                : serial_ar(&file, &cursor) {
+                open(world, filename);
+            }
+
+            /// Opens the archive and checks its header. This is a collective operation.
+
+            /// \param[in] world The world.
+            /// \param[in] filename Name of the file.
+            void open(World& world, const char* filename);
+
+            /// Closes the archive. This is a collective operation.
+            void close();
+
+            /// Returns the archive reading process-local data on process zero.
+            SharedFileSerialInputArchive& serial_archive() const {
+                MADNESS_ASSERT(world && world->rank() == 0);
+                return serial_ar;
+            }
+
+            /// Reads the table of the next container record. This is a collective operation.
+            ContainerRecord load_container_record() const;
+
+            /// Sends each extent to the process that owns its entry and returns the extents owned here.
+
+            /// This is a collective operation that fences.
+            /// \param[in] record The container record being loaded.
+            /// \param[in] by_owner The extents found by this process, indexed by owner.
+            /// \return The extents of the entries owned by this process, sorted by offset.
+            std::vector<extentT> exchange_extents(const ContainerRecord& record,
+                                                  const std::vector< std::vector<extentT> >& by_owner) const;
+
+            /// Reads \c buf.size() bytes at \c offset from this process alone.
+            void read_at(uint64_t offset, std::vector<unsigned char>& buf) const {
+                if (buf.size()) file.read_at(offset, buf.data(), buf.size());
+            }
+        };
+
+        /// Disable type info for shared-file output archives.
+
+        /// \tparam T The data type.
+        template <class T>
+        struct ArchivePrePostImpl<SharedFileOutputArchive,T> {
+            static void preamble_store(const SharedFileOutputArchive& ar) {}
+            static inline void postamble_store(const SharedFileOutputArchive& ar) {}
+        };
+
+        /// Disable type info for shared-file input archives.
+
+        /// \tparam T The data type.
+        template <class T>
+        struct ArchivePrePostImpl<SharedFileInputArchive,T> {
+            static inline void preamble_load(const SharedFileInputArchive& ar) {}
+            static inline void postamble_load(const SharedFileInputArchive& ar) {}
+        };
+
+        /// Specialization of \c ArchiveImpl for shared-file output archives.
+
+        /// Parallel objects are forwarded to their implementation of parallel
+        /// store, while serial objects are written only from process 0.
+        /// \tparam T The data type.
+        template <class T>
+        struct ArchiveImpl<SharedFileOutputArchive, T> {
+            template <typename Q>
+            static inline
+            typename std::enable_if<std::is_base_of<ParallelSerializableObject, Q>::value, const SharedFileOutputArchive&>::type
+            wrap_store(const SharedFileOutputArchive& ar, const Q& t) {
+                ArchiveStoreImpl<SharedFileOutputArchive,T>::store(ar,t);
+                return ar;
+            }
+
+            template <typename Q>
+            static inline
+            typename std::enable_if<!std::is_base_of<ParallelSerializableObject, Q>::value, const SharedFileOutputArchive&>::type
+            wrap_store(const SharedFileOutputArchive& ar, const Q& t) {
+                if (ar.get_world()->rank()==0) {
+                    ar.serial_archive() & t;
+                }
+                return ar;
+            }
+        };
+
+        /// Specialization of \c ArchiveImpl for shared-file input archives.
+
+        /// Parallel objects are forwarded to their implementation of parallel
+        /// load, while serial objects are read only from process 0 and then broadcast.
+        /// \tparam T The data type.
+        template <class T>
+        struct ArchiveImpl<SharedFileInputArchive, T> {
+            template <typename Q>
+            static inline
+            typename std::enable_if<std::is_base_of<ParallelSerializableObject, Q>::value, const SharedFileInputArchive&>::type
+            wrap_load(const SharedFileInputArchive& ar, const Q& t) {
+                ArchiveLoadImpl<SharedFileInputArchive,T>::load(ar,const_cast<T&>(t));
+                return ar;
+            }
+
+            template <typename Q>
+            static inline
+            typename std::enable_if<!std::is_base_of<ParallelSerializableObject, Q>::value, const SharedFileInputArchive&>::type
+            wrap_load(const SharedFileInputArchive& ar, const Q& t) {
+                if (ar.get_world()->rank()==0) {
+                    ar.serial_archive() & t;
+                }
+                ar.broadcast(const_cast<T&>(t), 0);
+                return ar;
+            }
+        };
+
+        /// Write the archive array only from process zero.
+
+        /// \tparam T The array data type.
+        template <class T>
+        struct ArchiveImpl< SharedFileOutputArchive, archive_array<T> > {
+            static inline const SharedFileOutputArchive& wrap_store(const SharedFileOutputArchive& ar, const archive_array<T>& t) {
+                if (ar.get_world()->rank() == 0) ar.serial_archive() & t;
+                return ar;
+            }
+        };
+
+        /// Read the archive array and broadcast.
+
+        /// \tparam T The array data type.
+        template <class T>
+        struct ArchiveImpl< SharedFileInputArchive, archive_array<T> > {
+            static inline const SharedFileInputArchive& wrap_load(const SharedFileInputArchive& ar, const archive_array<T>& t) {
+                if (ar.get_world()->rank() == 0) ar.serial_archive() & t;
+                ar.broadcast(t, 0);
+                return ar;
+            }
+        };
+
+        /// Forward a fixed-size array to \c archive_array.
+
+        /// \tparam T The array data type.
+        /// \tparam n The number of items in the array.
+        template <class T, std::size_t n>
+        struct ArchiveImpl<SharedFileOutputArchive, T[n]> {
+            static inline const SharedFileOutputArchive& wrap_store(const SharedFileOutputArchive& ar, const T(&t)[n]) {
+                ar << wrap(&t[0],n);
+                return ar;
+            }
+        };
+
+        /// Forward a fixed-size array to \c archive_array.
+
+        /// \tparam T The array data type.
+        /// \tparam n The number of items in the array.
+        template <class T, std::size_t n>
+        struct ArchiveImpl<SharedFileInputArchive, T[n]> {
+            static inline const SharedFileInputArchive& wrap_load(const SharedFileInputArchive& ar, const T(&t)[n]) {
+                ar >> wrap(&t[0],n);
+                return ar;
+            }
+        };
+
+        /// @}
+    }
+}
+
+#endif // MADNESS_WORLD_SHARED_FILE_ARCHIVE_H__INCLUDED
@@ -0,0 +1,269 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+/// \file slab_allocator.cc
+/// \brief Implements the per-thread free lists behind \c slab_allocate
+
+#include <madness/world/slab_allocator.h>
+#include <madness/world/hardware.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+namespace madness {
+
+    namespace {
+
+        const std::size_t NCLASS = slab_max_size/slab_alignment; ///< Number of size classes
+        const std::size_t SLAB_BYTES = 64*1024; ///< Bytes carved at a time
+        const int MAX_DOMAIN = 16;  ///< Domains beyond this share depots
+
+        /// A free block; \c next_batch is only used by the first block of a batch
+        struct Block {
+            Block* next;
+            Block* next_batch;
+        };
+
+        /// Batches of free blocks shared by the threads of a NUMA domain
+        struct Depot {
+            std::mutex lock;
+            std::atomic<Block*> batches{nullptr}; ///< Modified only under \c lock
+        };
+
+        /// Free lists of one thread
+
+        /// Trivially destructible so that blocks freed while the thread (or
+        /// program) is shutting down can still be routed to the depot.
+        struct Cache {
+            Block* head[NCLASS];
+            std::size_t n[NCLASS];
+            char* chunk;
+            char* chunk_end;
+            int domain;         ///< Depot set of this thread
+            int state;          ///< 0 = unused, 1 = live, 2 = thread exiting
+        };
+
+        std::atomic<std::uint64_t> nlocal{0}, nremote{0}, nslab{0};
+
+        thread_local Cache cache;
+
+        inline std::size_t class_size(std::size_t c) {
+            return (c + 1)*slab_alignment;
+        }
+
+        /// Number of blocks moved between a thread and the depot at once
+        inline std::size_t batch_size(std::size_t c) {
+            return std::max<std::size_t>(8, 8192/class_size(c));
+        }
+
+        /// Depot for size class \c c of domain \c domain
+        Depot& depot(int domain, std::size_t c) {
+            // Never destroyed since blocks may be freed during static destruction
+            static Depot* d = new Depot[MAX_DOMAIN*NCLASS];
+            return d[domain*NCLASS + c];
+        }
+
+        int num_domains() {
+            return std::min(Hardware::NumNUMADomains(), MAX_DOMAIN);
+        }
+
+        bool enabled() {
+            static const bool e = [] {
+                const char* s = getenv("MAD_SLAB_ALLOC");
+                if (!s) return true;
+                int value;
+                if (sscanf(s, "%d", &value) != 1 || (value != 0 && value != 1)) {
+                    std::fprintf(stderr, "!!! WARNING: MAD_SLAB_ALLOC should be 0 or 1 ... ignored\n");
+                    return true;
+                }
+                return value == 1;
+            }();
+            return e;
+        }
+
+        void push_batch(int domain, std::size_t c, Block* b) {
+            Depot& d = depot(domain, c);
+            std::lock_guard<std::mutex> guard(d.lock);
+            b->next_batch = d.batches.load(std::memory_order_relaxed);
+            d.batches.store(b, std::memory_order_relaxed);
+        }
+
+        Block* pop_batch(int domain, std::size_t c) {
+            Depot& d = depot(domain, c);
+            // Peek so that empty depots (the common case for remote
+            // domains) are skipped without taking their lock
+            if (!d.batches.load(std::memory_order_relaxed)) return nullptr;
+            std::lock_guard<std::mutex> guard(d.lock);
+            Block* b = d.batches.load(std::memory_order_relaxed);
+            if (b) d.batches.store(b->next_batch, std::memory_order_relaxed);
+            return b;
+        }
+
+        /// Returns the free lists of an exiting thread to the depot
+        struct CacheGuard {
+            CacheGuard() { cache.state = 1; }
+            ~CacheGuard() {
+                for (std::size_t c=0; c<NCLASS; ++c) {
+                    if (cache.head[c]) push_batch(cache.domain, c, cache.head[c]);
+                    cache.head[c] = nullptr;
+                    cache.n[c] = 0;
+                }
+                cache.state = 2;
+            }
+        };
+
+        thread_local CacheGuard cache_guard;
+
+        /// Makes the calling thread's cache live; false if the thread is exiting
+        bool cache_live() {
+            if (cache.state == 0) {
+                static_cast<void>(&cache_guard);
+                cache.domain = Hardware::CurrentNUMADomain() % MAX_DOMAIN;
+            }
+            return cache.state == 1;
+        }
+
+        /// Takes a batch, preferring the depot of this thread's domain
+        Block* take_batch(std::size_t c) {
+            Block* b = pop_batch(cache.domain, c);
+            if (b) {
+                nlocal.fetch_add(1, std::memory_order_relaxed);
+                return b;
+            }
+            const int n = num_domains();
+            for (int i=1; i<n; ++i) {
+                b = pop_batch((cache.domain + i) % n, c);
+                if (b) {
+                    nremote.fetch_add(1, std::memory_order_relaxed);
+                    return b;
+                }
+            }
+            return nullptr;
+        }
+
+        /// Refills an empty free list and returns one block from it
+        void* refill(std::size_t c) {
+            const std::size_t nb = batch_size(c);
+            Block* b = take_batch(c);
+            if (b) {
+                // Batches normally hold nb blocks (those flushed by an
+                // exiting thread may hold fewer); counting them would
+                // chase a pointer through every block
+                cache.head[c] = b->next;
+                cache.n[c] = nb - 1;
+                return b;
+            }
+
+            // Carve in descending order so that blocks are handed out in
+            // ascending address order
+            const std::size_t size = class_size(c);
+            if (cache.chunk + nb*size > cache.chunk_end) {
+                cache.chunk = static_cast<char*>(::operator new(SLAB_BYTES));
+                cache.chunk_end = cache.chunk + SLAB_BYTES;
+                nslab.fetch_add(1, std::memory_order_relaxed);
+            }
+            for (std::size_t i=nb; i>0; --i) {
+                Block* p = reinterpret_cast<Block*>(cache.chunk + (i-1)*size);
+                p->next = cache.head[c];
+                cache.head[c] = p;
+            }
+            cache.chunk += nb*size;
+            cache.n[c] = nb;
+
+            b = cache.head[c];
+            cache.head[c] = b->next;
+            --cache.n[c];
+            return b;
+        }
+
+    } // namespace
+
+    void* slab_allocate(std::size_t size) {
+        if (size > slab_max_size || !enabled())
+            return ::operator new(size);
+
+        const std::size_t c = size ? (size - 1)/slab_alignment : 0;
+        if (!cache_live())
+            return ::operator new(class_size(c));
+
+        Block* b = cache.head[c];
+        if (b) {
+            cache.head[c] = b->next;
+            if (cache.n[c]) --cache.n[c];
+            return b;
+        }
+        return refill(c);
+    }
+
+    void slab_deallocate(void* p, std::size_t size) noexcept {
+        if (!p) return;
+        if (size > slab_max_size || !enabled()) {
+            ::operator delete(p);
+            return;
+        }
+
+        const std::size_t c = size ? (size - 1)/slab_alignment : 0;
+        Block* b = static_cast<Block*>(p);
+        if (!cache_live()) {
+            b->next = nullptr;
+            push_batch(cache.domain, c, b);
+            return;
+        }
+
+        b->next = cache.head[c];
+        cache.head[c] = b;
+
+        // Hand a batch to the depot once this thread holds more than it
+        // is likely to need (n may overestimate the length of the list)
+        const std::size_t nb = batch_size(c);
+        if (++cache.n[c] > 2*nb) {
+            Block* last = b;
+            std::size_t i = 1;
+            for (; i<nb && last->next; ++i) last = last->next;
+            cache.head[c] = last->next;
+            last->next = nullptr;
+            cache.n[c] = cache.head[c] ? cache.n[c] - i : 0;
+            push_batch(cache.domain, c, b);
+        }
+    }
+
+    SlabStats slab_get_stats() {
+        SlabStats s;
+        s.nlocal = nlocal.load(std::memory_order_relaxed);
+        s.nremote = nremote.load(std::memory_order_relaxed);
+        s.nslab = nslab.load(std::memory_order_relaxed);
+        return s;
+    }
+
+} // namespace madness
@@ -0,0 +1,129 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+#ifndef MADNESS_WORLD_SLAB_ALLOCATOR_H__INCLUDED
+#define MADNESS_WORLD_SLAB_ALLOCATOR_H__INCLUDED
+
+/// \file slab_allocator.h
+/// \brief Per-thread free lists for the small objects made for every task and future
+
+#include <madness/madness_config.h>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace madness {
+
+    /// Allocates a block of at least \c size bytes from the slab allocator
+
+    /// Blocks up to \c slab_max_size bytes come from a per-thread free
+    /// list for each 16-byte size class, so allocation and release
+    /// normally touch no lock and no shared cache line.  Larger requests
+    /// are passed to \c ::operator new.
+    ///
+    /// Free lists are refilled by carving 64 KB slabs.  A thread that
+    /// frees more blocks than it allocates (the usual case for a worker
+    /// thread running tasks made by the main thread) hands batches back
+    /// to a depot from which other threads refill, so memory circulates
+    /// between threads rather than piling up in one of them.  There is
+    /// one depot per NUMA domain; a thread refills from the depot of its
+    /// own domain before taking memory from another domain, and slabs are
+    /// first touched by the thread that carves them so they are placed
+    /// in its domain.  Slabs are never returned to the operating system.
+    ///
+    /// Setting the environment variable MAD_SLAB_ALLOC=0 sends all
+    /// requests to \c ::operator new and \c ::operator delete, which is
+    /// useful with memory checkers.
+    /// \param[in] size The number of bytes
+    /// \return Pointer to the block, 16-byte aligned
+    void* slab_allocate(std::size_t size);
+
+    /// Returns a block obtained from \c slab_allocate
+
+    /// \param[in] p Pointer to the block (may be null)
+    /// \param[in] size The size that was passed to \c slab_allocate
+    void slab_deallocate(void* p, std::size_t size) noexcept;
+
+    /// Largest request served from the free lists
+    static constexpr std::size_t slab_max_size = 1024;
+
+    /// Alignment of blocks served from the free lists
+    static constexpr std::size_t slab_alignment = 16;
+
+    /// Placement counters of the slab allocator, summed over all threads
+    struct SlabStats {
+        std::uint64_t nlocal;   ///< #refills from the depot of the thread's own NUMA domain
+        std::uint64_t nremote;  ///< #refills from the depot of another NUMA domain
+        std::uint64_t nslab;    ///< #slabs carved
+    };
+
+    /// Returns the placement counters of the slab allocator
+    SlabStats slab_get_stats();
+
+    /// Standard allocator that draws from \c slab_allocate
+
+    /// Intended for \c std::allocate_shared so that an object and its
+    /// reference count share a single recycled block.
+    /// \tparam T The value type
+    template <typename T>
+    class SlabAllocator {
+    public:
+        typedef T value_type;
+
+        SlabAllocator() = default;
+
+        template <typename U>
+        SlabAllocator(const SlabAllocator<U>&) noexcept { }
+
+        T* allocate(std::size_t n) {
+            if (alignof(T) > slab_alignment)
+                return static_cast<T*>(::operator new(n*sizeof(T), std::align_val_t(alignof(T))));
+            return static_cast<T*>(slab_allocate(n*sizeof(T)));
+        }
+
+        void deallocate(T* p, std::size_t n) noexcept {
+            if (alignof(T) > slab_alignment)
+                ::operator delete(p, std::align_val_t(alignof(T)));
+            else
+                slab_deallocate(p, n*sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(const SlabAllocator<U>&) const noexcept { return true; }
+
+        template <typename U>
+        bool operator!=(const SlabAllocator<U>&) const noexcept { return false; }
+    };
+
+} // namespace madness
+
+#endif // MADNESS_WORLD_SLAB_ALLOCATOR_H__INCLUDED
@@ -386,12 +386,73 @@ void test_accessors() {
     if (a[1] != 20000000.0) MADNESS_EXCEPTION("Ooops", int(a[1]));
 }
 
+class BenchWorker : public madness::ThreadBase {
+private:
+    ConcurrentHashMap<int,double>& a; // Better would be a shared pointer
+    const int first, n, nkey;
+    const bool insert;
+
+public:
+    BenchWorker(ConcurrentHashMap<int,double>& a, int first, int n, int nkey, bool insert)
+            : ThreadBase(), a(a), first(first), n(n), nkey(nkey), insert(insert) {
+        start();
+    }
+
+    void run() {
+        typedef ConcurrentHashMap<int,double>::datumT datumT;
+        if (insert) {
+            for (int i=first; i<first+n; ++i) a.insert(datumT(i,i));
+        }
+        else {
+            // Stride through the keys so that threads do not share a working set
+            long key = first;
+            for (int i=0; i<n; ++i) {
+                ConcurrentHashMap<int,double>::const_accessor r;
+                if (!a.find(r, int(key))) MADNESS_EXCEPTION("bench: missing key", int(key));
+                key = (key + 7919) % nkey;
+            }
+        }
+        ndone++;
+    }
+};
+
+double bench_run(ConcurrentHashMap<int,double>& a, int nthread, int n, int nkey, bool insert) {
+    ndone = 0;
+    double used = madness::wall_time();
+    std::vector<BenchWorker*> workers;
+    for (int t=0; t<nthread; ++t)
+        workers.push_back(new BenchWorker(a, insert ? t*n : (t*nkey)/nthread, n, nkey, insert));
+    while (ndone != nthread) sched_yield();
+    used = madness::wall_time() - used;
+    for (int t=0; t<nthread; ++t) delete workers[t];
+    return used/(double(n)*nthread);
+}
+
+void test_bench() {
+    // Threads insert disjoint keys into a map made with the default
+    // size, then look keys up through const accessors (as the
+    // WorldContainer does) in a map of nkey entries
+    const int nkey = 1<<18;
+    const int nop = 1<<20;
+    printf("\n  ConcurrentHashMap with %d entries ... wall time per operation per thread\n", nkey);
+    printf("  threads   insert (ns)   find (ns)\n");
+    for (int nthread=1; nthread<=64; nthread*=2) {
+        ConcurrentHashMap<int,double> a;
+        const double insert_used = bench_run(a, nthread, nkey/nthread, nkey, true);
+        if (a.size() != size_t((nkey/nthread)*nthread)) MADNESS_EXCEPTION("bench: wrong size", int(a.size()));
+        const double find_used = bench_run(a, nthread, nop/nthread, (nkey/nthread)*nthread, false);
+        printf("  %7d   %11.1f   %9.1f\n", nthread, insert_used*1e9*nthread, find_used*1e9*nthread);
+    }
+}
+
 int main(int argc, char** argv) {
     madness::initialize(argc,argv);
 
     if (getenv("MAD_SMALL_TESTS")) smalltest=true;
     for (int iarg=1; iarg<argc; iarg++) if (strcmp(argv[iarg],"--small")==0) smalltest=true;
     std::cout << "small test : " << smalltest << std::endl;
+    bool bench = false;
+    for (int iarg=1; iarg<argc; iarg++) if (strcmp(argv[iarg],"--bench")==0) bench=true;
     
     try {
         test_coverage();
@@ -401,6 +462,7 @@ int main(int argc, char** argv) {
             test_thread();
             test_accessors();
         }
+        if (bench) test_bench();
 
         cout << "Things seem to be working!\n";
     }
@@ -1,6 +1,10 @@
 #include <madness/world/MADworld.h>
 
 // This program is used to do a simple test of the task queue.
+//
+// It doubles as a scheduler microbenchmark: run it with
+// MAD_WORK_STEALING=0 and MAD_WORK_STEALING=1 to compare the shared
+// queue with the work-stealing deques.
 
 const int NGEN=100;
 const int NTASK=100000;
@@ -89,12 +93,21 @@ int main(int argc, char** argv) {
     double finish = madness::wall_time();
 
 
-    std::cout << "Total tasks = " << total_count
+    std::cout << "Scheduler = "
+            << (madness::ThreadPool::is_work_stealing() ? "work stealing" : "shared queue")
+            << "\nTotal tasks = " << total_count
             << "\nTotal runtime = " << finish - start
-            << " (s)\nTasks per thread:\n";
+            << " (s)\nTasks per second = " << total_count/(finish - start)
+            << "\nTasks per thread:\n";
     for (unsigned long i = 0; i < (madness::ThreadPool::size() + 1); ++i)
         std::cout << i << " " << thread_counters[i] << "\n";
 
+    if (madness::ThreadPool::is_work_stealing()) {
+        const madness::WSDQStats stats = madness::ThreadPool::get_work_stealing_stats();
+        std::cout << "Deque push/pop/steal/grow = " << stats.npush << " "
+                << stats.npop << " " << stats.nsteal << " " << stats.ngrow << "\n";
+    }
+
     cleanup_tls();
     madness::finalize();
 
@@ -37,6 +37,7 @@
 
 #include <madness/world/worldinit.h>
 #include <madness/world/thread.h>
+#include <madness/world/hardware.h>
 #include <madness/world/worldprofile.h>
 #include <madness/world/madness_exception.h>
 #include <madness/world/print.h>
@@ -74,6 +75,8 @@ namespace madness {
 
     ThreadPool* ThreadPool::instance_ptr = 0;
     double ThreadPool::await_timeout = 900.0;
+    thread_local int ThreadPool::deque_index = -1;
+    thread_local unsigned int ThreadPool::steal_seed = 1;
 #if HAVE_INTEL_TBB
     std::unique_ptr<tbb::global_control> ThreadPool::tbb_control = nullptr;
 #endif
@@ -338,7 +341,9 @@ namespace madness {
 #endif
     // The constructor is private to enforce the singleton model
     ThreadPool::ThreadPool(int nthread) :
-            threads(nullptr), main_thread(), nthreads(nthread), finish(false)
+            threads(nullptr), main_thread(), deques(nullptr), nthreads(nthread),
+            work_stealing(false), numa_aware(false), thread_domain(nullptr),
+            steal_counts(nullptr), finish(false)
     {
         nfinished = 0;
         instance_ptr = this;
@@ -388,16 +393,29 @@ namespace madness {
         tbb_control = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, num_tbb_threads);
 #else
 
+        work_stealing = default_work_stealing();
+        Hardware::Initialize();
+        numa_aware = work_stealing && default_numa_aware();
+
         try {
             if (nthreads > 0)
                 threads = new ThreadPoolThread[nthreads];
             else
                 threads = 0;
+            if (work_stealing)
+                deques = new WSDeque<PoolTaskInterface*>[nthreads + 1];
+            thread_domain = new std::atomic<int>[nthreads + 1];
+            steal_counts = new StealCounts[nthreads + 1];
         }
         catch (...) {
             MADNESS_EXCEPTION("memory allocation failed", 0);
         }
 
+        // The main thread owns the last deque
+        if (work_stealing) deque_index = nthreads;
+        for (int i=0; i<=nthreads; ++i) thread_domain[i] = 0;
+        thread_domain[nthreads] = Hardware::CurrentNUMADomain();
+
         for (int i=0; i<nthreads; ++i) {
             threads[i].set_pool_thread_index(i);
             threads[i].start(pool_thread_main, (void *)(threads+i));
@@ -431,21 +449,69 @@ namespace madness {
         return nthread;
     }
 
+    // Get the task scheduler from the environment
+    bool ThreadPool::default_work_stealing() {
+        const char* cws = getenv("MAD_WORK_STEALING");
+        if (cws) {
+            int ws;
+            int result = sscanf(cws, "%d", &ws);
+            if (result != 1)
+                MADNESS_EXCEPTION("MAD_WORK_STEALING is not an integer", result);
+            return ws != 0;
+        }
+        return false;
+    }
+
+    // Get the NUMA preference of thieves from the environment
+    bool ThreadPool::default_numa_aware() {
+        if (Hardware::NumNUMADomains() < 2) return false;
+        const char* cnuma = getenv("MAD_NUMA");
+        if (cnuma) {
+            int numa;
+            if (sscanf(cnuma, "%d", &numa) != 1) {
+                std::cerr << "!!! WARNING: MAD_NUMA should be an integer ... ignored\n";
+                return true;
+            }
+            return numa != 0;
+        }
+        return true;
+    }
+
     void ThreadPool::thread_main(ThreadPoolThread* const thread) {
         PROFILE_MEMBER_FUNC(ThreadPool);
         thread->set_affinity(2, thread->get_pool_thread_index());
+#if !(HAVE_INTEL_TBB || HAVE_PARSEC)
+        thread_domain[thread->get_pool_thread_index()] = Hardware::CurrentNUMADomain();
+#endif
 
 #if !HAVE_PARSEC
+        if (work_stealing) {
+            deque_index = thread->get_pool_thread_index();
+            steal_seed = 2*deque_index + 1;
+            // There is no condition variable to sleep on, so back off
+            // from spinning once the pool has been idle for a while
+            unsigned int nidle = 0;
+            while (!finish) {
+                if (run_tasks(false, thread))
+                    nidle = 0;
+                else if (++nidle < 1000)
+                    cpu_relax();
+                else
+                    myusleep(10);
+            }
+        }
+        else {
 #define MULTITASK
 #ifdef  MULTITASK
-        while (!finish) {
-            run_tasks(true, thread);
-        }
+            while (!finish) {
+                run_tasks(true, thread);
+            }
 #else
-        while (!finish) {
-            run_task(true, thread);
-        }
+            while (!finish) {
+                run_task(true, thread);
+            }
 #endif
+        }
 #endif
 
 #ifdef MADNESS_TASK_PROFILING
@@ -524,8 +590,12 @@ namespace madness {
         if (!instance_ptr) return;
         instance()->finish = true;
 #if !HAVE_PARSEC
-        for (int i=0; i<instance()->nthreads; ++i) {
-            add(new PoolTaskNull);
+        // Wake up threads blocked on the queue ... work-stealing
+        // threads never block and just need to see finish
+        if (!instance()->work_stealing) {
+            for (int i=0; i<instance()->nthreads; ++i) {
+                add(new PoolTaskNull);
+            }
         }
 	instance_ptr->flush_prebuf();
         while (instance_ptr->nfinished != instance_ptr->nthreads);
@@ -553,4 +623,35 @@ namespace madness {
         return instance()->queue.get_stats();
     }
 
+    // Returns work-stealing statistics summed over all deques
+    WSDQStats ThreadPool::get_work_stealing_stats() {
+        WSDQStats sum;
+#if !(HAVE_INTEL_TBB || HAVE_PARSEC)
+        ThreadPool* const pool = instance();
+        if (pool->work_stealing) {
+            for (int i=0; i<=pool->nthreads; ++i) {
+                const WSDQStats s = pool->deques[i].get_stats();
+                sum.npush += s.npush;
+                sum.npop += s.npop;
+                sum.nsteal += s.nsteal;
+                sum.ngrow += s.ngrow;
+                sum.nsteal_remote += pool->steal_counts[i].nremote;
+            }
+        }
+#endif
+        return sum;
+    }
+
+    // Returns the NUMA domain of each thread, main thread last
+    std::vector<int> ThreadPool::get_numa_domains() {
+        std::vector<int> domains;
+#if !(HAVE_INTEL_TBB || HAVE_PARSEC)
+        if (instance_ptr) {
+            for (int i=0; i<=instance_ptr->nthreads; ++i)
+                domains.push_back(instance_ptr->thread_domain[i].load(std::memory_order_relaxed));
+        }
+#endif
+        return domains;
+    }
+
 } // namespace madness
@@ -39,8 +39,12 @@
 */
 
 #include <madness/world/dqueue.h>
+#include <madness/world/wsdeque.h>
+#include <madness/world/slab_allocator.h>
+#include <madness/world/timeline.h>
 #include <madness/world/function_traits.h>
 #include <vector>
+#include <atomic>
 #include <cstddef>
 #include <cstdio>
 #include <pthread.h>
@@ -909,6 +913,15 @@ namespace madness {
         Barrier* barrier; ///< Barrier, only allocated for multithreaded tasks.
         AtomicInt count; ///< Used to count threads as they start.
 
+        /// Records the execution of this task in the timeline.
+
+        /// \param[in] start The time at which the task started.
+        void timeline_task(double start) const {
+            std::pair<void*,unsigned short> id;
+            get_id(id);
+            Timeline::task(id, typeid(*this).name(), start);
+        }
+
     	/// Returns true for the one thread that should invoke the destructor.
 
         /// \return True for the one thread that should invoke the destructor.
@@ -918,6 +931,7 @@ namespace madness {
             // A downside is this does not preserve any relationships between thread
             // numbering and the architecture ... more work ahead.
             int nthread = get_nthread();
+            const double start = Timeline::enabled() ? Timeline::now() : 0.0;
             if (nthread == 1) {
 #ifdef MADNESS_TASK_PROFILING
                 task_event_->start(id_, nthread, submit_time_);
@@ -926,6 +940,7 @@ namespace madness {
 #ifdef MADNESS_TASK_PROFILING
                 task_event_->stop();
 #endif // MADNESS_TASK_PROFILING
+                if (start) timeline_task(start);
                 return true;
             }
             else {
@@ -939,6 +954,7 @@ namespace madness {
 #endif // MADNESS_TASK_PROFILING
 
                 run(TaskThreadEnv(nthread, id, barrier));
+                if (start) timeline_task(start);
 
 #ifdef MADNESS_TASK_PROFILING
                 const bool cleanup = barrier->enter(id);
@@ -982,6 +998,37 @@ namespace madness {
             delete barrier;
         }
 
+        /// Allocates a task object from the calling thread's slab free lists.
+
+        /// Tasks are small, made by the million, and usually made by one
+        /// thread and destroyed by another, which is the pattern
+        /// \c slab_allocate is built for.
+        /// \param[in] size The size of the task object.
+        /// \return Pointer to the storage.
+        static void* operator new(std::size_t size) {
+            return slab_allocate(size);
+        }
+
+        /// Over-aligned task objects bypass the slab.
+        static void* operator new(std::size_t size, std::align_val_t al) {
+            return ::operator new(size, al);
+        }
+
+        /// Returns the storage of a task object.
+
+        /// The destructor is virtual so \c size is that of the most
+        /// derived class, as given to \c operator \c new.
+        /// \param[in] p Pointer to the storage.
+        /// \param[in] size The size of the task object.
+        static void operator delete(void* p, std::size_t size) noexcept {
+            slab_deallocate(p, size);
+        }
+
+        /// Frees an over-aligned task object.
+        static void operator delete(void* p, std::size_t, std::align_val_t al) noexcept {
+            ::operator delete(p, al);
+        }
+
         /// Call this to reset the number of threads before the task is submitted.
 
         /// Once a task has been constructed, /c TaskAttributes::set_nthread()
@@ -1162,7 +1209,17 @@ namespace madness {
         ThreadPoolThread *threads; ///< Array of threads.
         ThreadPoolThread main_thread; ///< Placeholder for main thread tls.
         DQueue<PoolTaskInterface*> queue; ///< Queue of tasks.
+        WSDeque<PoolTaskInterface*>* deques; ///< Per-thread deques for work stealing (\c nthreads+1, the last belongs to the main thread).
         int nthreads; ///< Number of threads.
+        bool work_stealing; ///< If true pool threads use work-stealing deques.
+        bool numa_aware; ///< If true thieves try victims in their own NUMA domain first.
+        std::atomic<int>* thread_domain; ///< NUMA domain of each pool thread (\c nthreads+1, the last is the main thread).
+
+        /// Steals made by the owner of a deque, padded to avoid false sharing
+        struct alignas(64) StealCounts {
+            std::uint64_t nremote = 0; ///< #steals from a deque owned by a thread in another domain
+        };
+        StealCounts* steal_counts; ///< Per-deque steal counts (\c nthreads+1).
         volatile bool finish; ///< Set to true when time to stop.
         AtomicInt nfinished; ///< Thread pool exit counter.
 
@@ -1170,6 +1227,8 @@ namespace madness {
         static ThreadPool* instance_ptr; ///< Singleton pointer.
         static const int nmax = 128; ///< Number of task a worker thread will pop from the task queue
         static double await_timeout; ///< Waiter timeout.
+        static thread_local int deque_index; ///< Index of this thread's deque, or -1 if it has none.
+        static thread_local unsigned int steal_seed; ///< State of this thread's victim selection.
 
 #if defined(HAVE_IBMBGQ) and defined(HPM)
         static unsigned int main_hpmctx; ///< HPM context for main thread.
@@ -1185,6 +1244,91 @@ namespace madness {
         /// \return The number of threads.
         int default_nthread();
 
+        /// Get the scheduler choice from the environment.
+
+        /// \return True if \c MAD_WORK_STEALING is set to a nonzero value.
+        bool default_work_stealing();
+
+        /// Get the NUMA preference from the environment.
+
+        /// \return False if \c MAD_NUMA is set to 0 or there is only one NUMA domain.
+        bool default_numa_aware();
+
+        /// Run one task from the work-stealing deques or the shared queue.
+
+        /// High-priority, multi-threaded and externally submitted tasks
+        /// live in the shared queue and are taken first.  Otherwise the
+        /// thread pops its own deque (LIFO, for cache locality) and, if
+        /// that is empty, tries to steal the oldest task from a randomly
+        /// chosen victim.  On a NUMA node victims in the thief's own domain
+        /// are tried before those in other domains, so tasks (and the data
+        /// they were given) tend to stay near the memory they came from.
+        /// \param[in,out] this_thread The calling thread.
+        /// \return True if a task was run.
+        bool run_tasks_work_stealing(ThreadPoolThread* const this_thread) {
+#if !(HAVE_INTEL_TBB || HAVE_PARSEC)
+            if (!queue.empty()) {
+                PoolTaskInterface* taskbuf[nmax];
+                const int ntask = queue.pop_front(nmax, taskbuf, false);
+                if (ntask > 0) {
+                    run_task_batch(ntask, taskbuf, this_thread);
+                    return true;
+                }
+            }
+
+            PoolTaskInterface* task = nullptr;
+            bool got = (deque_index >= 0) && deques[deque_index].pop(task);
+            if (!got) {
+                const int ndeque = nthreads + 1;
+                steal_seed = steal_seed*1103515245u + 12345u;
+                const int first = int((steal_seed>>16) % unsigned(ndeque));
+                const int domain = (deque_index >= 0) ?
+                        thread_domain[deque_index].load(std::memory_order_relaxed) : 0;
+                // Pass 0 visits victims in this domain, pass 1 the rest
+                for (int pass=(numa_aware ? 0 : 1); pass<2 && !got; ++pass) {
+                    for (int i=0; i<ndeque && !got; ++i) {
+                        const int victim = (first + i) % ndeque;
+                        if (victim == deque_index) continue;
+                        const bool remote =
+                                thread_domain[victim].load(std::memory_order_relaxed) != domain;
+                        if (numa_aware && remote != (pass == 1)) continue;
+                        got = deques[victim].steal(task);
+                        if (got && remote && deque_index >= 0)
+                            ++steal_counts[deque_index].nremote;
+                    }
+                }
+            }
+            if (got) run_task_batch(1, &task, this_thread);
+            return got;
+#else
+            MADNESS_EXCEPTION("run_tasks_work_stealing should not be called when using TBB or PaRSEC", 1);
+#endif
+        }
+
+        /// Run a batch of tasks that have been removed from a queue.
+
+        /// \param[in] ntask The number of tasks.
+        /// \param[in] taskbuf The tasks; null pointers are skipped.
+        /// \param[in,out] this_thread The calling thread.
+        void run_task_batch(int ntask, PoolTaskInterface** taskbuf, ThreadPoolThread* const this_thread) {
+#ifdef MADNESS_TASK_PROFILING
+            profiling::TaskEventList* event_list =
+                    this_thread->profiler().new_list(ntask);
+#endif // MADNESS_TASK_PROFILING
+            if (Timeline::enabled())
+                Timeline::counter("task queue", int64_t(queue.size()));
+            for (int i=0; i<ntask; ++i) {
+                if (taskbuf[i]) { // Task pointer might be zero due to stealing
+#ifdef MADNESS_TASK_PROFILING
+                    taskbuf[i]->set_event(event_list->event());
+#endif // MADNESS_TASK_PROFILING
+                    if (taskbuf[i]->run_multi_threaded()) {
+                        delete taskbuf[i];
+                    }
+                }
+            }
+        }
+
        /// Run the next task.
 
         /// \todo Verify and complete this documentation.
@@ -1198,6 +1342,8 @@ namespace madness {
 
             if (!wait && queue.empty()) return false;
             std::pair<PoolTaskInterface*,bool> t = queue.pop_front(wait);
+            if (t.second && Timeline::enabled())
+                Timeline::counter("task queue", int64_t(queue.size()));
 #ifdef MADNESS_TASK_PROFILING
             profiling::TaskEventList* event_list =
                     this_thread->profiler().new_list(1);
@@ -1235,22 +1381,11 @@ namespace madness {
             MADNESS_EXCEPTION("run_tasks should not be called when using Intel TBB", 1);
 #else
 
+            if (work_stealing) return run_tasks_work_stealing(this_thread);
+
             PoolTaskInterface* taskbuf[nmax];
             int ntask = queue.pop_front(nmax, taskbuf, wait);
-#ifdef MADNESS_TASK_PROFILING
-            profiling::TaskEventList* event_list =
-                    this_thread->profiler().new_list(ntask);
-#endif // MADNESS_TASK_PROFILING
-            for (int i=0; i<ntask; ++i) {
-                if (taskbuf[i]) { // Task pointer might be zero due to stealing
-#ifdef MADNESS_TASK_PROFILING
-                    taskbuf[i]->set_event(event_list->event());
-#endif // MADNESS_TASK_PROFILING
-                    if (taskbuf[i]->run_multi_threaded()) {
-                        delete taskbuf[i];
-                    }
-                }
-            }
+            run_task_batch(ntask, taskbuf, this_thread);
             return (ntask>0);
 #endif
         }
@@ -1336,9 +1471,17 @@ namespace madness {
 #else
             if (!task) MADNESS_EXCEPTION("ThreadPool: inserting a NULL task pointer", 1);
             int task_threads = task->get_nthread();
+            ThreadPool* const pool = instance();
+            // With work stealing ordinary tasks go on the submitting
+            // thread's own deque; threads without one (e.g., the RMI
+            // server) and high-priority tasks use the shared queue
+            if (pool->work_stealing && (deque_index >= 0) && (task_threads == 1) &&
+                !task->is_high_priority()) {
+                pool->deques[deque_index].push(task);
+            }
             // Currently multithreaded tasks must be shoved on the end of the q
             // to avoid a race condition as multithreaded task is starting up
-            if (task->is_high_priority() && (task_threads == 1)) {
+            else if (task->is_high_priority() && (task_threads == 1)) {
                 instance()->queue.push_front(task);
             }
             else {
@@ -1412,9 +1555,21 @@ namespace madness {
 
         /// Returns the number of tasks in the queue.
 
-        /// \return The number of tasks in the queue.
+        /// \return The number of tasks in the queue (approximate if work stealing is on).
         static std::size_t queue_size() {
-            return instance()->queue.size();
+            ThreadPool* const pool = instance();
+            std::size_t n = pool->queue.size();
+#if !(HAVE_INTEL_TBB || HAVE_PARSEC)
+            if (pool->work_stealing) {
+                for (int i=0; i<=pool->nthreads; ++i) n += pool->deques[i].size();
+            }
+#endif
+            return n;
+        }
+
+        /// Returns true if the pool is using work-stealing deques.
+        static bool is_work_stealing() {
+            return instance()->work_stealing;
         }
 
         /// Returns queue statistics.
@@ -1422,6 +1577,19 @@ namespace madness {
         /// \return Queue statistics.
         static const DQStats& get_stats();
 
+        /// Returns statistics summed over the work-stealing deques.
+
+        /// All counts are zero if work stealing is not in use.
+        /// \return Work-stealing statistics.
+        static WSDQStats get_work_stealing_stats();
+
+        /// Returns the NUMA domain of each pool thread and, last, of the main thread.
+
+        /// Domains are sampled when each thread starts (after it has been
+        /// bound, if binding is on).
+        /// \return The domains, or an empty vector if the pool does not exist.
+        static std::vector<int> get_numa_domains();
+
         /// Access the pool thread array
         /// \return ptr to the pool thread array, its size is given by \c size()
         static const ThreadPoolThread* get_threads() {
@@ -1498,6 +1666,9 @@ namespace madness {
 #elif HAVE_INTEL_TBB
 #else
             delete[] threads;           
+            delete[] deques;
+            delete[] thread_domain;
+            delete[] steal_counts;
 #endif
         }
     };
@@ -0,0 +1,273 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+/// \file timeline.cc
+/// \brief Implements the event buffers of \c Timeline and the trace writer
+
+#include <madness/world/timeline.h>
+#include <madness/world/thread.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <deque>
+#include <execinfo.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace madness {
+
+    bool Timeline::enabled_ = false;
+
+    namespace {
+
+        struct Event {
+            double start, stop;
+            const void* name;
+            int64_t a, b;
+            Timeline::Kind kind;
+            Timeline::NameKind name_kind;
+        };
+
+        struct Buffer {
+            std::deque<Event> events;
+            std::size_t ndropped = 0;
+            int tid = 0;
+            std::string name;
+        };
+
+        std::string prefix;
+        int rank = 0;
+        double t0 = 0.0;
+        std::size_t max_events = 1ul<<20;
+
+        std::mutex buffers_mutex;
+        std::vector<Buffer*> buffers;   // Never freed; threads may outlive finalize
+        thread_local Buffer* this_buffer = nullptr;
+
+        Buffer* get_buffer() {
+            if (!this_buffer) {
+                Buffer* b = new Buffer;
+                const ThreadBase* thread = ThreadBase::this_thread();
+                {
+                    std::lock_guard<std::mutex> guard(buffers_mutex);
+                    b->tid = int(buffers.size());
+                    buffers.push_back(b);
+                }
+                if (thread && thread->get_pool_thread_index() >= 0)
+                    b->name = "pool thread " + std::to_string(thread->get_pool_thread_index());
+                else
+                    b->name = "thread " + std::to_string(b->tid);
+                this_buffer = b;
+            }
+            return this_buffer;
+        }
+
+        std::string demangle(const char* symbol) {
+            int status = 0;
+            char* name = abi::__cxa_demangle(symbol, 0, 0, &status);
+            std::string result(status == 0 ? name : symbol);
+            free(name);
+            return result;
+        }
+
+        /// Looks a function up in the dynamic symbol table
+        std::string function_name(const void* fn) {
+            std::string mangled;
+            void* ptr = const_cast<void*>(fn);
+            char** bt_sym = backtrace_symbols(&ptr, 1);
+            if (bt_sym) {
+#ifdef ON_A_MAC
+                // <frame #> <file name> <address> <mangled name> + <function offset>
+                char file[1024], address[64], name[4096];
+                int frame;
+                if (sscanf(bt_sym[0], "%d %1023s %63s %4095s", &frame, file, address, name) == 4)
+                    mangled = name;
+#else
+                // <file>(<mangled name>+<function offset>) [<address>]
+                const char* first = strchr(bt_sym[0], '(');
+                if (first) {
+                    ++first;
+                    const char* last = strrchr(first, '+');
+                    if (last && last > first) mangled.assign(first, last - first);
+                }
+#endif
+                free(bt_sym);
+            }
+            if (mangled.empty()) {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "%p", fn);
+                return buf;
+            }
+            return demangle(mangled.c_str());
+        }
+
+        std::string event_name(Timeline::NameKind kind, const void* name) {
+            switch (kind) {
+            case Timeline::NAME_STRING:   return static_cast<const char*>(name);
+            case Timeline::NAME_FUNCTION: return function_name(name);
+            case Timeline::NAME_TYPE:     return demangle(static_cast<const char*>(name));
+            default:                      return "unknown";
+            }
+        }
+
+        /// Escapes a string for use in JSON
+        std::string quote(const std::string& s) {
+            std::string result("\"");
+            for (char c : s) {
+                if (c == '"' || c == '\\') result += '\\';
+                if (c >= 0 && c < 0x20) c = ' ';
+                result += c;
+            }
+            return result + "\"";
+        }
+
+    } // namespace
+
+    void Timeline::record(Kind kind, NameKind name_kind, const void* name,
+                          double start, double stop, int64_t a, int64_t b) {
+        Buffer* buf = get_buffer();
+        if (buf->events.size() >= max_events) {
+            ++buf->ndropped;
+            return;
+        }
+        buf->events.push_back(Event{start, stop, name, a, b, kind, name_kind});
+    }
+
+    void Timeline::initialize(int me) {
+        const char* s = getenv("MAD_TIMELINE");
+        if (!s || !*s) return;
+        prefix = s;
+        rank = me;
+
+        const char* smax = getenv("MAD_TIMELINE_MAX_EVENTS");
+        if (smax) {
+            long n;
+            if (sscanf(smax, "%ld", &n) == 1 && n > 0)
+                max_events = std::size_t(n);
+            else
+                std::fprintf(stderr, "!!! WARNING: MAD_TIMELINE_MAX_EVENTS should be a positive integer ... ignored\n");
+        }
+
+        t0 = now();
+        enabled_ = true;
+        set_thread_name("main");
+    }
+
+    void Timeline::set_origin() {
+        t0 = now();
+    }
+
+    void Timeline::set_thread_name(const char* name) {
+        if (enabled_) get_buffer()->name = name;
+    }
+
+    void Timeline::finalize() {
+        if (!enabled_) return;
+        enabled_ = false;
+
+        const std::string filename = prefix + "." + std::to_string(rank) + ".json";
+        FILE* f = fopen(filename.c_str(), "w");
+        if (!f) {
+            std::fprintf(stderr, "!!! WARNING: Timeline cannot open file %s\n", filename.c_str());
+            return;
+        }
+
+        std::map<std::pair<const void*,int>, std::string> names;
+        auto name_of = [&names](const Event& e) -> const std::string& {
+            const auto key = std::make_pair(e.name, int(e.name_kind));
+            auto it = names.find(key);
+            if (it == names.end())
+                it = names.emplace(key, quote(event_name(e.name_kind, e.name))).first;
+            return it->second;
+        };
+
+        std::lock_guard<std::mutex> guard(buffers_mutex);
+        std::size_t ndropped = 0;
+        fprintf(f, "{\"traceEvents\":[\n");
+        fprintf(f, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}}", rank, rank);
+        fprintf(f, ",\n{\"ph\":\"M\",\"name\":\"process_sort_index\",\"pid\":%d,\"args\":{\"sort_index\":%d}}", rank, rank);
+        for (const Buffer* buf : buffers) {
+            const int tid = buf->tid;
+            ndropped += buf->ndropped;
+            fprintf(f, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":%s}}",
+                    rank, tid, quote(buf->name).c_str());
+            for (const Event& e : buf->events) {
+                const double ts = e.start - t0;
+                const double dur = e.stop - e.start;
+                const char* name = name_of(e).c_str();
+                switch (e.kind) {
+                case TASK:
+                    fprintf(f, ",\n{\"ph\":\"X\",\"cat\":\"task\",\"name\":%s,\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                            name, rank, tid, ts, dur);
+                    break;
+                case SEND:
+                    fprintf(f, ",\n{\"ph\":\"i\",\"s\":\"t\",\"cat\":\"rmi\",\"name\":\"send\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,"
+                            "\"args\":{\"dest\":%lld,\"bytes\":%lld,\"handler\":%s}}",
+                            rank, tid, ts, (long long)e.a, (long long)e.b, name);
+                    break;
+                case RECV:
+                    fprintf(f, ",\n{\"ph\":\"X\",\"cat\":\"rmi\",\"name\":%s,\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                            "\"args\":{\"src\":%lld,\"bytes\":%lld}}",
+                            name, rank, tid, ts, dur, (long long)e.a, (long long)e.b);
+                    break;
+                case AM:
+                    fprintf(f, ",\n{\"ph\":\"X\",\"cat\":\"am\",\"name\":%s,\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                            name, rank, tid, ts, dur);
+                    break;
+                case SPAN:
+                    fprintf(f, ",\n{\"ph\":\"X\",\"cat\":\"world\",\"name\":%s,\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                            name, rank, tid, ts, dur);
+                    break;
+                case COUNTER:
+                    fprintf(f, ",\n{\"ph\":\"C\",\"name\":%s,\"pid\":%d,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                            name, rank, ts, (long long)e.a);
+                    break;
+                }
+            }
+        }
+        for (Buffer* buf : buffers) {
+            buf->events.clear();
+            buf->ndropped = 0;
+        }
+        fprintf(f, "\n],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{\"rank\":%d,\"dropped_events\":%zu}}\n",
+                rank, ndropped);
+        fclose(f);
+
+        if (ndropped)
+            std::fprintf(stderr, "!!! WARNING: Timeline dropped %zu events on rank %d; raise MAD_TIMELINE_MAX_EVENTS\n",
+                         ndropped, rank);
+    }
+
+} // namespace madness
@@ -0,0 +1,178 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+
+#ifndef MADNESS_WORLD_TIMELINE_H__INCLUDED
+#define MADNESS_WORLD_TIMELINE_H__INCLUDED
+
+/// \file timeline.h
+/// \brief Records a per-thread event timeline and writes it as a Chrome trace
+
+#include <madness/madness_config.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace madness {
+
+    /// Per-thread recorder of task, message, fence and queue events
+
+    /// Unlike the task profiler (MADNESS_TASK_PROFILING) the timeline is
+    /// always compiled in.  It is off unless the environment variable
+    /// MAD_TIMELINE is set, in which case every event is appended to a
+    /// buffer owned by the calling thread (no locks, no shared cache
+    /// lines) and \c finalize() writes one file per process named
+    /// "<MAD_TIMELINE>.<rank>.json" in the Chrome Trace Event format.
+    /// The files can be opened individually in chrome://tracing or
+    /// https://ui.perfetto.dev, or combined with bin/timeline_merge.py.
+    /// When off, each hook costs one test of a static flag.
+    ///
+    /// Recorded are
+    ///  - every task run by the pool, named by its function (or by its
+    ///    type for tasks without a function);
+    ///  - every active message sent (destination, size and handler)
+    ///    and the execution of every active message received, with the
+    ///    function it invokes;
+    ///  - every global fence;
+    ///  - the length of the pool's task queue, sampled by pool threads.
+    ///
+    /// Times are in microseconds from a barrier in madness::initialize, so
+    /// the files of different processes line up to within the barrier skew.
+    /// Each thread keeps at most MAD_TIMELINE_MAX_EVENTS events (default
+    /// 1M, 48 bytes each); later events are dropped and counted.
+    ///
+    /// Function names are looked up in the dynamic symbol table, so link
+    /// with -rdynamic to see the names of functions in the executable.
+    class Timeline {
+    public:
+        /// Event categories
+        enum Kind : unsigned char {TASK, SEND, RECV, AM, SPAN, COUNTER};
+
+        /// How the name of an event is stored
+        enum NameKind : unsigned char {
+            NAME_STRING,        ///< Static null-terminated string
+            NAME_FUNCTION,      ///< Function pointer to look up
+            NAME_TYPE,          ///< Mangled type name
+            NAME_NONE           ///< Unknown
+        };
+
+    private:
+        static bool enabled_;
+
+        /// Records an event in the buffer of the calling thread
+        static void record(Kind kind, NameKind name_kind, const void* name,
+                           double start, double stop, int64_t a, int64_t b);
+
+    public:
+        /// Returns true if events are being recorded
+        static bool enabled() {
+            return enabled_;
+        }
+
+        /// The time stamp used for events, in microseconds
+        static double now() {
+            return std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        /// Reads MAD_TIMELINE and starts recording if it is set
+
+        /// Called by madness::initialize before any thread is started.
+        /// \param[in] rank The rank of this process in the default world
+        static void initialize(int rank);
+
+        /// Sets the time origin of the trace to now
+
+        /// Called by madness::initialize right after the barrier that
+        /// follows the start of RMI.
+        static void set_origin();
+
+        /// Writes the file of this process and stops recording
+
+        /// Called by madness::finalize once all threads are idle.
+        static void finalize();
+
+        /// Names the calling thread in the trace
+        static void set_thread_name(const char* name);
+
+        /// Records the execution of a task
+
+        /// \param[in] id The task identifier as given by \c PoolTaskInterface::get_id
+        /// \param[in] type_name Mangled name of the task type, used if \c id is empty
+        /// \param[in] start Time at which the task started
+        static void task(const std::pair<void*,unsigned short>& id, const char* type_name, double start) {
+            const double stop = now();
+            if (id.second == 1)
+                record(TASK, NAME_FUNCTION, id.first, start, stop, 0, 0);
+            else if (id.second == 2)
+                record(TASK, NAME_TYPE, id.first, start, stop, 0, 0);
+            else
+                record(TASK, NAME_TYPE, type_name, start, stop, 0, 0);
+        }
+
+        /// Records an active message sent
+        static void send(int dest, std::size_t nbyte, const void* handler) {
+            const double t = now();
+            record(SEND, NAME_FUNCTION, handler, t, t, dest, int64_t(nbyte));
+        }
+
+        /// Records the execution of an active message received
+        static void recv(int src, std::size_t nbyte, const void* handler, double start) {
+            record(RECV, NAME_FUNCTION, handler, start, now(), src, int64_t(nbyte));
+        }
+
+        /// Records the execution of the function of an active message
+
+        /// Nested within the \c recv event of the RMI message, which
+        /// always names the generic handler of \c WorldAmInterface.
+        static void active_message(const void* func, double start) {
+            record(AM, NAME_FUNCTION, func, start, now(), 0, 0);
+        }
+
+        /// Records an interval such as a fence
+        /// \param[in] name Static string naming the interval
+        /// \param[in] start Time at which the interval started
+        static void span(const char* name, double start) {
+            record(SPAN, NAME_STRING, name, start, now(), 0, 0);
+        }
+
+        /// Records the value of a counter
+        /// \param[in] name Static string naming the counter
+        static void counter(const char* name, int64_t value) {
+            const double t = now();
+            record(COUNTER, NAME_STRING, name, t, t, value, 0);
+        }
+    };
+
+} // namespace madness
+
+#endif // MADNESS_WORLD_TIMELINE_H__INCLUDED
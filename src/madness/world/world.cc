@@ -38,6 +38,8 @@
 #include <madness/world/world.h>
 #include <madness/world/worldmem.h>
 #include <madness/world/timers.h>
+#include <madness/world/timeline.h>
+#include <madness/world/hardware.h>
 #include <madness/world/worldam.h>
 #include <madness/world/world_task_queue.h>
 #include <madness/world/worldgop.h>
@@ -203,6 +205,7 @@ namespace madness {
 
         start_cpu_time = cpu_time();
         start_wall_time = wall_time();
+        Timeline::initialize(comm.Get_rank());
         ThreadPool::begin();        // Must have thread pool before any AM arrives
         if(comm.Get_size() > 1) {
             RMI::begin(comm);           // Must have RMI while still running single threaded
@@ -210,6 +213,7 @@ namespace madness {
             // this is needed to avoid hangs with some MPIs, e.g. Intel MPI on commodity hardware
             comm.Barrier();
         }
+        Timeline::set_origin();     // Times of all processes start from the barrier
 
 #ifdef HAVE_PAPI
         begin_papi_measurement();
@@ -222,7 +226,8 @@ namespace madness {
         madness_initialized_ = true;
         if(!quiet && comm.Get_rank() == 0)
             std::cout << "MADNESS runtime initialized with " << ThreadPool::size()
-                << " threads in the pool and affinity " << sbind << "\n";
+                << " threads in the pool and affinity " << sbind
+                << (ThreadPool::is_work_stealing() ? " (work stealing)" : "") << "\n";
 
         return * World::default_world;
     }
@@ -250,6 +255,7 @@ namespace madness {
         if(world_size > 1)
             RMI::end();
         ThreadPool::end();
+        Timeline::finalize();
         detail::WorldMpi::finalize();
         madness_initialized_ = false;
         madness_quiet_ = false;
@@ -274,33 +280,41 @@ namespace madness {
         double nbyte_sent = rmi.nbyte_sent;
         double nbyte_recv = rmi.nbyte_recv;
         double server_q = rmi.max_serv_send_q;
+        double server_util = 100.0*rmi.utilization();
+        double nmsg_adopted = rmi.nmsg_adopted;
         world.gop.sum(nmsg_sent);
         world.gop.sum(nmsg_recv);
         world.gop.sum(nbyte_sent);
         world.gop.sum(nbyte_recv);
         world.gop.sum(server_q);
+        world.gop.sum(server_util);
+        world.gop.sum(nmsg_adopted);
 
         double max_nmsg_sent = rmi.nmsg_sent;
         double max_nmsg_recv = rmi.nmsg_recv;
         double max_nbyte_sent = rmi.nbyte_sent;
         double max_nbyte_recv = rmi.nbyte_recv;
         double max_server_q = rmi.max_serv_send_q;
+        double max_server_util = 100.0*rmi.utilization();
         world.gop.max(max_nmsg_sent);
         world.gop.max(max_nmsg_recv);
         world.gop.max(max_nbyte_sent);
         world.gop.max(max_nbyte_recv);
         world.gop.max(max_server_q);
+        world.gop.max(max_server_util);
 
         double min_nmsg_sent = rmi.nmsg_sent;
         double min_nmsg_recv = rmi.nmsg_recv;
         double min_nbyte_sent = rmi.nbyte_sent;
         double min_nbyte_recv = rmi.nbyte_recv;
         double min_server_q = rmi.max_serv_send_q;
+        double min_server_util = 100.0*rmi.utilization();
         world.gop.min(min_nmsg_sent);
         world.gop.min(min_nmsg_recv);
         world.gop.min(min_nbyte_sent);
         world.gop.min(min_nbyte_recv);
         world.gop.min(min_server_q);
+        world.gop.min(min_server_util);
 
         double npush_back = q.npush_back;
         double npush_front = q.npush_front;
@@ -355,8 +369,9 @@ namespace madness {
                 printf("          #total threads    %d\n", int(ThreadPool::size()+1));
             }
             else {
-                printf("       #threads per node    %d+main+server = %d\n", int(ThreadPool::size()), int(ThreadPool::size()+2));
-                printf("          #total threads    %d\n", int(ThreadPool::size()+2)*world.size());
+                const int nserver = RMI::num_threads();
+                printf("       #threads per node    %d+main+%d*server = %d\n", int(ThreadPool::size()), nserver, int(ThreadPool::size()+1+nserver));
+                printf("          #total threads    %d\n", int(ThreadPool::size()+1+nserver)*world.size());
             }
             printf("\n");
 
@@ -364,6 +379,8 @@ namespace madness {
             printf("  ----------------------\n");
             printf("   #messages in server q    %.2e / %.2e / %.2e\n",
                    min_server_q, server_q/world.size(), max_server_q);
+            printf("  server utilization (%%)    %.2e / %.2e / %.2e\n",
+                   min_server_util, server_util/world.size(), max_server_util);
             printf(" #messages sent per node    %.2e / %.2e / %.2e\n",
                    min_nmsg_sent, nmsg_sent/world.size(), max_nmsg_sent);
             printf("    #bytes sent per node    %.2e / %.2e / %.2e\n",
@@ -374,6 +391,7 @@ namespace madness {
                    min_nbyte_recv, nbyte_recv/world.size(), max_nbyte_recv);
             printf("        #msgs systemwide    %.2e\n", nmsg_sent);
             printf("       #bytes systemwide    %.2e\n", nbyte_sent);
+            printf("  #huge msgs kept by data    %.2e\n", nmsg_adopted);
             printf("\n");
             printf("  Thread pool statistics (min / avg / max)\n");
             printf("  ----------------------\n");
@@ -404,6 +422,9 @@ namespace madness {
 #ifdef WORLD_GATHER_MEM_STATS
             world_mem_info()->print();
 #endif
+            fflush(stdout);
+            Hardware::Print(std::cout);
+            printf("\n");
 
             printf("         Total wall time    %.1fs\n", total_wall_time);
             printf("         Total  cpu time    %.1fs\n", total_cpu_time);
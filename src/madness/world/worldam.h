@@ -118,7 +118,9 @@ namespace madness {
         am_handlerT get_func() const { return archive::to_abs_fn_ptr<am_handlerT>(func); }
 
         archive::BufferInputArchive make_input_arch() const {
-            return archive::BufferInputArchive(buf(),size());
+            // Huge messages arrive in a buffer of their own, which the
+            // deserialized arguments may then alias
+            return archive::BufferInputArchive(buf(),size(),RMI::adopt_recv_buffer(this));
         }
 
         archive::BufferOutputArchive make_output_arch() const {
@@ -261,7 +263,14 @@ namespace madness {
             MADNESS_ASSERT(arg->size() + sizeof(AmArg) == nbyte);
             MADNESS_ASSERT(w);
             MADNESS_ASSERT(func);
-            func(*arg);
+            if (Timeline::enabled()) {
+                const double start = Timeline::now();
+                func(*arg);
+                Timeline::active_message(reinterpret_cast<const void*>(func), start);
+            }
+            else {
+                func(*arg);
+            }
             w->am.nrecv++;  // Must be AFTER execution of the function
         }
 
@@ -44,6 +44,7 @@
 #include <set>
 
 #include <madness/world/parallel_archive.h>
+#include <madness/world/shared_file_archive.h>
 #include <madness/world/worldhashmap.h>
 #include <madness/world/mpi_archive.h>
 #include <madness/world/world_object.h>
@@ -1628,6 +1629,96 @@ namespace madness {
                 if (ar.dofence()) world->gop.fence();
             }
         };
+
+        /// Write container to a shared-file archive with optional fence
+
+        /// \ingroup worlddc
+        /// Each process serializes its local entries into a chunk
+        /// together with an index of (key, offset, size) for every
+        /// entry, and all chunks are then written into a single record
+        /// of the file with one collective write.
+        ///
+        /// If ar.dofence() is true (default) fence is invoked before and
+        /// after the IO.
+        template <class keyT, class valueT>
+        struct ArchiveStoreImpl< SharedFileOutputArchive, WorldContainer<keyT,valueT> > {
+            static void store(const SharedFileOutputArchive& ar, const WorldContainer<keyT,valueT>& t) {
+                typedef typename WorldContainer<keyT,valueT>::const_iterator iterator;
+                World* world = ar.get_world();
+                if (ar.dofence()) world->gop.fence();
+                std::vector<unsigned char> data, index;
+                VectorOutputArchive dataar(data, 0), indexar(index, 0);
+                unsigned long count = 0;
+                for (iterator it=t.begin(); it!=t.end(); ++it) ++count;
+                indexar & count;
+                for (iterator it=t.begin(); it!=t.end(); ++it) {
+                    const uint64_t offset = data.size();
+                    dataar & *it;
+                    const uint64_t size = data.size() - offset;
+                    indexar & it->first & offset & size;
+                }
+                ar.store_container(data, index);
+                if (ar.dofence()) world->gop.fence();
+            }
+        };
+
+        template <class keyT, class valueT>
+        struct ArchiveLoadImpl< SharedFileInputArchive, WorldContainer<keyT,valueT> > {
+            /// Read container from a shared-file archive
+
+            /// \ingroup worlddc
+            /// See store method above for format of file content. The
+            /// number of readers and the process map of \c t need not match
+            /// those used when writing.
+            ///
+            /// The index chunks are shared round-robin among the readers,
+            /// which tell the owner of every entry where to find it. Each
+            /// process then reads its own entries, merging adjacent ones
+            /// into larger reads.
+            static void load(const SharedFileInputArchive& ar, WorldContainer<keyT,valueT>& t) {
+                typedef typename WorldContainer<keyT,valueT>::pairT pairT;
+                typedef SharedFileInputArchive::extentT extentT;
+                const uint64_t max_read = uint64_t(1) << 26; // Largest merged read
+                World* world = ar.get_world();
+                if (ar.dofence()) world->gop.fence();
+
+                const SharedFileInputArchive::ContainerRecord record = ar.load_container_record();
+                std::vector< std::vector<extentT> > by_owner(world->size());
+                for (std::size_t w=world->rank(); w<record.index_size.size(); w+=world->size()) {
+                    std::vector<unsigned char> index(record.index_size[w]);
+                    ar.read_at(record.index_offset[w], index);
+                    VectorInputArchive indexar(index);
+                    unsigned long count = 0;
+                    indexar & count;
+                    while (count--) {
+                        keyT key;
+                        uint64_t offset, size;
+                        indexar & key & offset & size;
+                        by_owner[t.owner(key)].push_back(extentT(record.data_offset[w]+offset, size));
+                    }
+                }
+
+                const std::vector<extentT> mine = ar.exchange_extents(record, by_owner);
+                std::vector<unsigned char> buf;
+                for (std::size_t i=0; i<mine.size(); ) {
+                    std::size_t j = i+1;
+                    uint64_t end = mine[i].first + mine[i].second;
+                    while (j<mine.size() && mine[j].first==end && end-mine[i].first<max_read) {
+                        end += mine[j].second;
+                        ++j;
+                    }
+                    buf.resize(end - mine[i].first);
+                    ar.read_at(mine[i].first, buf);
+                    VectorInputArchive dataar(buf);
+                    for (; i<j; ++i) {
+                        pairT datum;
+                        dataar & datum;
+                        t.replace(datum);
+                    }
+                }
+                if (ar.dofence()) world->gop.fence();
+            }
+        };
     }
 
 }
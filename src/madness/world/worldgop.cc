@@ -29,8 +29,14 @@
   fax:   865-572-0680
 */
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
 #include <limits>
+#include <vector>
 #include <madness/world/worldgop.h>
+#include <madness/world/timeline.h>
 #include <madness/world/MADworld.h>
 #ifdef MADNESS_HAS_GOOGLE_PERF_MINIMAL
 #include <gperftools/malloc_extension.h>
@@ -38,124 +44,228 @@
 namespace madness {
 
 
-    /// Synchronizes all processes in communicator AND globally ensures no pending AM or tasks
+    bool WorldGopInterface::fence_quiescent(uint64_t& nsent, uint64_t& nrecv) const {
+        const uint64_t npoll = nfence_poll_;
+        const uint64_t ntask1 = world_.taskq.size();
+        const uint64_t nsent1 = world_.am.nsent;
+        const uint64_t nrecv1 = world_.am.nrecv;
 
-    /// Runs Dykstra-like termination algorithm on binary tree by
-    /// locally ensuring ntask=0 and all am sent and processed,
-    /// and then participating in a global sum of nsent and nrecv.
-    /// Then globally checks that nsent=nrecv and that both are
-    /// constant over two traversals.  We are then we are sure
-    /// that all tasks and AM are processed and there no AM in
-    /// flight.
-    void WorldGopInterface::fence(bool debug) {
-        PROFILE_MEMBER_FUNC(WorldGopInterface);
-        unsigned long nsent_prev=0, nrecv_prev=1; // invalid initial condition
-        SafeMPI::Request req0, req1;
-        ProcessID parent, child0, child1;
-        world_.mpi.binary_tree_info(0, parent, child0, child1);
-        Tag gfence_tag = world_.mpi.unique_tag();
-        Tag bcast_tag = world_.mpi.unique_tag();
-        int npass = 0;
+        __asm__ __volatile__ (" " : : : "memory");
 
-        //double start = wall_time();
+        const uint64_t ntask2 = world_.taskq.size();
+        nsent = world_.am.nsent;
+        nrecv = world_.am.nrecv;
 
-      if (debug)
-        madness::print(world_.rank(), ": WORLD.GOP.FENCE: entering fence loop, gfence_tag=", gfence_tag, " bcast_tag=", bcast_tag);
+        __asm__ __volatile__ (" " : : : "memory");
 
-      while (1) {
-            uint64_t sum0[2]={0,0}, sum1[2]={0,0}, sum[2];
-            if (child0 != -1) req0 = world_.mpi.Irecv((void*) &sum0, sizeof(sum0), MPI_BYTE, child0, gfence_tag);
-            if (child1 != -1) req1 = world_.mpi.Irecv((void*) &sum1, sizeof(sum1), MPI_BYTE, child1, gfence_tag);
-            world_.taskq.fence();
-            if (child0 != -1) World::await(req0);
-            if (child1 != -1) World::await(req1);
+        // A poller is counted in nfence_poll_ only after it is queued and
+        // is uncounted before it is retired, so a mismatch errs toward busy
+        return (ntask1 <= npoll) && (ntask2 <= npoll) && (nsent1 == nsent) && (nrecv1 == nrecv);
+    }
 
-            if (debug && (child0 != -1 || child1 != -1))
-              madness::print(world_.rank(), ": WORLD.GOP.FENCE: npass=", npass, " received messages from children={", child0, ",", child1, "} gfence_tag=", gfence_tag);
 
-            bool finished;
-            uint64_t ntask1, nsent1, nrecv1, ntask2, nsent2, nrecv2;
-            do {
-                world_.taskq.fence();
+    /// State of one fence
 
-                // Since the number of outstanding tasks and number of AM sent/recv
-                // don't share a critical section read each twice and ensure they
-                // are unchanged to ensure that are consistent ... they don't have
-                // to be current.
+    /// Each pass is a wave up the binary tree, in which a process adds
+    /// its nsent and nrecv to those of its children once it is locally
+    /// quiescent, followed by a wave down with the root's decision.  All
+    /// messages are nonblocking and poll() never waits, so detection
+    /// overlaps with running tasks and AM.
+    class WorldGopInterface::FenceWave {
+        enum State {UP, DOWN, FINISHING, DONE};
 
-                ntask1 = world_.taskq.size();
-                nsent1 = world_.am.nsent;
-                nrecv1 = world_.am.nrecv;
+        WorldGopInterface& gop;
+        const bool debug;
+        ProcessID parent, child0, child1;
+        Tag up_tag, down_tag;
+        State state;
+        int npass;
+        SafeMPI::Request req0, req1, reqdown, sendup, senddown0, senddown1;
+        uint64_t sum0[2], sum1[2], sum[2]; // sums of nsent and nrecv
+        uint64_t down[3];                  // global sums and finished flag
+        uint64_t prev[2];                  // global sums of previous pass (root only)
+        bool waiting;                      // true if last poll was only waiting for messages
+
+        void post_children() {
+            if (child0 != -1) req0 = gop.world_.mpi.Irecv((void*) &sum0, sizeof(sum0), MPI_BYTE, child0, up_tag);
+            if (child1 != -1) req1 = gop.world_.mpi.Irecv((void*) &sum1, sizeof(sum1), MPI_BYTE, child1, up_tag);
+        }
 
-                __asm__ __volatile__ (" " : : : "memory");
+        void send_children() {
+            if (child0 != -1) senddown0 = gop.world_.mpi.Isend(&down, sizeof(down), MPI_BYTE, child0, down_tag);
+            if (child1 != -1) senddown1 = gop.world_.mpi.Isend(&down, sizeof(down), MPI_BYTE, child1, down_tag);
+            ++npass;
+            if (debug)
+                madness::print(gop.world_.rank(), ": WORLD.GOP.FENCE: npass=", npass, " sum0=", down[0], " sum1=", down[1], " finished=", down[2]);
+            if (down[2]) {
+                state = FINISHING;
+            }
+            else {
+                post_children();
+                state = UP;
+            }
+        }
 
-                ntask2 = world_.taskq.size();
-                nsent2 = world_.am.nsent;
-                nrecv2 = world_.am.nrecv;
+    public:
+        Future<bool> done;
+
+        FenceWave(WorldGopInterface& gop, bool debug)
+            : gop(gop), debug(debug), state(UP), npass(0), waiting(false)
+        {
+            gop.world_.mpi.binary_tree_info(0, parent, child0, child1);
+            up_tag = gop.world_.mpi.unique_tag();
+            down_tag = gop.world_.mpi.unique_tag();
+            sum0[0] = sum0[1] = sum1[0] = sum1[1] = 0;
+            prev[0] = 0; prev[1] = 1; // invalid initial condition
+            if (debug)
+                madness::print(gop.world_.rank(), ": WORLD.GOP.FENCE: starting fence, up_tag=", up_tag, " down_tag=", down_tag);
+            post_children();
+        }
 
-                __asm__ __volatile__ (" " : : : "memory");
+        /// Advances the fence as far as possible without waiting and returns true once it is complete
+        bool poll() {
+            // A pass that is not the last may be followed at once by the next
+            int n;
+            do {
+                n = npass;
+                if (step()) return true;
+            } while (npass != n && state == UP);
+            return false;
+        }
 
-                finished = (ntask2==0) && (ntask1==0) && (nsent1==nsent2) && (nrecv1==nrecv2);
+        /// True if the last call to poll() was held up only by messages
+        bool is_waiting() const {return waiting;}
+
+    private:
+        bool step() {
+            waiting = true;
+            if (state == UP) {
+                // Pending sends from the previous pass must be done before their buffers are reused
+                if (!req0.Test() || !req1.Test() || !sendup.Test() || !senddown0.Test() || !senddown1.Test())
+                    return false;
+                uint64_t nsent, nrecv;
+                if (!gop.fence_quiescent(nsent, nrecv)) {
+                    waiting = false;
+                    return false;
+                }
+
+                sum[0] = sum0[0] + sum1[0] + nsent;
+                sum[1] = sum0[1] + sum1[1] + nrecv;
+                sum0[0] = sum0[1] = sum1[0] = sum1[1] = 0;
+
+                if (parent == -1) {
+                    down[0] = sum[0];
+                    down[1] = sum[1];
+                    down[2] = (sum[0]==sum[1] && sum[0]==prev[0] && sum[1]==prev[1]);
+                    prev[0] = sum[0];
+                    prev[1] = sum[1];
+                    send_children();
+                }
+                else {
+                    reqdown = gop.world_.mpi.Irecv((void*) &down, sizeof(down), MPI_BYTE, parent, down_tag);
+                    sendup = gop.world_.mpi.Isend(&sum, sizeof(sum), MPI_BYTE, parent, up_tag);
+                    state = DOWN;
+                }
             }
-            while (!finished);
-
-            sum[0] = sum0[0] + sum1[0] + nsent2; // Must use values read above
-            sum[1] = sum0[1] + sum1[1] + nrecv2;
-
-            if (parent != -1) {
-                req0 = world_.mpi.Isend(&sum, sizeof(sum), MPI_BYTE, parent, gfence_tag);
-                if (debug)
-                  madness::print(world_.rank(), ": WORLD.GOP.FENCE: npass=", npass, " sent message to parent=", parent, " gfence_tag=", gfence_tag);
-                World::await(req0);
+            if (state == DOWN) {
+                if (!reqdown.Test()) return false;
+                send_children();
+            }
+            if (state == FINISHING) {
+                if (!sendup.Test() || !senddown0.Test() || !senddown1.Test()) return false;
                 if (debug)
-                  madness::print(world_.rank(), ": WORLD.GOP.FENCE: npass=", npass, " parent=", parent, ", confirmed receipt");
+                    madness::print(gop.world_.rank(), ": WORLD.GOP.FENCE: done with fence in ", npass, (npass > 1 ? " loops" : " loop"));
+                state = DONE;
+                done.set(true);
             }
+            return state == DONE;
+        }
+    };
 
-            // While we are probably idle free unused communication buffers
-            //world_.am.free_managed_buffers();
 
-            //bool dowork = (npass==0) || (ThreadPool::size()==0);
-            bool dowork = true;
-            broadcast(&sum, sizeof(sum), 0, dowork, bcast_tag);
-            ++npass;
+    /// Task that polls a fence and queues a fresh copy of itself until the fence is complete
 
-            if (debug)
-              madness::print(world_.rank(), ": WORLD.GOP.FENCE: npass=", npass, " sum0=", sum[0], " nsent_prev=", nsent_prev, " sum1=", sum[1], " nrecv_prev=", nrecv_prev);
+    /// While only messages are awaited it backs off like a waiting
+    /// thread would, so as not to take the processor from their senders.
+    class WorldGopInterface::FencePollTask : public TaskInterface {
+        std::shared_ptr<FenceWave> wave;
+        std::shared_ptr<MutexWaiter> waiter;
+
+    public:
+        FencePollTask(const std::shared_ptr<FenceWave>& wave, const std::shared_ptr<MutexWaiter>& waiter)
+            : wave(wave), waiter(waiter) {}
+
+        static void add(WorldGopInterface& gop, const std::shared_ptr<FenceWave>& wave,
+                        const std::shared_ptr<MutexWaiter>& waiter) {
+            gop.world_.taskq.add(new FencePollTask(wave, waiter));
+            gop.nfence_poll_++;
+        }
 
-            if (sum[0]==sum[1] && sum[0]==nsent_prev && sum[1]==nrecv_prev) {
-              if (debug)
-                madness::print(world_.rank(), ": WORLD.GOP.FENCE: npass=", npass, " exiting fence loop");
-              break;
+        void run(World& world) {
+            WorldGopInterface& gop = world.gop;
+            if (!wave->poll()) {
+                if (wave->is_waiting()) waiter->wait();
+                else waiter->reset();
+                add(gop, wave, waiter);
             }
+            gop.nfence_poll_--;
+        }
+    };
 
-//                 if (wall_time() - start > 1200.0) {
-//                     std::cout << rank() << " FENCE " << nsent2 << " "
-//                         << nsent_prev << " " << nrecv2 << " " << nrecv_prev
-//                         << " " << sum[0] << " " << sum[1] << " " << npass
-//                         << " " << taskq.size() << std::endl;
-//                     std::cout.flush();
-//                     //myusleep(1000);
-//                     MADNESS_ASSERT(0);
-//                 }
 
-            nsent_prev = sum[0];
-            nrecv_prev = sum[1];
+    Future<bool> WorldGopInterface::fence_async(bool debug) {
+        std::shared_ptr<FenceWave> wave(new FenceWave(*this, debug));
+        Future<bool> done = wave->done;
+        FencePollTask::add(*this, wave, std::make_shared<MutexWaiter>());
+        return done;
+    }
+
+
+    /// Synchronizes all processes in communicator AND globally ensures no pending AM or tasks
+
+    /// Runs Dykstra-like termination algorithm on binary tree by
+    /// locally ensuring ntask=0 and all am sent and processed,
+    /// and then participating in a global sum of nsent and nrecv.
+    /// Then globally checks that nsent=nrecv and that both are
+    /// constant over two traversals.  We are then we are sure
+    /// that all tasks and AM are processed and there no AM in
+    /// flight.
+    void WorldGopInterface::fence(bool debug) {
+        PROFILE_MEMBER_FUNC(WorldGopInterface);
+        const double start = Timeline::enabled() ? Timeline::now() : 0.0;
+        // This thread drives the waves itself between tasks and, like
+        // World::await(Request), sleeps rather than spins on messages
+        FenceWave wave(*this, debug);
+        ThreadPool::await([&wave] () -> bool { return wave.poll(); }, true, true);
+        if (start) Timeline::span("fence", start);
 
-        };
         world_.am.free_managed_buffers(); // free up communication buffers
         deferred_->do_cleanup();
 #ifdef MADNESS_HAS_GOOGLE_PERF_MINIMAL
         MallocExtension::instance()->ReleaseFreeMemory();
 //        print("clearing memory");
 #endif
-      if (debug)
-        madness::print(world_.rank(), ": WORLD.GOP.FENCE: done with fence in ", npass, (npass > 1 ? " loops" : " loop"));
     }
 
 
     /// Broadcasts bytes from process root while still processing AM & tasks
 
     /// Optimizations can be added for long messages
+    size_t WorldGopInterface::default_segment_nbyte() {
+        size_t nbyte = 128*1024;
+        const char* mad_gop_segment_size = getenv("MAD_GOP_SEGMENT_SIZE");
+        if (mad_gop_segment_size) {
+            long n;
+            if (sscanf(mad_gop_segment_size, "%ld", &n) != 1 || n < 0) {
+                std::cerr << "!!! WARNING: MAD_GOP_SEGMENT_SIZE is not a non-negative integer ... using default\n";
+            }
+            else {
+                nbyte = n;
+            }
+        }
+        return nbyte;
+    }
+
     void WorldGopInterface::broadcast(void* buf, size_t nbyte, ProcessID root, bool dowork, Tag bcast_tag) {
         MADNESS_ASSERT(nbyte <= size_t(std::numeric_limits<int>::max()));
         SafeMPI::Request req0, req1;
@@ -166,6 +276,30 @@ namespace madness {
 
         //print("BCAST TAG", bcast_tag);
 
+        if (segment_nbyte_ && nbyte > 2*segment_nbyte_ && world_.size() > 1) {
+            // Pipeline the segments down the tree
+            char* p = static_cast<char*>(buf);
+            const size_t nseg = (nbyte + segment_nbyte_ - 1)/segment_nbyte_;
+            std::vector<SafeMPI::Request> recv(nseg), send0(nseg), send1(nseg);
+            // Poll without the 100us sleep of World::await(Request)
+            auto wait = [dowork](SafeMPI::Request& r) {World::await([&r]() {return r.Test();}, dowork);};
+            for (size_t s=0; s<nseg; ++s) {
+                const size_t first = s*segment_nbyte_, n = std::min(segment_nbyte_, nbyte - first);
+                if (parent != -1) recv[s] = world_.mpi.Irecv(p+first, n, MPI_BYTE, parent, bcast_tag);
+            }
+            for (size_t s=0; s<nseg; ++s) {
+                const size_t first = s*segment_nbyte_, n = std::min(segment_nbyte_, nbyte - first);
+                if (parent != -1) wait(recv[s]);
+                if (child0 != -1) send0[s] = world_.mpi.Isend(p+first, n, MPI_BYTE, child0, bcast_tag);
+                if (child1 != -1) send1[s] = world_.mpi.Isend(p+first, n, MPI_BYTE, child1, bcast_tag);
+            }
+            for (size_t s=0; s<nseg; ++s) {
+                if (child0 != -1) wait(send0[s]);
+                if (child1 != -1) wait(send1[s]);
+            }
+            return;
+        }
+
         if (parent != -1) {
             req0 = world_.mpi.Irecv(buf, nbyte, MPI_BYTE, parent, bcast_tag);
             World::await(req0, dowork);
@@ -38,7 +38,9 @@
 /// If you can recall the Intel hypercubes, their comm lib used GOP as
 /// the abbreviation.
 
+#include <algorithm>
 #include <type_traits>
+#include <vector>
 #include <madness/world/worldtypes.h>
 #include <madness/world/buffer_archive.h>
 #include <madness/world/world.h>
@@ -145,9 +147,14 @@ namespace madness {
         World& world_; ///< MPI interface
         std::shared_ptr<detail::DeferredCleanup> deferred_; ///< Deferred cleanup object.
         bool debug_; ///< Debug mode
+        size_t segment_nbyte_; ///< Segment size of pipelined reduce and broadcast (0 = never pipeline)
+        AtomicInt nfence_poll_; ///< No. of queued fence polling tasks, which do not count as local work
 
         friend class detail::DeferredCleanup;
 
+        class FenceWave;
+        class FencePollTask;
+
         // Message tags
         struct PointToPointTag { };
         struct LazySyncTag { };
@@ -613,12 +620,25 @@ namespace madness {
         }
 
 
+        /// Reads MAD_GOP_SEGMENT_SIZE or returns the default segment size
+        static size_t default_segment_nbyte();
+
+        /// Returns true if no tasks other than fence pollers are queued and reads nsent and nrecv
+
+        /// Since the number of outstanding tasks and number of AM sent/recv
+        /// don't share a critical section each is read twice to ensure that
+        /// they are consistent ... they don't have to be current.
+        bool fence_quiescent(uint64_t& nsent, uint64_t& nrecv) const;
+
     public:
 
         // In the World constructor can ONLY rely on MPI and MPI being initialized
         WorldGopInterface(World& world) :
             world_(world), deferred_(new detail::DeferredCleanup()), debug_(false)
-        { }
+            , segment_nbyte_(default_segment_nbyte())
+        {
+            nfence_poll_ = 0;
+        }
 
         ~WorldGopInterface() {
             deferred_->destroy(true);
@@ -633,6 +653,24 @@ namespace madness {
             return status;
         }
 
+        /// Returns the segment size in bytes used to pipeline long reductions and broadcasts
+
+        /// Messages longer than two segments are cut into segments that
+        /// flow through the binary tree concurrently, so the latency is
+        /// about nbyte/bandwidth + 2*log2(P) segment hops instead of
+        /// 2*log2(P) full-buffer hops.  The default is 128 KB and may be
+        /// set with the environment variable MAD_GOP_SEGMENT_SIZE (bytes).
+        size_t get_segment_size() const {return segment_nbyte_;}
+
+        /// Sets the segment size in bytes (0 disables pipelining) and returns the old value
+
+        /// Must be the same on all processes
+        size_t set_segment_size(size_t nbyte) {
+            size_t old = segment_nbyte_;
+            segment_nbyte_ = nbyte;
+            return old;
+        }
+
         /// Synchronizes all processes in communicator ... does NOT fence pending AM or tasks
         void barrier() {
             long i = world_.rank();
@@ -649,20 +687,35 @@ namespace madness {
         /// Then globally checks that nsent=nrecv and that both are
         /// constant over two traversals.  We are then sure
         /// that all tasks and AM are processed and there no AM in
-        /// flight.
+        /// flight.  The waves are those of fence_async(); this thread
+        /// runs tasks while waiting and then frees communication buffers
+        /// and runs deferred cleanup.
         /// \param[in] debug set to true to print progress statistics using madness::print(); the default is false.
         void fence(bool debug = false);
 
 
+        /// Starts a fence and returns a future that is set when it has completed
+
+        /// The termination waves of fence() travel the binary tree as
+        /// nonblocking messages that are polled by a task, so no thread
+        /// blocks and the caller may continue with local computation.  Only
+        /// tasks and AM submitted before the call, and everything they
+        /// spawn, are covered.  Like fence() it must be called by all processes in
+        /// the same order.  Unlike fence() it does not free communication
+        /// buffers or run deferred cleanup.  Future<void> carries no state,
+        /// so the returned future holds true.
+        /// \param[in] debug set to true to print progress statistics using madness::print(); the default is false.
+        Future<bool> fence_async(bool debug = false);
+
+
         /// Broadcasts bytes from process root while still processing AM & tasks
 
-        /// Optimizations can be added for long messages
+        /// Messages longer than two segments (see get_segment_size()) are
+        /// pipelined down the tree in segments.
         void broadcast(void* buf, size_t nbyte, ProcessID root, bool dowork = true, Tag bcast_tag = -1);
 
 
         /// Broadcasts typed contiguous data from process root while still processing AM & tasks
-
-        /// Optimizations can be added for long messages
         template <typename T>
         inline void broadcast(T* buf, size_t nelem, ProcessID root) {
             broadcast((void *) buf, nelem*sizeof(T), root);
@@ -706,9 +759,16 @@ namespace madness {
 
         /// Inplace global reduction (like MPI all_reduce) while still processing AM & tasks
 
-        /// Optimizations can be added for long messages and to reduce the memory footprint
+        /// Buffers longer than two segments (see get_segment_size()) use
+        /// reduce_pipelined(), shorter ones a reduction of the whole buffer
+        /// up a binary tree followed by a broadcast.
         template <typename T, class opT>
         void reduce(T* buf, size_t nelem, opT op) {
+            if (segment_nbyte_ && nelem*sizeof(T) > 2*segment_nbyte_ && world_.size() > 1) {
+                reduce_pipelined(buf, nelem, op);
+                return;
+            }
+
             SafeMPI::Request req0, req1;
             ProcessID parent, child0, child1;
             world_.mpi.binary_tree_info(0, parent, child0, child1);
@@ -740,6 +800,83 @@ namespace madness {
             broadcast(buf, nelem, 0);
         }
 
+        /// Inplace global reduction of a long buffer pipelined in segments
+
+        /// The buffer is cut into segments of about get_segment_size()
+        /// bytes.  Each process reduces segment s from its children and
+        /// sends it up while later segments are still arriving, and the
+        /// root sends each reduced segment down the same tree at once.
+        /// All receives are posted up front and every wait services AM
+        /// and tasks.  Segments sent with the same tag between the same
+        /// pair of processes arrive in order, so one tag per direction
+        /// suffices.
+        template <typename T, class opT>
+        void reduce_pipelined(T* buf, size_t nelem, opT op) {
+            ProcessID parent, child0, child1;
+            world_.mpi.binary_tree_info(0, parent, child0, child1);
+            const Tag up_tag = world_.mpi.unique_tag();
+            const Tag down_tag = world_.mpi.unique_tag();
+
+            const size_t seglen = std::max(size_t(1), segment_nbyte_/sizeof(T));
+            const size_t nseg = (nelem + seglen - 1)/seglen;
+            auto first = [=](size_t s) {return s*seglen;};
+            auto length = [=](size_t s) {return std::min(seglen, nelem - s*seglen);};
+            // Poll without the 100us sleep of World::await(Request), which is longer than a segment takes
+            auto wait = [](SafeMPI::Request& r) {World::await([&r]() {return r.Test();});};
+
+            T* buf0 = new T[nelem];     // from child0, then the result from parent
+            T* buf1 = (child1 != -1) ? new T[nelem] : nullptr;
+            std::vector<SafeMPI::Request> recv0(nseg), recv1(nseg), up(nseg), down(nseg);
+            std::vector<SafeMPI::Request> send0(nseg), send1(nseg);
+
+            for (size_t s=0; s<nseg; ++s) {
+                if (child0 != -1) recv0[s] = world_.mpi.Irecv(buf0+first(s), length(s)*sizeof(T), MPI_BYTE, child0, up_tag);
+                if (child1 != -1) recv1[s] = world_.mpi.Irecv(buf1+first(s), length(s)*sizeof(T), MPI_BYTE, child1, up_tag);
+            }
+
+            // Reduce up the tree; the root immediately starts down with each segment
+            for (size_t s=0; s<nseg; ++s) {
+                T* p = buf + first(s);
+                const long n = length(s);
+                if (child0 != -1) {
+                    wait(recv0[s]);
+                    for (long i=0; i<n; ++i) p[i] = op(p[i],buf0[first(s)+i]);
+                }
+                if (child1 != -1) {
+                    wait(recv1[s]);
+                    for (long i=0; i<n; ++i) p[i] = op(p[i],buf1[first(s)+i]);
+                }
+                if (parent != -1) {
+                    up[s] = world_.mpi.Isend(p, n*sizeof(T), MPI_BYTE, parent, up_tag);
+                    // buf0 segment s is free now so the result can land there
+                    down[s] = world_.mpi.Irecv(buf0+first(s), n*sizeof(T), MPI_BYTE, parent, down_tag);
+                }
+                else {
+                    if (child0 != -1) send0[s] = world_.mpi.Isend(p, n*sizeof(T), MPI_BYTE, child0, down_tag);
+                    if (child1 != -1) send1[s] = world_.mpi.Isend(p, n*sizeof(T), MPI_BYTE, child1, down_tag);
+                }
+            }
+
+            // Pass the result down the tree
+            if (parent != -1) {
+                for (size_t s=0; s<nseg; ++s) {
+                    T* p = buf0 + first(s);
+                    wait(down[s]);
+                    if (child0 != -1) send0[s] = world_.mpi.Isend(p, length(s)*sizeof(T), MPI_BYTE, child0, down_tag);
+                    if (child1 != -1) send1[s] = world_.mpi.Isend(p, length(s)*sizeof(T), MPI_BYTE, child1, down_tag);
+                    wait(up[s]);
+                    std::copy(p, p+length(s), buf+first(s));
+                }
+            }
+
+            for (size_t s=0; s<nseg; ++s) {
+                if (child0 != -1) wait(send0[s]);
+                if (child1 != -1) wait(send1[s]);
+            }
+            delete [] buf0;
+            delete [] buf1;
+        }
+
         /// Inplace global sum while still processing AM & tasks
         template <typename T>
         inline void sum(T* buf, size_t nelem) {
@@ -46,9 +46,13 @@
 #include <madness/world/worldmutex.h>
 #include <madness/world/madness_exception.h>
 #include <madness/world/worldhash.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <new>
 #include <stdio.h>
 #include <map>
+#include <type_traits>
 
 namespace madness {
 
@@ -59,129 +63,110 @@ namespace madness {
 
     namespace Hash_private {
 
-        // A hashtable is an array of nbin bins.
-        // Each bin is a linked list of entries protected by a spinlock.
-        // Each entry holds a key+value pair, a read-write mutex, and a link to the next entry.
+        // All entries are kept in one linked list sorted by their
+        // split-order key, which is the bit reversal of their hash
+        // (Shalev and Shavit, J. ACM 53, 379 (2006)).  Bin b is a node
+        // in the same list at the bit reversal of b, so the entries with
+        // hash%nbins == b follow bin b, and doubling nbins splits a bin
+        // by inserting a new bin node into the list without moving any
+        // entry.  New bins are linked in when first used, so the table
+        // grows incrementally.  Since the list itself never changes
+        // order, iterators see every entry even while the table grows.
+        //
+        // The entries between a bin node and the next bin node are its
+        // segment.  Writers lock the bin that owns the segment.  Readers
+        // take no lock: a bin's version is odd while entries are being
+        // unlinked and is bumped when they are, and a reader that sees
+        // it change retries.  Unlinked entries are recycled within their
+        // bin and only freed with the map, so a reader never touches
+        // freed memory.
+
+        /// Reverses the bits of a 64-bit word
+        inline uint64_t reverse_bits(uint64_t x) {
+            x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+            x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+            x = ((x >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((x & 0x0F0F0F0F0F0F0F0Full) << 4);
+            x = ((x >> 8) & 0x00FF00FF00FF00FFull) | ((x & 0x00FF00FF00FF00FFull) << 8);
+            x = ((x >> 16) & 0x0000FFFF0000FFFFull) | ((x & 0x0000FFFF0000FFFFull) << 16);
+            return (x >> 32) | (x << 32);
+        }
+
+        /// A link in the list ... order is even for bins and odd for entries
+        class node {
+        public:
+            std::atomic<node*> next;
+            uint64_t order;
+
+            node(uint64_t order) : next(nullptr), order(order) {}
+
+            bool is_bin() const {return !(order & 0x1);}
+        };
 
         template <typename keyT, typename valueT>
-        class entry : public madness::MutexReaderWriter {
+        class entry : public node, public madness::MutexReaderWriter {
         public:
             typedef std::pair<const keyT, valueT> datumT;
-            datumT datum;
 
-            class entry<keyT,valueT> * volatile next;
+        private:
+            typename std::aligned_storage<sizeof(datumT), alignof(datumT)>::type storage;
+
+        public:
+            entry() : node(1) {}
+
+            datumT& datum() {return *reinterpret_cast<datumT*>(&storage);}
 
-            entry(const datumT& datum, entry<keyT,valueT>* next)
-                    : datum(datum), next(next) {}
+            const datumT& datum() const {return *reinterpret_cast<const datumT*>(&storage);}
         };
 
         template <class keyT, class valueT>
-        class bin : private madness::Spinlock {
+        class bin : public node, private madness::Spinlock {
         private:
             typedef entry<keyT,valueT> entryT;
-            typedef std::pair<const keyT, valueT> datumT;
             // Could pad here to avoid false sharing of cache line but
             // perhaps better to just use more bins
         public:
 
-            entryT* volatile p;
-            int volatile ninbin;
+            std::atomic<bin*> next_bin;     ///< Next bin in the list
+            std::atomic<unsigned> version;  ///< Odd while entries are being unlinked
+            std::atomic<long> ninbin;       ///< No. of entries in the segment
+            std::atomic<bool> ready;        ///< True once linked into the list
+            entryT* free;                   ///< Entries unlinked from the segment for reuse
 
-            bin() : p(0),ninbin(0) {}
+            bin() : node(0), next_bin(nullptr), version(0), ninbin(0), ready(false), free(nullptr) {}
 
-            ~bin() {
-                clear();
+            using madness::Spinlock::lock;
+            using madness::Spinlock::unlock;
+
+            /// Makes the version odd before entries are unlinked ... must hold the lock
+            void begin_unlink() {
+                version.store(version.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
             }
 
-            void clear() {
-                lock();             // BEGIN CRITICAL SECTION
-                while (p) {
-                    entryT* n=p->next;
-                    delete p;
-                    p=n;
-                    ninbin--;
-                }
-                MADNESS_ASSERT(ninbin == 0);
-                unlock();           // END CRITICAL SECTION
-            }
-
-            entryT* find(const keyT& key, const int lockmode) const {
-                bool gotlock;
-                entryT* result;
-                madness::MutexWaiter waiter;
-                do {
-                    lock();             // BEGIN CRITICAL SECTION
-                    result = match(key);
-                    if (result) {
-                        gotlock = result->try_lock(lockmode);
-                    }
-                    else {
-                        gotlock = true;
-                    }
-                    unlock();           // END CRITICAL SECTION
-                    if (!gotlock) waiter.wait(); //cpu_relax();
-                }
-                while (!gotlock);
-
-                return result;
-            }
-
-            std::pair<entryT*,bool> insert(const datumT& datum, int lockmode) {
-                bool gotlock;
-                entryT* result;
-                bool notfound;
-                madness::MutexWaiter waiter;
-                do {
-                    lock();             // BEGIN CRITICAL SECTION
-                    result = match(datum.first);
-                    notfound = !result;
-                    if (notfound) {
-                        result = p = new entryT(datum,p);
-                        ++ninbin;
-                    }
-                    gotlock = result->try_lock(lockmode);
-                    unlock();           // END CRITICAL SECTION
-                    if (!gotlock) waiter.wait(); //cpu_relax();
-                }
-                while (!gotlock);
+            /// Makes the version even again once entries are unlinked ... must hold the lock
+            void end_unlink() {
+                version.store(version.load(std::memory_order_relaxed)+1, std::memory_order_release);
+            }
 
-                return std::pair<entryT*,bool>(result,notfound);
+            /// Returns an entry to construct a datum in ... must hold the lock
+            entryT* alloc() {
+                entryT* e = free;
+                if (e) free = static_cast<entryT*>(e->next.load(std::memory_order_relaxed));
+                else e = new entryT;
+                return e;
             }
 
-            bool del(const keyT& key, int lockmode) {
-                bool status = false;
-                lock();             // BEGIN CRITICAL SECTION
-                for (entryT *t=p,*prev=0; t; prev=t,t=t->next) {
-                    if (t->datum.first == key) {
-                        if (prev) {
-                            prev->next = t->next;
-                        }
-                        else {
-                            p = t->next;
-                        }
-                        t->unlock(lockmode);
-                        delete t;
-                        --ninbin;
-                        status = true;
-                        break;
-                    }
-                }
-                unlock();           // END CRITICAL SECTION
-                return status;
+            /// Destroys the datum and keeps the entry for reuse ... must hold the lock between begin/end_unlink
+            void recycle(entryT* e) {
+                typedef typename entryT::datumT datumT;
+                e->datum().~datumT();
+                e->next.store(free, std::memory_order_relaxed);
+                free = e;
             }
 
             std::size_t size() const {
                 return ninbin;
             };
-
-        private:
-            entryT* match(const keyT& key) const {
-                entryT* t;
-                for (t=p; t; t=t->next)
-                    if (t->datum.first == key) break;
-                return t;
-            }
-
         };
 
         /// iterator for hash
@@ -200,44 +185,38 @@ namespace madness {
             typedef datumT& reference;
 
         private:
+            typedef typename hashT::binT binT;
+
             hashT* h;               // Associated hash table
-            int bin;                // Current bin
-            entryT* entry;          // Current entry in bin ... zero means at end
+            entryT* entry;          // Current entry ... zero means at end
 
             template <class otherHashT>
             friend class HashIterator;
 
-            /// If the entry is null (end of current bin) finds next non-empty bin
-            void next_non_null_entry() {
-                while (!entry) {
-                    ++bin;
-                    if ((unsigned) bin == h->nbins) {
-                        entry = 0;
-                        return;
-                    }
-                    entry = h->bins[bin].p;
-                }
-                return;
+            /// Returns the first entry at or after p, or zero at the end of the list
+            static entryT* first_entry(node* p) {
+                while (p && p->is_bin()) p = p->next.load(std::memory_order_acquire);
+                return static_cast<entryT*>(p);
             }
 
         public:
 
             /// Makes invalid iterator
-            HashIterator() : h(0), bin(-1), entry(0) {}
+            HashIterator() : h(0), entry(0) {}
 
             /// Makes begin/end iterator
             HashIterator(hashT* h, bool begin)
-                    : h(h), bin(-1), entry(0) {
-                if (begin) next_non_null_entry();
+                    : h(h), entry(0) {
+                if (begin) entry = first_entry(h->first_bin());
             }
 
             /// Makes iterator to specific entry
-            HashIterator(hashT* h, int bin, entryT* entry)
-                    : h(h), bin(bin), entry(entry) {}
+            HashIterator(hashT* h, entryT* entry)
+                    : h(h), entry(entry) {}
 
             /// Copy constructor
             HashIterator(const HashIterator& other)
-                    : h(other.h), bin(other.bin), entry(other.entry) {}
+                    : h(other.h), entry(other.entry) {}
 
             /// Implicit conversion of another hash type to this hash type
 
@@ -245,12 +224,13 @@ namespace madness {
             /// types.
             template <class otherHashT>
             HashIterator(const HashIterator<otherHashT>& other)
-                    : h(other.h), bin(other.bin), entry(other.entry) {}
+                    : h(other.h), entry(other.entry) {}
+
+            HashIterator& operator=(const HashIterator& other) = default;
 
             HashIterator& operator++() {
                 if (!entry) return *this;
-                entry = entry->next;
-                next_non_null_entry();
+                entry = first_entry(entry->next.load(std::memory_order_acquire));
                 return *this;
             }
 
@@ -272,36 +252,36 @@ namespace madness {
             /// Only positive increments are supported
 
             /// This exists to support splitting of range for parallel iteration.
+            /// Whole segments are skipped using their counts.
             void advance(int n) {
                 if (n==0 || !entry) return;
                 MADNESS_ASSERT(n>=0);
 
-                // Linear increment up to end of this bin
-                while (n-- && (entry=entry->next)) {}
-                next_non_null_entry();
-                if (!entry) return; // end
-
-                if (n <= 0) return;
-
-                // If here, will point to first entry in
-                // a bin ... determine which bin contains
-                // our end point.
-                while (unsigned(n) >= h->bins[bin].size()) {
-                    n -= h->bins[bin].size();
-                    ++bin;
-                    if (unsigned(bin) == h->nbins) {
+                node* p = const_cast<node*>(static_cast<const node*>(entry));
+                while (n) {
+                    p = p->next.load(std::memory_order_acquire);
+                    if (!p) {
                         entry = 0;
                         return; // end
                     }
+                    if (p->is_bin()) {
+                        binT* b = static_cast<binT*>(p);
+                        long nb;
+                        while ((nb = b->ninbin) < n) {
+                            n -= nb;
+                            b = b->next_bin.load(std::memory_order_acquire);
+                            if (!b) {
+                                entry = 0;
+                                return; // end
+                            }
+                        }
+                        p = b;
+                    }
+                    else {
+                        --n;
+                    }
                 }
-
-                entry = h->bins[bin].p;
-                MADNESS_ASSERT(entry);
-
-                // Linear increment to target
-                while (n--) entry=entry->next;
-
-                return;
+                entry = static_cast<entryT*>(p);
             }
 
 
@@ -316,13 +296,13 @@ namespace madness {
             reference operator*() const {
                 MADNESS_ASSERT(entry);
                 //if (!entry) throw "Hash iterator: operator*: at end";
-                return entry->datum;
+                return entry->datum();
             }
 
             pointer operator->() const {
                 MADNESS_ASSERT(entry);
                 //if (!entry) throw "Hash iterator: operator->: at end";
-                return &entry->datum;
+                return &entry->datum();
             }
         };
 
@@ -369,12 +349,12 @@ namespace madness {
 
             datumT& operator*() const {
                 if (!entry) MADNESS_EXCEPTION("Hash accessor: operator*: no value", 0);
-                return entry->datum;
+                return entry->datum();
             }
 
             datumT* operator->() const {
                 if (!entry) MADNESS_EXCEPTION("Hash accessor: operator->: no value", 0);
-                return &entry->datum;
+                return &entry->datum();
             }
 
             void release() {
@@ -392,6 +372,14 @@ namespace madness {
 
     } // End of namespace Hash_private
 
+    /// A concurrent hash map that grows as entries are added
+
+    /// Lookups take no lock other than that of the entry requested by an
+    /// accessor, and inserts and erases lock only the bin they modify.
+    /// The number of bins doubles whenever the average number of entries
+    /// per bin exceeds two; see Hash_private for how this works without
+    /// moving entries.  Memory of erased entries (but not their data) is
+    /// kept for reuse until the map is destroyed.
     template < class keyT, class valueT, class hashfunT = Hash<keyT> >
     class ConcurrentHashMap {
     public:
@@ -407,50 +395,285 @@ namespace madness {
         friend class Hash_private::HashIterator<hashT>;
         friend class Hash_private::HashIterator<const hashT>;
 
-    protected:
-        const size_t nbins;         // Number of bins
-        binT* bins;                 // Array of bins
-
     private:
+        typedef Hash_private::node nodeT;
+
+        static const int NSEG = 32;         // Bin segment s>0 holds bins [2^s,2^(s+1)), 0 holds 0 and 1
+        static const size_t MAXBINS = size_t(1) << NSEG;
+        static const long MAXLOAD = 2;      // Max. average no. of entries per bin
+        static const int NCOUNT = 64;       // No. of entry counters (by hash%NCOUNT)
+
+        // Readers may compare the key of an entry that is being recycled,
+        // which is harmless only if the key owns no memory
+        static const bool lockfree_read = std::is_trivially_destructible<keyT>::value;
+
+        struct alignas(64) counterT {
+            std::atomic<long> n;
+        };
+
+        mutable std::atomic<binT*> bins[NSEG];  // Lazily allocated segments of bins
+        std::atomic<size_t> nbins;              // Number of bins (a power of two)
+        counterT counts[NCOUNT];                // Entry counts spread to avoid contention
         hashfunT hashfun;
 
-        //unsigned int hash(const keyT& key) const {return hashfunT::hash(key)%nbins;}
+        /// Returns bin b, allocating its segment if necessary
+        binT* get_bin(size_t b) const {
+            int s = 0;
+            size_t first = 0;
+            if (b > 1) {
+                s = 63 - __builtin_clzll(b);
+                first = size_t(1) << s;
+            }
+            binT* seg = bins[s].load(std::memory_order_acquire);
+            if (!seg) {
+                binT* fresh = new binT[s ? (size_t(1) << s) : 2];
+                if (bins[s].compare_exchange_strong(seg, fresh, std::memory_order_acq_rel)) seg = fresh;
+                else delete [] fresh;
+            }
+            return seg + (b - first);
+        }
 
-        static int nbins_prime(int n) {
-            static const int primes[] = {11, 23, 31, 41, 53, 61, 71, 83, 101,
-                131, 181, 239, 293, 359, 421, 557, 673, 821, 953, 1021, 1231,
-                1531, 1747, 2069, 2543, 3011, 4003, 5011, 6073, 7013, 8053,
-                9029, 9907, 17401, 27479, 37847, 48623, 59377, 70667, 81839,
-                93199, 104759, 224759, 350411, 479951, 611969, 746791, 882391,
-                1299743, 2750171, 4256257, 5800159, 7368811, 8960477, 10570871,
-                12195269, 13834133};
-            static const int nprimes = sizeof(primes)/sizeof(int);
-            // n is a user provided estimate of the no. of elements to be put
-            // in the table.  Want to make the number of bins a prime number
-            // larger than this.
-            for (int i=0; i<nprimes; ++i) if (n<=primes[i]) return primes[i];
-            return primes[nprimes-1];
+        binT* first_bin() const {
+            return get_bin(0);
         }
 
-        unsigned int hash_to_bin(const keyT& key) const {
-            return hashfun(key)%nbins;
+        /// Returns bin b after linking it into the list if that has not been done
+        binT* get_ready_bin(size_t b) const {
+            binT* p = get_bin(b);
+            if (!p->ready.load(std::memory_order_acquire)) init_bin(p, b);
+            return p;
+        }
+
+        /// Links bin b into the list, splitting the segment that holds its place
+        void init_bin(binT* p, size_t b) const {
+            const size_t parent = b & ~(size_t(1) << (63 - __builtin_clzll(b)));
+            const uint64_t order = Hash_private::reverse_bits(b);
+            binT* owner = lock_segment(get_ready_bin(parent), order);
+            if (!p->ready.load(std::memory_order_relaxed)) {
+                nodeT* prev = owner;
+                nodeT* cur = prev->next.load(std::memory_order_relaxed);
+                while (cur && cur->order < order) {
+                    prev = cur;
+                    cur = cur->next.load(std::memory_order_relaxed);
+                }
+                long nmove = 0;
+                for (nodeT* t=cur; t && !t->is_bin(); t=t->next.load(std::memory_order_relaxed)) ++nmove;
+
+                // Readers already in the owner's segment might cross into the new one
+                owner->begin_unlink();
+                p->order = order;
+                p->next.store(cur, std::memory_order_relaxed);
+                p->ninbin = nmove;
+                p->next_bin.store(owner->next_bin.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                owner->ninbin -= nmove;
+                owner->next_bin.store(p, std::memory_order_release);
+                prev->next.store(p, std::memory_order_release);
+                p->ready.store(true, std::memory_order_release);
+                owner->end_unlink();
+            }
+            owner->unlock();
+        }
+
+        /// Starting from bin p, which precedes order in the list, locks and returns the bin whose segment holds order
+        static binT* lock_segment(binT* p, uint64_t order) {
+            p->lock();
+            while (true) {
+                binT* q = p->next_bin.load(std::memory_order_acquire);
+                if (!q || q->order > order) return p;
+                p->unlock();
+                p = q;
+                p->lock();
+            }
+        }
+
+        /// Split-order key of an entry with hash h
+        static uint64_t entry_order(std::size_t h) {
+            return Hash_private::reverse_bits(uint64_t(h) | (uint64_t(1) << 63));
+        }
+
+        /// Hash of an entry reconstructed from its split-order key (enough for bins and counters)
+        static size_t order_hash(uint64_t order) {
+            return Hash_private::reverse_bits(order) & ~(uint64_t(1) << 63);
+        }
+
+        binT* bin_of(std::size_t h) const {
+            return get_ready_bin(size_t(h) & (nbins.load(std::memory_order_relaxed) - 1));
+        }
+
+        /// Counts an entry in or out and doubles the number of bins if they are too full
+        void count(std::size_t h, long n) {
+            std::atomic<long>& c = counts[h % NCOUNT].n;
+            const long nentry = c.fetch_add(n, std::memory_order_relaxed) + n;
+            if (n > 0) {
+                size_t nb = nbins.load(std::memory_order_relaxed);
+                if (nentry*NCOUNT > MAXLOAD*long(nb) && nb < MAXBINS)
+                    nbins.compare_exchange_strong(nb, 2*nb, std::memory_order_relaxed);
+            }
+        }
+
+        /// Searches the segment of locked bin p for key and returns (predecessor, entry or zero)
+        static std::pair<nodeT*,entryT*> match(binT* p, uint64_t order, const keyT& key) {
+            nodeT* prev = p;
+            nodeT* t = p->next.load(std::memory_order_relaxed);
+            while (t && t->order < order) {
+                prev = t;
+                t = t->next.load(std::memory_order_relaxed);
+            }
+            nodeT* first = prev;
+            for (; t && t->order == order; prev=t, t=t->next.load(std::memory_order_relaxed)) {
+                if (static_cast<entryT*>(t)->datum().first == key)
+                    return std::pair<nodeT*,entryT*>(prev, static_cast<entryT*>(t));
+            }
+            return std::pair<nodeT*,entryT*>(first, nullptr);
+        }
+
+        /// Finds key without taking the bin lock and, if found, takes the entry lock
+        entryT* find_entry(const keyT& key, int lockmode) const {
+            const std::size_t h = hashfun(key);
+            const uint64_t order = entry_order(h);
+            binT* p = bin_of(h);
+            madness::MutexWaiter waiter;
+            while (true) {
+                if (!lockfree_read) {
+                    p = lock_segment(p, order);
+                    entryT* result = match(p, order, key).second;
+                    const bool gotlock = !result || result->try_lock(lockmode);
+                    p->unlock();
+                    if (gotlock) return result;
+                    waiter.wait();
+                    continue;
+                }
+
+                const unsigned version = p->version.load(std::memory_order_acquire);
+                if (version & 0x1) {
+                    waiter.wait();
+                    continue;
+                }
+
+                // Walk the segment ... a bin before order means the table has grown
+                entryT* result = nullptr;
+                binT* next_bin = nullptr;
+                bool consistent = true;
+                uint64_t last = p->order;
+                for (nodeT* t=p->next.load(std::memory_order_acquire); t && t->order<=order;
+                     t=t->next.load(std::memory_order_acquire)) {
+                    if (t->order < last) {
+                        consistent = false;
+                        break;
+                    }
+                    last = t->order;
+                    if (t->is_bin()) {
+                        next_bin = static_cast<binT*>(t);
+                        break;
+                    }
+                    if (t->order == order && static_cast<entryT*>(t)->datum().first == key) {
+                        result = static_cast<entryT*>(t);
+                        break;
+                    }
+                }
+                if (next_bin) {
+                    p = next_bin;
+                    continue;
+                }
+
+                const bool gotlock = consistent && (!result || result->try_lock(lockmode));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (p->version.load(std::memory_order_relaxed) != version) {
+                    if (result && gotlock) result->unlock(lockmode);
+                    continue;
+                }
+                if (gotlock) return result;
+                waiter.wait();
+            }
+        }
+
+        std::pair<entryT*,bool> insert_entry(const datumT& datum, int lockmode) {
+            const std::size_t h = hashfun(datum.first);
+            const uint64_t order = entry_order(h);
+            binT* p = bin_of(h);
+            madness::MutexWaiter waiter;
+            while (true) {
+                p = lock_segment(p, order);
+                std::pair<nodeT*,entryT*> r = match(p, order, datum.first);
+                entryT* result = r.second;
+                const bool notfound = !result;
+                if (notfound) {
+                    result = p->alloc();
+                    new (&result->datum()) datumT(datum);
+                    result->order = order;
+                    result->next.store(r.first->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    r.first->next.store(result, std::memory_order_release);
+                    ++(p->ninbin);
+                }
+                const bool gotlock = result->try_lock(lockmode);
+                p->unlock();
+                if (gotlock) {
+                    if (notfound) count(h, 1);
+                    return std::pair<entryT*,bool>(result, notfound);
+                }
+                waiter.wait();
+            }
+        }
+
+        bool del(const keyT& key, int lockmode) {
+            const std::size_t h = hashfun(key);
+            const uint64_t order = entry_order(h);
+            binT* p = lock_segment(bin_of(h), order);
+            std::pair<nodeT*,entryT*> r = match(p, order, key);
+            entryT* t = r.second;
+            if (t) {
+                p->begin_unlink();
+                r.first->next.store(t->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                t->unlock(lockmode);
+                p->recycle(t);
+                --(p->ninbin);
+                p->end_unlink();
+            }
+            p->unlock();
+            if (t) count(h, -1);
+            return t;
         }
 
     public:
+        /// Makes an empty map with about n/2 bins to begin with
         ConcurrentHashMap(int n=1021, const hashfunT& hf = hashfunT())
-                : nbins(hashT::nbins_prime(n))
-                , bins(new binT[nbins])
-                , hashfun(hf) {}
+                : nbins(16)
+                , hashfun(hf) {
+            for (int s=0; s<NSEG; ++s) bins[s] = nullptr;
+            for (int i=0; i<NCOUNT; ++i) counts[i].n = 0;
+            while (long(nbins)*MAXLOAD < n && nbins < MAXBINS) nbins = 2*nbins;
+            binT* b0 = get_bin(0);
+            b0->ready = true;
+        }
 
         ConcurrentHashMap(const  hashT& h)
-                : nbins(h.nbins)
-                , bins(new binT[nbins])
-                , hashfun(h.hashfun) {
+                : ConcurrentHashMap(int(h.nbins*MAXLOAD), h.hashfun) {
             *this = h;
         }
 
         virtual ~ConcurrentHashMap() {
-            delete [] bins;
+            nodeT* t = first_bin()->next.load(std::memory_order_relaxed);
+            while (t) {
+                nodeT* next = t->next.load(std::memory_order_relaxed);
+                if (!t->is_bin()) {
+                    static_cast<entryT*>(t)->datum().~datumT();
+                    delete static_cast<entryT*>(t);
+                }
+                t = next;
+            }
+            for (int s=0; s<NSEG; ++s) {
+                binT* seg = bins[s];
+                if (seg) {
+                    const size_t n = s ? (size_t(1) << s) : 2;
+                    for (size_t i=0; i<n; ++i) {
+                        while (entryT* e = seg[i].free) {
+                            seg[i].free = static_cast<entryT*>(e->next.load(std::memory_order_relaxed));
+                            delete e;
+                        }
+                    }
+                    delete [] seg;
+                }
+            }
         }
 
         hashT& operator=(const  hashT& h) {
@@ -465,16 +688,14 @@ namespace madness {
         }
 
         std::pair<iterator,bool> insert(const datumT& datum) {
-            int bin = hash_to_bin(datum.first);
-            std::pair<entryT*,bool> result = bins[bin].insert(datum,entryT::NOLOCK);
-            return std::pair<iterator,bool>(iterator(this,bin,result.first),result.second);
+            std::pair<entryT*,bool> result = insert_entry(datum,entryT::NOLOCK);
+            return std::pair<iterator,bool>(iterator(this,result.first),result.second);
         }
 
         /// Returns true if new pair was inserted; false if key is already in the map and the datum was not inserted
         bool insert(accessor& result, const datumT& datum) {
             result.release();
-            int bin = hash_to_bin(datum.first);
-            std::pair<entryT*,bool> r = bins[bin].insert(datum,entryT::WRITELOCK);
+            std::pair<entryT*,bool> r = insert_entry(datum,entryT::WRITELOCK);
             result.set(r.first);
             return r.second;
         }
@@ -482,8 +703,7 @@ namespace madness {
         /// Returns true if new pair was inserted; false if key is already in the map and the datum was not inserted
         bool insert(const_accessor& result, const datumT& datum) {
             result.release();
-            int bin = hash_to_bin(datum.first);
-            std::pair<entryT*,bool> r = bins[bin].insert(datum,entryT::READLOCK);
+            std::pair<entryT*,bool> r = insert_entry(datum,entryT::READLOCK);
             result.set(r.first);
             return r.second;
         }
@@ -499,7 +719,7 @@ namespace madness {
         }
 
         std::size_t erase(const keyT& key) {
-            if (bins[hash_to_bin(key)].del(key,entryT::NOLOCK)) return 1;
+            if (del(key,entryT::NOLOCK)) return 1;
             else return 0;
         }
 
@@ -509,34 +729,31 @@ namespace madness {
         }
 
         void erase(accessor& item) {
-            bins[hash_to_bin(item->first)].del(item->first,entryT::WRITELOCK);
+            del(item->first,entryT::WRITELOCK);
             item.unset();
         }
 
         void erase(const_accessor& item) {
             item.convert_read_lock_to_write_lock();
-            bins[hash_to_bin(item->first)].del(item->first,entryT::WRITELOCK);
+            del(item->first,entryT::WRITELOCK);
             item.unset();
         }
 
         iterator find(const keyT& key) {
-            int bin = hash_to_bin(key);
-            entryT* entry = bins[bin].find(key,entryT::NOLOCK);
+            entryT* entry = find_entry(key,entryT::NOLOCK);
             if (!entry) return end();
-            else return iterator(this,bin,entry);
+            else return iterator(this,entry);
         }
 
         const_iterator find(const keyT& key) const {
-            int bin = hash_to_bin(key);
-            const entryT* entry = bins[bin].find(key,entryT::NOLOCK);
+            const entryT* entry = find_entry(key,entryT::NOLOCK);
             if (!entry) return end();
-            else return const_iterator(this,bin,entry);
+            else return const_iterator(this,entry);
         }
 
         bool find(accessor& result, const keyT& key) {
             result.release();
-            int bin = hash_to_bin(key);
-            entryT* entry = bins[bin].find(key,entryT::WRITELOCK);
+            entryT* entry = find_entry(key,entryT::WRITELOCK);
             bool foundit = entry;
             if (foundit) result.set(entry);
             return foundit;
@@ -544,23 +761,41 @@ namespace madness {
 
         bool find(const_accessor& result, const keyT& key) const {
             result.release();
-            int bin = hash_to_bin(key);
-            entryT* entry = bins[bin].find(key,entryT::READLOCK);
+            entryT* entry = find_entry(key,entryT::READLOCK);
             bool foundit = entry;
             if (foundit) result.set(entry);
             return foundit;
         }
 
         void clear() {
-            for (unsigned int i=0; i<nbins; ++i) bins[i].clear();
+            for (binT* p=first_bin(); p; p=p->next_bin.load(std::memory_order_acquire)) {
+                p->lock();
+                p->begin_unlink();
+                nodeT* t = p->next.load(std::memory_order_relaxed);
+                p->next.store(p->next_bin.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                for (; t && !t->is_bin(); ) {
+                    nodeT* next = t->next.load(std::memory_order_relaxed);
+                    counts[order_hash(t->order) % NCOUNT].n--;
+                    p->recycle(static_cast<entryT*>(t));
+                    t = next;
+                }
+                p->ninbin = 0;
+                p->end_unlink();
+                p->unlock();
+            }
         }
 
         size_t size() const {
-            size_t sum = 0;
-            for (size_t i=0; i<nbins; ++i) sum += bins[i].size();
+            long sum = 0;
+            for (int i=0; i<NCOUNT; ++i) sum += counts[i].n.load(std::memory_order_relaxed);
             return sum;
         }
 
+        /// Returns the current number of bins
+        size_t bin_count() const {
+            return nbins;
+        }
+
         valueT& operator[](const keyT& key) {
             std::pair<iterator,bool> it = insert(datumT(key,valueT()));
             return it.first->second;
@@ -593,11 +828,14 @@ namespace madness {
         hashfunT& get_hash() const { return hashfun; }
 
         void print_stats() const {
-            for (unsigned int i=0; i<nbins; ++i) {
-                if (i && (i%10)==0) printf("\n");
-                printf("%8d", int(bins[i].size()));
+            size_t nready = 0, nmax = 0;
+            for (const binT* p=first_bin(); p; p=p->next_bin.load(std::memory_order_acquire)) {
+                ++nready;
+                nmax = std::max(nmax, p->size());
             }
-            printf("\n");
+            printf("entries %lu   bins %lu   linked bins %lu   largest bin %lu\n",
+                   (unsigned long) size(), (unsigned long) bin_count(),
+                   (unsigned long) nready, (unsigned long) nmax);
         }
     };
 }
@@ -34,7 +34,9 @@
 #include <madness/world/worldrmi.h>
 #include <madness/world/posixmem.h>
 #include <madness/world/timers.h>
+#include <madness/world/timeline.h>
 #include <iostream>
+#include <cstdio>
 #include <algorithm>
 #include <utility>
 #include <sstream>
@@ -46,11 +48,17 @@
 namespace madness {
 
     RMI::RmiTask* RMI::task_ptr = nullptr;
+    std::vector<RMI::RmiTask*> RMI::tasks;
     RMIStats RMI::stats;
     volatile bool RMI::debugging = false;
-    std::list< std::unique_ptr<RMISendReq> > RMI::send_req;
+    thread_local std::list< std::unique_ptr<RMISendReq> > RMI::send_req;
 
     thread_local bool RMI::is_server_thread = false;
+    thread_local void* RMI::adoptable_buf = nullptr;
+    thread_local std::shared_ptr<void> RMI::adopted_buf;
+    thread_local unsigned int RMI::next_channel = 0;
+    thread_local RMI::RmiTask* RMI::RmiTask::this_task = nullptr;
+    const int RMI::RmiTask::MAX_IDLE_BACKOFF_US;
 
 #if HAVE_INTEL_TBB
     tbb::task* RMI::tbb_rmi_parent_task = nullptr;
@@ -75,10 +83,19 @@ namespace madness {
           narrived = SafeMPI::Request::Testsome(maxq_, recv_req.get(), ind.get(), status.get());
           if (narrived) break;
           ++iterations;
-          clear_send_req();
-          myusleep(RMI::testsome_backoff_us);
+          clear_send_req(stats);
+          myusleep(backoff_us);
         }
 
+        // With several channels, a channel that has been idle for a whole
+        // round of polling progressively backs off so that it does not
+        // steal cycles from the busy ones; it resumes fast polling as
+        // soon as something arrives.
+        if (narrived)
+            backoff_us = RMI::testsome_backoff_us;
+        else if (adaptive_backoff)
+            backoff_us = std::min(2*backoff_us + 1, MAX_IDLE_BACKOFF_US);
+
 #ifndef HAVE_CRAYXT
         waiter.reset();
 #endif
@@ -87,13 +104,14 @@ namespace madness {
             print_error(rank, ":RMI: ", narrived, " messages just arrived\n");
 
         if (narrived) {
+            const double start = wall_time();
             for (int m=0; m<narrived; ++m) {
                 const int src = status[m].Get_source();
                 const size_t len = status[m].Get_count(MPI_BYTE);
                 const int i = ind[m];
 
-                ++(RMI::stats.nmsg_recv);
-                RMI::stats.nbyte_recv += len;
+                ++(stats.nmsg_recv);
+                stats.nbyte_recv += len;
 
                 const header* h = (const header*)(recv_buf[i]);
                 rmi_handlerT func = archive::to_abs_fn_ptr<rmi_handlerT>(h->func);
@@ -109,7 +127,7 @@ namespace madness {
                                   " count=", count, "\n");
 
                     if (is_ordered(attr)) ++(recv_counters[src]);
-                    func(recv_buf[i], len);
+                    invoke(i, func, len, src);
                     post_recv_buf(i);
                 }
                 else {
@@ -148,7 +166,7 @@ namespace madness {
                                 " count=", q[m].count, "\n");
 
                   ++(recv_counters[src]);
-                  q[m].func(recv_buf[q[m].i], q[m].len);
+                  invoke(q[m].i, q[m].func, q[m].len, src);
                   post_recv_buf(q[m].i);
                 }
                 else {
@@ -171,7 +189,8 @@ namespace madness {
             // aggregates task submission.
             ThreadPool::instance()->flush_prebuf();
 #endif
-            clear_send_req();
+            clear_send_req(stats);
+            stats.busy_time += wall_time() - start;
         }
     }
 
@@ -196,6 +215,38 @@ namespace madness {
         }
     }
 
+    void RMI::RmiTask::invoke(int i, rmi_handlerT func, size_t len, ProcessID src) {
+        // Only the buffer of a huge message is private to the message;
+        // the others are reposted as soon as the handler returns
+        const bool huge = (i == (int)nrecv_);
+        if (huge) adoptable_buf = recv_buf[i];
+
+        if (Timeline::enabled()) {
+            const double t = Timeline::now();
+            func(recv_buf[i], len);
+            Timeline::recv(src, len, reinterpret_cast<const void*>(func), t);
+        }
+        else {
+            func(recv_buf[i], len);
+        }
+
+        if (huge) {
+            adoptable_buf = nullptr;
+            if (adopted_buf) {
+                // Whatever still aliases the buffer now frees it
+                recv_buf[i] = 0;
+                adopted_buf.reset();
+                ++(stats.nmsg_adopted);
+            }
+        }
+    }
+
+    std::shared_ptr<void> RMI::adopt_recv_buffer(const void* buf) {
+        if (!buf || buf != adoptable_buf) return nullptr;
+        if (!adopted_buf) adopted_buf = std::shared_ptr<void>(adoptable_buf, &free);
+        return adopted_buf;
+    }
+
     void RMI::RmiTask::post_recv_buf(int i) {
         if (i < (int)nrecv_) {
             recv_req[i] = comm.Irecv(recv_buf[i], max_msg_len_, MPI_BYTE, MPI_ANY_SOURCE, SafeMPI::RMI_TAG);
@@ -220,9 +271,18 @@ namespace madness {
         //for (int i=0; i<nrecv_; ++i) free(recv_buf[i]);
     }
 
+    RMIStats RMI::RmiTask::get_stats() const {
+        RMIStats result = stats;
+        result.nmsg_sent = nmsg_sent.load(std::memory_order_relaxed);
+        result.nbyte_sent = nbyte_sent.load(std::memory_order_relaxed);
+        if (start_time > 0.0 && result.wall_time == 0.0)
+            result.wall_time = wall_time() - start_time; // Still running
+        return result;
+    }
+
     static volatile bool rmi_task_is_running = false;
 
-    RMI::RmiTask::RmiTask(const SafeMPI::Intracomm& _comm)
+    RMI::RmiTask::RmiTask(const SafeMPI::Intracomm& _comm, int nchannel)
             : comm(_comm.Clone())
             , nproc(comm.Get_size())
             , rank(comm.Get_rank())
@@ -238,6 +298,14 @@ namespace madness {
             , ind()
             , q()
             , n_in_q(0)
+            , stats()
+            , nmsg_sent(0)
+            , nbyte_sent(0)
+            , numsent(0)
+            , start_time(0.0)
+            , backoff_us(RMI::testsome_backoff_us)
+            , adaptive_backoff(nchannel > 1)
+            , tag_(4096)
     {
         // Get the maximum buffer size from the MAD_BUFFER_SIZE environment
         // variable.
@@ -295,6 +363,12 @@ namespace madness {
             maxq_ = nrecv_ + 1;
         }
 
+        // The recv buffers are shared out among the channels
+        if (nchannel > 1) {
+            nrecv_ = std::max(nrecv_/nchannel, std::size_t(32));
+            maxq_ = nrecv_ + 1;
+        }
+
         // Get environment variable controlling use of synchronous send (MAD_NSSEND)
         // negative=sends synchronous message every MAD_RECV_BUFFER sends (default)
         //        0=never send synchronous message
@@ -341,17 +415,22 @@ namespace madness {
         const size_t nbyte = info[nword+1];
         const int tag = info[nword+2];
 
+        // The handler is invoked by the server thread of the channel that
+        // received the request, which must also receive the message itself
+        RmiTask* task = RmiTask::this_task;
+        MADNESS_ASSERT(task);
+
         // extra dose of paranoia: assert that we never process so many huge messages
         // that the tag wraparound somewhere becomes possible ...
         // the worst case is where only one node sends huge messages to every node in the communicator
         // AND it has enough threads to use up all tags
         // NB list::size() is O(1) in c++11, but O(N) in older libstdc++
         bool OK = (ThreadPool::size() < size_t(RMI::RmiTask::unique_tag_period()) ||
-                   RMI::task_ptr->hugeq.size() <
-                   std::size_t(RMI::RmiTask::unique_tag_period() / RMI::task_ptr->comm.Get_size()));
+                   task->hugeq.size() <
+                   std::size_t(RMI::RmiTask::unique_tag_period() / task->comm.Get_size()));
         if (!OK) MADNESS_EXCEPTION("huge_msg_handler paranoid test failing", RMI::RmiTask::unique_tag_period());
-        RMI::task_ptr->hugeq.push_back(std::make_tuple(src, nbyte, tag));
-        RMI::task_ptr->post_pending_huge_msg();
+        task->hugeq.push_back(std::make_tuple(src, nbyte, tag));
+        task->post_pending_huge_msg();
     }
 
     namespace detail {
@@ -400,8 +479,22 @@ namespace madness {
                 if (testsome_backoff_us > 100) testsome_backoff_us = 100;
             }
 
+            // Get the number of server threads from the MAD_NUM_RMI_THREADS
+            // environment variable
+            int nthread = 1;
+            const char* mad_num_rmi_threads = getenv("MAD_NUM_RMI_THREADS");
+            if (mad_num_rmi_threads) {
+                int result = sscanf(mad_num_rmi_threads, "%d", &nthread);
+                if (result != 1)
+                    MADNESS_EXCEPTION("MAD_NUM_RMI_THREADS is not an integer", result);
+                if (nthread < 1) nthread = 1;
+                if (nthread > MAX_NUM_THREADS) nthread = MAX_NUM_THREADS;
+            }
+
             MADNESS_ASSERT(task_ptr == nullptr);
 #if HAVE_INTEL_TBB
+            // Only one server task is launched with TBB
+            nthread = 1;
 
             // Force the RMI task to be picked up by someone other than main thread
             // by keeping main thread occupied AND enqueing enough dummy tasks to make
@@ -411,6 +504,7 @@ namespace madness {
                 new (tbb::task::allocate_root()) tbb::empty_task;
             tbb_rmi_parent_task->set_ref_count(2);
             task_ptr = new (tbb_rmi_parent_task->allocate_child()) RmiTask(comm);
+            tasks.push_back(task_ptr);
 #ifdef MADNESS_CAN_USE_TBB_PRIORITY
             tbb::task::enqueue(*task_ptr, tbb::priority_high);
 #else
@@ -450,8 +544,12 @@ namespace madness {
             tbb::task::destroy(*empty_root);
             task_ptr->comm.Barrier();
 #else
-            task_ptr = new RmiTask(comm);
-            task_ptr->start();
+            // Create all channels before starting any server thread so that
+            // the clones of the communicator are made collectively in order
+            for (int i=0; i<nthread; ++i)
+                tasks.push_back(new RmiTask(comm, nthread));
+            task_ptr = tasks[0];
+            for (RmiTask* t : tasks) t->start();
 #endif // HAVE_INTEL_TBB
         }
 
@@ -463,7 +561,6 @@ namespace madness {
     RMI::Request
     RMI::RmiTask::RmiTask::isend(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr) {
         int tag = SafeMPI::RMI_TAG;
-        static std::size_t numsent = 0; // for tracking synchronous sends
 
         if (nbyte > max_msg_len_) {
             // Huge message protocol ... send message to dest indicating size and origin of huge message.
@@ -495,15 +592,13 @@ namespace madness {
                       " ordered=", is_ordered(attr),
                       " count=", int(send_counters[dest]), "\n");
 
-        // Since most uses are ordered and we need the mutex to accumulate stats
-        // we presently always get the lock
-        lock();
-
         // If ordering need the mutex to enclose sending the message
         // otherwise there is a livelock scenario due to a starved thread
-        // holding an early counter.
-        if (is_ordered(attr)) {
-            //lock();
+        // holding an early counter.  Unordered messages need no lock
+        // since the statistics are atomic.
+        const bool ordered = is_ordered(attr);
+        if (ordered) {
+            lock();
             attr |= ((send_counters[dest]++)<<16);
         }
 
@@ -511,32 +606,31 @@ namespace madness {
         h->func = archive::to_rel_fn_ptr(func);
         h->attr = attr;
 
-        ++(RMI::stats.nmsg_sent);
-        RMI::stats.nbyte_sent += nbyte;
-
+        nmsg_sent.fetch_add(1, std::memory_order_relaxed);
+        nbyte_sent.fetch_add(nbyte, std::memory_order_relaxed);
+        if (Timeline::enabled())
+            Timeline::send(dest, nbyte, reinterpret_cast<const void*>(func));
 
-        numsent++;
+        const std::size_t n = numsent.fetch_add(1, std::memory_order_relaxed) + 1;
         Request result;
-        if (nssend_ && numsent==std::size_t(nssend_)) {
+        if (nssend_ && (n % std::size_t(nssend_)) == 0) {
             result = comm.Issend(buf, nbyte, MPI_BYTE, dest, tag);
-            numsent %= nssend_;
         }
         else {
             result = comm.Isend(buf, nbyte, MPI_BYTE, dest, tag);
         }
 
-        unlock();
+        if (ordered) unlock();
 
         return result;
     }
 
     int RMI::RmiTask::unique_tag() const {
         constexpr int first_tag = 4096;
-        static int tag = first_tag;
         /// should be able to do this with atomics
         lock();
-        tag = (tag == first_tag+unique_tag_period()-1) ? first_tag : tag + 1;
-        const int result = tag;
+        tag_ = (tag_ == first_tag+unique_tag_period()-1) ? first_tag : tag_ + 1;
+        const int result = tag_;
         unlock();
         return result;
     }
@@ -37,18 +37,29 @@
 #include <madness/world/worldtypes.h>
 #include <madness/world/archive.h>
 #include <sstream>
+#include <algorithm>
 #include <utility>
 #include <list>
 #include <memory>
 #include <tuple>
+#include <vector>
+#include <atomic>
 #include <pthread.h>
 #include <madness/world/print.h>
 
 /*
-  There is just one server thread and it is the only one
+  By default there is just one server thread and it is the only one
   messing with the recv buffers, so there is no need for
   mutex on recv related data.
 
+  Optionally (environment variable MAD_NUM_RMI_THREADS) there can
+  be several server threads.  Each server thread owns an independent
+  channel (RmiTask) with its own clone of the communicator, its own
+  recv buffers, and its own send/recv counters, so the above still
+  holds per channel.  Ordered messages between a given pair of
+  processes always travel through the same channel so that ordering
+  is preserved; unordered messages are spread over the channels.
+
   Multiple threads (including the server) may send hence
   we need to be careful about send-related data.
 
@@ -132,9 +143,30 @@ namespace madness {
         uint64_t nmsg_recv;
         uint64_t nbyte_recv;
         uint64_t max_serv_send_q;
+        uint64_t nmsg_adopted; ///< #huge messages whose buffer was kept alive by objects aliasing it
+        double busy_time;   ///< Seconds the server thread(s) spent processing arrived messages
+        double wall_time;   ///< Seconds the server thread(s) have been running
 
         RMIStats()
-            : nmsg_sent(0), nbyte_sent(0), nmsg_recv(0), nbyte_recv(0), max_serv_send_q(0) {}
+            : nmsg_sent(0), nbyte_sent(0), nmsg_recv(0), nbyte_recv(0), max_serv_send_q(0)
+            , nmsg_adopted(0), busy_time(0.0), wall_time(0.0) {}
+
+        /// Fraction of the server thread(s) time spent processing messages
+        double utilization() const {
+            return (wall_time > 0.0) ? busy_time/wall_time : 0.0;
+        }
+
+        RMIStats& operator+=(const RMIStats& other) {
+            nmsg_sent += other.nmsg_sent;
+            nbyte_sent += other.nbyte_sent;
+            nmsg_recv += other.nmsg_recv;
+            nbyte_recv += other.nbyte_recv;
+            max_serv_send_q = std::max(max_serv_send_q, other.max_serv_send_q);
+            nmsg_adopted += other.nmsg_adopted;
+            busy_time += other.busy_time;
+            wall_time += other.wall_time;
+            return *this;
+        }
     };
 
     /// This for RMI server thread to manage lifetime of WorldAM messages that it is sending
@@ -149,6 +181,8 @@ namespace madness {
         typedef uint32_t attrT;
 
         static thread_local bool is_server_thread; //< if true this thread is the server thread
+        static thread_local void* adoptable_buf; //< Huge message whose handler is running on this thread
+        static thread_local std::shared_ptr<void> adopted_buf; //< Owner made by adopt_recv_buffer, if any
 
         
 
@@ -168,11 +202,11 @@ namespace madness {
         static void set_this_thread_is_server(bool flag = true) {is_server_thread = flag;}
         static bool get_this_thread_is_server() {return is_server_thread;}
 
-        static std::list< std::unique_ptr<RMISendReq> > send_req; // List of outstanding world active messages sent by the server
+        static thread_local std::list< std::unique_ptr<RMISendReq> > send_req; // List of outstanding world active messages sent by this server thread
 
     private:
 
-        static void clear_send_req() {
+        static void clear_send_req(RMIStats& stats) {
             //std::cout << "clearing server messages " << pthread_self() << std::endl;
             stats.max_serv_send_q = std::max(stats.max_serv_send_q,uint64_t(send_req.size()));
             auto it=send_req.begin();
@@ -221,24 +255,42 @@ namespace madness {
             std::unique_ptr<qmsg[]> q;
             int n_in_q;
 
+            RMIStats stats;                        // Receive-side stats (server thread only)
+            std::atomic<uint64_t> nmsg_sent;       // Send-side stats (any thread)
+            std::atomic<uint64_t> nbyte_sent;
+            std::atomic<std::size_t> numsent;      // For tracking synchronous sends
+            double start_time;                     // When the server thread started
+            int backoff_us;                        // Present sleep between polls
+            const bool adaptive_backoff;           // If true idle channels back off
+            static const int MAX_IDLE_BACKOFF_US = 500;
+
+            static thread_local RmiTask* this_task; // The channel served by this thread, if any
+
             static inline bool is_ordered(attrT attr) { return attr & ATTR_ORDERED; }
 
             void process_some();
 
-            RmiTask(const SafeMPI::Intracomm& comm = SafeMPI::COMM_WORLD);
+            RmiTask(const SafeMPI::Intracomm& comm = SafeMPI::COMM_WORLD, int nchannel = 1);
             virtual ~RmiTask();
 
+            /// Returns the statistics of this channel
+            RMIStats get_stats() const;
+
             static void set_rmi_task_is_running(bool flag = true);
 
 #if HAVE_INTEL_TBB
             tbb::task* execute() {
                 set_rmi_task_is_running(true);
                 RMI::set_this_thread_is_server(true);
+                this_task = this;
+                start_time = madness::wall_time();
 
                 while (! finished) process_some();
+                stats.wall_time = madness::wall_time() - start_time;
                 finished = false;  // to ensure that RmiTask::exit() that
                                    // triggered the exit proceeds to completion
 
+                this_task = nullptr;
                 RMI::set_this_thread_is_server(false);
                 set_rmi_task_is_running(false);
                 return nullptr;
@@ -246,14 +298,20 @@ namespace madness {
 #else
             void run() {
                 RMI::set_this_thread_is_server(true);
+                Timeline::set_thread_name("rmi server");
+                this_task = this;
+                start_time = madness::wall_time();
                 try {
                     while (! finished) process_some();
+                    stats.wall_time = madness::wall_time() - start_time;
                     finished = false;
                 } catch(...) {
                     delete this;
+                    this_task = nullptr;
                     RMI::set_this_thread_is_server(false);
                     throw;
                 }
+                this_task = nullptr;
                 RMI::set_this_thread_is_server(false);
             }
 #endif // HAVE_INTEL_TBB
@@ -276,8 +334,13 @@ namespace madness {
 
             void post_recv_buf(int i);
 
+            /// Runs the handler of the message in receive buffer \c i
+            void invoke(int i, rmi_handlerT func, size_t len, ProcessID src);
+
         private:
 
+            mutable int tag_; // Last tag returned by unique_tag()
+
             /// thread-safely round-robins through tags in [first_tag, first_tag+period) range
             /// @returns new tag to be used in messaging
             int unique_tag() const;
@@ -291,12 +354,25 @@ namespace madness {
         static tbb::task* tbb_rmi_parent_task;
 #endif // HAVE_INTEL_TBB
 
-        static RmiTask* task_ptr;    // Pointer to the singleton instance
-        static RMIStats stats;
+        static RmiTask* task_ptr;    // Pointer to the first channel (always present if running)
+        static std::vector<RmiTask*> tasks; // All channels, one server thread each
+        static RMIStats stats;       // Stats accumulated from channels that have ended
+        static thread_local unsigned int next_channel; // Round-robin channel for unordered sends
         static volatile bool debugging;    // True if debugging
 
         static const size_t DEFAULT_MAX_MSG_LEN = 3*512*1024;  //!< the default size of recv buffers, in bytes; the actual size can be configured by the user via envvar MAD_BUFFER_SIZE
         static const int DEFAULT_NRECV = 128;  //!< the default # of recv buffers; the actual number can be configured by the user via envvar MAD_RECV_BUFFERS
+        static const int MAX_NUM_THREADS = 16; //!< the maximum # of server threads; the actual number can be configured by the user via envvar MAD_NUM_RMI_THREADS
+
+        /// Selects the channel used to send a message to \c dest
+        static RmiTask* select_channel(ProcessID dest, unsigned int attr) {
+            const std::size_t n = tasks.size();
+            if (n == 1) return task_ptr;
+            if (attr & ATTR_ORDERED)
+                return tasks[(task_ptr->rank + dest) % n]; // Fixed per pair to preserve order
+            else
+                return tasks[(next_channel++) % n];
+        }
 
         // Not allowed
         RMI(const RMI&);
@@ -318,16 +394,25 @@ namespace madness {
             return task_ptr->maxq_;
         }
 
-        /// Returns the number of recv buffers
+        /// Returns the number of recv buffers per server thread
 
-        /// @return The number of recv buffers
-        /// @note The default value is given by RMI::DEFAULT_NRECV, can be overridden at runtime by the user via environment variable MAD_RECV_BUFFERS
+        /// @return The number of recv buffers per server thread
+        /// @note The default value is given by RMI::DEFAULT_NRECV, can be overridden at runtime by the user via environment variable MAD_RECV_BUFFERS.
+        /// The buffers are divided among the server threads.
         /// @warning Cannot be smaller than 32.
         static std::size_t nrecv() {
             MADNESS_ASSERT(task_ptr);
             return task_ptr->nrecv_;
         }
 
+        /// Returns the number of server threads
+
+        /// @return The number of server threads (0 if RMI is not running)
+        /// @note The default is 1, can be overridden at runtime by the user via environment variable MAD_NUM_RMI_THREADS
+        static std::size_t num_threads() {
+            return tasks.size();
+        }
+
         /// Send a remote method invocation (again you should probably be looking at worldam.h instead)
 
         /// @param[in] buf Pointer to the data buffer (do not modify until send is completed)
@@ -344,22 +429,37 @@ namespace madness {
                   "!! MADNESS RMI error: This typically occurs when an active message is sent or a remote task is spawned after calling madness::finalize()\n");
               MADNESS_EXCEPTION("!! MADNESS error: The RMI thread is not running", (task_ptr != nullptr));
             }
-            return task_ptr->isend(buf, nbyte, dest, func, attr);
+            return select_channel(dest, attr)->isend(buf, nbyte, dest, func, attr);
         }
 
+        /// Shares ownership of the buffer of a huge message with its handler
+
+        /// Messages longer than \c max_msg_len() are received into a
+        /// buffer of their own that is freed when the handler returns.  A
+        /// handler may instead keep it alive by calling this with the
+        /// address it was given, so that objects deserialized from the
+        /// message (e.g., tensors) can alias the buffer rather than copy
+        /// out of it.  The buffer is freed when the last owner goes away.
+        /// \param[in] buf The address passed to the running handler
+        /// \return Owner of the buffer, or null if \c buf is not a huge
+        ///     message being handled by the calling thread
+        static std::shared_ptr<void> adopt_recv_buffer(const void* buf);
+
         static void assert_aslr_off(const SafeMPI::Intracomm& comm = SafeMPI::COMM_WORLD);  // will complain to std::cerr and throw if ASLR is on
 
         static void begin(const SafeMPI::Intracomm& comm = SafeMPI::COMM_WORLD);
 
         static void end() {
             if(task_ptr) {
-                task_ptr->exit();
+                for (RmiTask* t : tasks) t->exit();
+                for (RmiTask* t : tasks) stats += t->get_stats();
 #if HAVE_INTEL_TBB
                 tbb_rmi_parent_task->wait_for_all();
                 tbb::task::destroy(*tbb_rmi_parent_task);
 #else
-                delete task_ptr;
+                for (RmiTask* t : tasks) delete t;
 #endif // HAVE_INTEL_TBB
+                tasks.clear();
                 task_ptr = nullptr;
             }
         }
@@ -368,7 +468,18 @@ namespace madness {
 
         static bool get_debug() { return debugging; }
 
-        static const RMIStats& get_stats() { return stats; }
+        /// Returns the statistics summed over all server threads
+        static RMIStats get_stats() {
+            RMIStats result = stats;
+            for (const RmiTask* t : tasks) result += t->get_stats();
+            return result;
+        }
+
+        /// Returns the statistics of server thread \c i
+        static RMIStats get_stats(std::size_t i) {
+            MADNESS_ASSERT(i < tasks.size());
+            return tasks[i]->get_stats();
+        }
     }; // class RMI
 
 } // namespace madness
@@ -0,0 +1,219 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_WORLD_WSDEQUE_H__INCLUDED
+#define MADNESS_WORLD_WSDEQUE_H__INCLUDED
+
+/// \file wsdeque.h
+/// \brief Implements WSDeque, a lock-free work-stealing deque
+
+#include <madness/world/madness_exception.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace madness {
+
+    struct WSDQStats {
+        uint64_t npush;         ///< #calls to push by the owner
+        uint64_t npop;          ///< #successful pops by the owner
+        uint64_t nsteal;        ///< #successful steals by other threads
+        uint64_t ngrow;         ///< #times the buffer was grown
+        uint64_t nsteal_remote; ///< #steals across NUMA domains (counted by the thread pool)
+
+        WSDQStats()
+                : npush(0), npop(0), nsteal(0), ngrow(0), nsteal_remote(0) {}
+    };
+
+
+    /// A lock-free, single-owner, multi-thief double-ended queue.
+
+    /// This is the dynamic circular work-stealing deque of Chase and
+    /// Lev (SPAA 2005) with the C++11 memory orderings of Le et al.
+    /// (PPoPP 2013).  Only the owning thread may call push() and pop(),
+    /// which operate on the bottom of the deque in LIFO order;
+    /// any thread may call steal(), which takes from the top in FIFO
+    /// order.  The buffer grows as needed but never shrinks; retired
+    /// buffers are kept until destruction since a thief may still be
+    /// reading from them.
+    ///
+    /// T must be a pointer (or other trivially copyable type for which
+    /// T() is an acceptable "empty" value).
+    template <typename T>
+    class WSDeque {
+        class Array {
+            const int64_t mask;
+            std::atomic<T>* const buf;
+
+        public:
+            Array(int64_t size) : mask(size-1), buf(new std::atomic<T>[size]) {}
+
+            ~Array() {delete [] buf;}
+
+            int64_t size() const {return mask+1;}
+
+            T get(int64_t i) const {
+                return buf[i & mask].load(std::memory_order_relaxed);
+            }
+
+            void put(int64_t i, T value) {
+                buf[i & mask].store(value, std::memory_order_relaxed);
+            }
+
+            Array* grow(int64_t bottom, int64_t top) const {
+                Array* a = new Array(2*size());
+                for (int64_t i=top; i<bottom; ++i) a->put(i, get(i));
+                return a;
+            }
+        };
+
+        char pad0[64];                       ///< Keep top and bottom in separate cache lines
+        std::atomic<int64_t> top;            ///< Index thieves steal from
+        char pad1[64];
+        std::atomic<int64_t> bottom;         ///< Index the owner pushes/pops at
+        std::atomic<Array*> array;           ///< Current buffer
+        std::vector<Array*> retired;         ///< Old buffers (owner only)
+        WSDQStats stats;                     ///< Owner statistics (npush, npop, ngrow)
+        std::atomic<uint64_t> nstolen;       ///< Steal counter updated by thieves
+
+    public:
+        /// Constructs an empty deque
+
+        /// \param[in] hint Initial capacity, rounded up to a power of two
+        WSDeque(std::size_t hint=1024)
+            : top(0), bottom(0), array(nullptr), nstolen(0)
+        {
+            int64_t sz = 2;
+            while (sz < int64_t(hint)) sz <<= 1;
+            array.store(new Array(sz), std::memory_order_relaxed);
+        }
+
+        WSDeque(const WSDeque&) = delete;
+        WSDeque& operator=(const WSDeque&) = delete;
+
+        ~WSDeque() {
+            delete array.load(std::memory_order_relaxed);
+            for (Array* a : retired) delete a;
+        }
+
+        /// Pushes value onto the bottom of the deque (owner only)
+        void push(T value) {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            Array* a = array.load(std::memory_order_relaxed);
+            if (b - t > a->size() - 1) {
+                Array* na = a->grow(b, t);
+                retired.push_back(a);
+                array.store(na, std::memory_order_release);
+                a = na;
+                ++(stats.ngrow);
+            }
+            a->put(b, value);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b+1, std::memory_order_relaxed);
+            ++(stats.npush);
+        }
+
+        /// Pops the most recently pushed value off the bottom (owner only)
+
+        /// \param[out] value The popped value if successful
+        /// \return True if a value was popped
+        bool pop(T& value) {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            Array* a = array.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            bool got = false;
+            if (t <= b) {
+                value = a->get(b);
+                got = true;
+                if (t == b) {
+                    // Last element ... race against thieves for it
+                    if (!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst,
+                                                     std::memory_order_relaxed))
+                        got = false;
+                    bottom.store(b+1, std::memory_order_relaxed);
+                }
+            }
+            else {
+                bottom.store(b+1, std::memory_order_relaxed);
+            }
+            if (got) ++(stats.npop);
+            return got;
+        }
+
+        /// Steals the oldest value from the top (any thread)
+
+        /// May spuriously fail if it loses a race with another thief or
+        /// the owner.
+        /// \param[out] value The stolen value if successful
+        /// \return True if a value was stolen
+        bool steal(T& value) {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t < b) {
+                Array* a = array.load(std::memory_order_acquire);
+                T x = a->get(t);
+                if (!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed))
+                    return false;
+                value = x;
+                nstolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+
+        /// Approximate number of elements (exact only when quiescent)
+        std::size_t size() const {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_relaxed);
+            return (b > t) ? std::size_t(b - t) : 0;
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        /// Returns statistics; only consistent when quiescent
+        WSDQStats get_stats() const {
+            WSDQStats s = stats;
+            s.nsteal = nstolen.load(std::memory_order_relaxed);
+            return s;
+        }
+    };
+
+}  // namespace madness
+
+#endif // MADNESS_WORLD_WSDEQUE_H__INCLUDED